@@ -0,0 +1,73 @@
+// bench_lexer.cpp
+// 词法分析器基准：零拷贝模式下，lex 耗时应随模板大小线性增长
+// 编译: g++ -std=c++17 -O2 -I.. bench_lexer.cpp ../trace.cpp ../lexer.cpp -o bench_lexer
+#include "lexer.h"
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+
+// 丢弃所有输出的streambuf，屏蔽词法分析器的调试输出
+class NullBuffer : public std::streambuf {
+protected:
+    int overflow(int c) { return c; }
+};
+
+// 生成大约targetBytes字节的部署模板
+static std::string makeTemplate(size_t targetBytes) {
+    const std::string block =
+        "apiVersion: apps/v1\n"
+        "kind: Deployment\n"
+        "metadata:\n"
+        "  name: {{ .Values.nameOverride | default \"myapp\" }}\n"
+        "spec:\n"
+        "  replicas: {{ .Values.replicaCount }}\n"
+        "  {{- if .Values.service.enabled }}\n"
+        "  ports:\n"
+        "  - containerPort: {{ .Values.service.port }}\n"
+        "  {{- end }}\n"
+        "  {{/* 注释 */}}\n";
+    std::string result;
+    result.reserve(targetBytes + block.size());
+    while (result.size() < targetBytes) {
+        result += block;
+    }
+    return result;
+}
+
+int main() {
+    NullBuffer nullBuffer;
+    std::streambuf* old = std::cout.rdbuf(&nullBuffer);
+
+    std::ostringstream report;
+    report << "size(KB)\ttokens\ttime(ms)\tns/byte" << std::endl;
+
+    for (size_t kb = 64; kb <= 8 * 1024; kb *= 2) {
+        std::shared_ptr<const std::string> source =
+            std::make_shared<const std::string>(makeTemplate(kb * 1024));
+
+        std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+        Lexer lexer("bench", source, "{{", "}}");
+        LexOptions options;
+        options.zeroCopy = true;
+        lexer.setOptions(options);
+        size_t tokens = 0;
+        for (;;) {
+            Item item = lexer.nextItem();
+            ++tokens;
+            if (item.type == ItemEOF || item.type == ItemError) {
+                break;
+            }
+        }
+        std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+        double ms = std::chrono::duration<double, std::milli>(end - begin).count();
+        report << kb << "\t" << tokens << "\t" << ms << "\t"
+               << (ms * 1e6 / static_cast<double>(source->size())) << std::endl;
+    }
+
+    std::cout.rdbuf(old);
+    std::cout << report.str();
+    return 0;
+}
@@ -0,0 +1,108 @@
+// bench_parse.cpp
+// 解析基准：统计解析 SingleTemplateAndValues/deployment.yaml 一次所需的堆分配次数和耗时
+// 同时测量在前面加上 _helpers.tpl 风格的 define 块之后的情况，覆盖 define 子树进入 treeSet 的路径
+// 编译: g++ -std=c++17 -O2 -I.. bench_parse.cpp ../trace.cpp ../arena.cpp ../lexer.cpp ../node.cpp ../tree_nodes.cpp ../parse.cpp -o bench_parse
+// 运行: ./bench_parse [模板文件]
+#include "parse.h"
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <string>
+
+// 全局分配计数
+static size_t g_allocCount = 0;
+static size_t g_allocBytes = 0;
+
+void* operator new(size_t size) {
+    ++g_allocCount;
+    g_allocBytes += size;
+    void* p = std::malloc(size ? size : 1);
+    if (p == NULL) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    std::free(p);
+}
+
+// 丢弃所有输出的streambuf，屏蔽解析器的调试输出
+class NullBuffer : public std::streambuf {
+protected:
+    int overflow(int c) { return c; }
+};
+
+// deployment.yaml 引用的命名模板，模拟 chart 中 _helpers.tpl 的内容
+static const char* HELPERS =
+    "{{- define \"mysql.name\" -}}\n"
+    "{{- default .Chart.Name .Values.nameOverride | trunc 63 | trimSuffix \"-\" -}}\n"
+    "{{- end -}}\n"
+    "{{- define \"mysql.fullname\" -}}\n"
+    "{{- if .Values.fullnameOverride -}}\n"
+    "{{- .Values.fullnameOverride | trunc 63 | trimSuffix \"-\" -}}\n"
+    "{{- else -}}\n"
+    "{{- printf \"%s-%s\" .Release.Name .Chart.Name | trunc 63 | trimSuffix \"-\" -}}\n"
+    "{{- end -}}\n"
+    "{{- end -}}\n";
+
+// 重复解析iterations次，输出每次解析的平均分配次数、字节数和耗时
+static std::string runCase(const std::string& label, const std::string& text, int iterations) {
+    size_t trees = 0;
+    size_t allocCount = 0;
+    size_t allocBytes = 0;
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        size_t countBefore = g_allocCount;
+        size_t bytesBefore = g_allocBytes;
+        std::map<std::string, Tree*> treeSet = Tree::Parse("deployment", text, "{{", "}}");
+        allocCount += g_allocCount - countBefore;
+        allocBytes += g_allocBytes - bytesBefore;
+        trees = treeSet.size();
+        for (std::map<std::string, Tree*>::iterator it = treeSet.begin(); it != treeSet.end(); ++it) {
+            delete it->second;
+        }
+    }
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+    double us = std::chrono::duration<double, std::micro>(end - begin).count() / iterations;
+    std::ostringstream report;
+    report << label << " (" << text.size() << " bytes)" << std::endl;
+    report << "  trees per parse: " << trees << std::endl;
+    report << "  allocations per parse: " << allocCount / iterations << std::endl;
+    report << "  allocated bytes per parse: " << allocBytes / iterations << std::endl;
+    report << "  time per parse (us): " << us << std::endl;
+    return report.str();
+}
+
+int main(int argc, char* argv[]) {
+    std::string path = argc > 1 ? argv[1] : "../SingleTemplateAndValues/deployment.yaml";
+    std::ifstream file(path.c_str());
+    if (!file) {
+        std::cerr << "无法打开模板文件: " << path << std::endl;
+        return 1;
+    }
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    const std::string text = buffer.str();
+
+    NullBuffer nullBuffer;
+    std::streambuf* oldOut = std::cout.rdbuf(&nullBuffer);
+    std::streambuf* oldErr = std::cerr.rdbuf(&nullBuffer);
+
+    const int iterations = 200;
+    std::string report = runCase(path, text, iterations);
+    report += runCase(path + " + helpers", HELPERS + text, iterations);
+
+    std::cout.rdbuf(oldOut);
+    std::cerr.rdbuf(oldErr);
+    std::cout << report;
+    return 0;
+}
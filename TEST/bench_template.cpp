@@ -0,0 +1,104 @@
+// bench_template.cpp
+// 具名模板输出缓存基准：模拟 deployment.yaml 对 fullname/labels 等辅助模板的反复调用，
+// 分别在打开和关闭 ExecOptions::memoizeTemplates 时渲染同一模板，比较耗时并报告缓存命中次数
+// 编译: g++ -std=c++17 -O2 -I.. bench_template.cpp ../trace.cpp ../file_loader.cpp ../values.cpp ../yaml_reader.cpp ../exec.cpp ../template_cache.cpp ../tree_optimizer.cpp ../output_sink.cpp ../bytecode.cpp ../parse.cpp ../tree_nodes.cpp ../node.cpp ../lexer.cpp ../arena.cpp -lpthread -o bench_template
+// 运行: ./bench_template [容器数]
+#include "exec.h"
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+using namespace template_engine;
+
+// 丢弃所有输出，只统计字节数
+class DiscardSink : public OutputSink {
+public:
+    DiscardSink() : bytes_(0) {}
+    virtual void Write(const char*, size_t size) { bytes_ += size; }
+    size_t Bytes() const { return bytes_; }
+
+private:
+    size_t bytes_;
+};
+
+static std::string generateValues(int containers) {
+    std::ostringstream out;
+    out << "Release:\n  Name: demo\n  Service: Helm\n";
+    out << "Chart:\n  Name: mysql\n  Version: 1.2.3\n";
+    out << "Values:\n  fullnameOverride: \"\"\n  image:\n    repository: mysql\n    tag: \"8.0\"\n";
+    out << "  containers:\n";
+    for (int i = 0; i < containers; ++i) {
+        out << "    - name: c" << i << "\n      port: " << 3306 + i << "\n";
+    }
+    return out.str();
+}
+
+// 辅助模板都只依赖"$"，每个容器都调用一次
+static const char* kTemplate =
+    "{{- define \"mysql.name\" -}}{{ default .Chart.Name .Values.nameOverride }}{{- end -}}\n"
+    "{{- define \"mysql.fullname\" -}}{{ .Release.Name }}-{{ template \"mysql.name\" . }}{{- end -}}\n"
+    "{{- define \"mysql.labels\" -}}\n"
+    "app: {{ template \"mysql.name\" . }}\n"
+    "chart: {{ .Chart.Name }}-{{ .Chart.Version }}\n"
+    "release: {{ .Release.Name }}\n"
+    "heritage: {{ .Release.Service }}\n"
+    "{{- end -}}\n"
+    "metadata:\n"
+    "  name: {{ template \"mysql.fullname\" . }}\n"
+    "  labels:\n"
+    "{{ template \"mysql.labels\" . }}\n"
+    "containers:\n"
+    "{{- range .Values.containers }}\n"
+    "- name: {{ template \"mysql.fullname\" $ }}-{{ .name }}\n"
+    "  image: {{ $.Values.image.repository }}:{{ $.Values.image.tag }}\n"
+    "  labels:\n"
+    "{{ template \"mysql.labels\" $ }}\n"
+    "{{- end }}\n";
+
+static double renderMs(const Values* data, bool memoize, int iterations, size_t& bytes, ExecStats& stats) {
+    ExecOptions options;
+    options.memoizeTemplates = memoize;
+    DiscardSink sink;
+    // 预热：编译模板
+    ExecuteTemplate("bench", kTemplate, data, sink, "{{", "}}", options);
+    options.stats = &stats;
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        ExecuteTemplate("bench", kTemplate, data, sink, "{{", "}}", options);
+    }
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+    bytes = sink.Bytes() / (iterations + 1);
+    return std::chrono::duration<double, std::milli>(end - begin).count() / iterations;
+}
+
+int main(int argc, char* argv[]) {
+    int containers = argc > 1 ? std::atoi(argv[1]) : 500;
+    if (containers <= 0) {
+        std::cerr << "用法: bench_template [容器数]" << std::endl;
+        return 1;
+    }
+
+    Values* data = ParseSimpleYAML(generateValues(containers));
+    const int iterations = 20;
+    size_t bytesOff = 0;
+    size_t bytesOn = 0;
+    ExecStats statsOff;
+    ExecStats statsOn;
+    double off = renderMs(data, false, iterations, bytesOff, statsOff);
+    double on = renderMs(data, true, iterations, bytesOn, statsOn);
+    delete data;
+
+    if (bytesOff != bytesOn) {
+        std::cerr << "输出不一致: " << bytesOff << " != " << bytesOn << std::endl;
+        return 1;
+    }
+    std::cout << containers << " containers, " << bytesOn << " bytes per render" << std::endl;
+    std::cout << "  memoize off (ms per render): " << off << ", template calls: "
+              << statsOff.templateCalls / iterations << std::endl;
+    std::cout << "  memoize on  (ms per render): " << on << ", template calls: "
+              << statsOn.templateCalls / iterations << ", memo hits: " << statsOn.memoHits / iterations << std::endl;
+    std::cout << "  speedup: " << off / on << "x" << std::endl;
+    return 0;
+}
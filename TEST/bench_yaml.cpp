@@ -0,0 +1,120 @@
+// bench_yaml.cpp
+// values解析基准：统计解析一份values文件所需的堆分配次数和耗时
+// 不指定文件时生成一份约5万行的values文档，包含嵌套映射、对象列表、流式集合、块标量、引号和注释
+// 编译: g++ -std=c++17 -O2 -I.. bench_yaml.cpp ../trace.cpp ../file_loader.cpp ../values.cpp ../yaml_reader.cpp ../exec.cpp ../template_cache.cpp ../tree_optimizer.cpp ../output_sink.cpp ../bytecode.cpp ../parse.cpp ../tree_nodes.cpp ../node.cpp ../lexer.cpp ../arena.cpp -o bench_yaml
+// 运行: ./bench_yaml [values文件]
+#include "values.h"
+#include "file_loader.h"
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <string>
+
+using namespace template_engine;
+
+// 全局分配计数
+static size_t g_allocCount = 0;
+static size_t g_allocBytes = 0;
+
+void* operator new(size_t size) {
+    ++g_allocCount;
+    g_allocBytes += size;
+    void* p = std::malloc(size ? size : 1);
+    if (p == NULL) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    std::free(p);
+}
+
+// 生成一份values文档，每个服务约25行
+static std::string generateValues(int services) {
+    std::ostringstream out;
+    out << "## generated values\n";
+    out << "global:\n  imageRegistry: \"registry.example.com\"\n  pullSecrets: []\n\n";
+    out << "services:\n";
+    for (int i = 0; i < services; ++i) {
+        out << "  svc" << i << ":\n"
+            << "    enabled: " << (i % 2 ? "true" : "false") << "\n"
+            << "    replicaCount: " << (i % 5 + 1) << "\n"
+            << "    image:\n"
+            << "      repository: app/service-" << i << "\n"
+            << "      tag: \"1." << i << ".0\"\n"
+            << "      pullPolicy: IfNotPresent  # 拉取策略\n"
+            << "    ports: [8080, 8443]\n"
+            << "    labels: {tier: backend, team: 'core'}\n"
+            << "    env:\n"
+            << "      - name: LOG_LEVEL\n"
+            << "        value: info\n"
+            << "      - name: TIMEOUT_SECONDS\n"
+            << "        value: \"30\"\n"
+            << "    resources:\n"
+            << "      limits:\n"
+            << "        cpu: 500m\n"
+            << "        memory: 512Mi\n"
+            << "      requests: {cpu: 100m, memory: 128Mi}\n"
+            << "    config: |\n"
+            << "      server.port=8080\n"
+            << "      server.name=service-" << i << "\n"
+            << "\n"
+            << "    # 可选的亲和性设置\n"
+            << "    affinity: {}\n"
+            << "    nodeSelector:\n";
+    }
+    return out.str();
+}
+
+int main(int argc, char* argv[]) {
+    std::string label;
+    std::string text;
+    if (argc > 1) {
+        label = argv[1];
+        if (!ReadFile(label, text)) {
+            std::cerr << "无法打开values文件: " << label << std::endl;
+            return 1;
+        }
+    } else {
+        label = "generated";
+        text = generateValues(2000);
+    }
+
+    size_t lines = 0;
+    for (size_t i = 0; i < text.size(); ++i) {
+        lines += text[i] == '\n';
+    }
+
+    // 解析和释放分开计时
+    const int iterations = 20;
+    size_t allocCount = 0;
+    size_t allocBytes = 0;
+    double parseMs = 0;
+    double freeMs = 0;
+    for (int i = 0; i < iterations; ++i) {
+        size_t countBefore = g_allocCount;
+        size_t bytesBefore = g_allocBytes;
+        std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+        Values* values = ParseSimpleYAML(text);
+        std::chrono::steady_clock::time_point parsed = std::chrono::steady_clock::now();
+        allocCount += g_allocCount - countBefore;
+        allocBytes += g_allocBytes - bytesBefore;
+        delete values;
+        std::chrono::steady_clock::time_point freed = std::chrono::steady_clock::now();
+        parseMs += std::chrono::duration<double, std::milli>(parsed - begin).count();
+        freeMs += std::chrono::duration<double, std::milli>(freed - parsed).count();
+    }
+    std::cout << label << " (" << lines << " lines, " << text.size() << " bytes)" << std::endl;
+    std::cout << "  allocations per parse: " << allocCount / iterations << std::endl;
+    std::cout << "  allocated bytes per parse: " << allocBytes / iterations << std::endl;
+    std::cout << "  time per parse (ms): " << parseMs / iterations << std::endl;
+    std::cout << "  time to free the result (ms): " << freeMs / iterations << std::endl;
+    return 0;
+}
@@ -0,0 +1,59 @@
+// test_scope.cpp
+// 变量作用域检查：if/with/range的条件和各分支中声明的变量在{{end}}之后不可见（与Go text/template一致），
+// 同名声明只遮蔽外层变量；range的声明按每次迭代绑定下标/键和元素。任一用例输出不符时返回1
+// 编译: g++ -std=c++17 -O2 -I.. test_scope.cpp ../trace.cpp ../file_loader.cpp ../values.cpp ../yaml_reader.cpp ../exec.cpp ../template_cache.cpp ../tree_optimizer.cpp ../output_sink.cpp ../bytecode.cpp ../parse.cpp ../tree_nodes.cpp ../node.cpp ../lexer.cpp ../arena.cpp -lpthread -o test_scope
+// 运行: ./test_scope
+#include "exec.h"
+#include <iostream>
+#include <string>
+
+using namespace template_engine;
+
+struct ScopeCase {
+    const char* text;
+    const char* expected;
+};
+
+static const ScopeCase kCases[] = {
+    // if分支中的同名声明只遮蔽到{{end}}
+    {"{{ $x := \"a\" }}{{ if .Values.flag }}{{ $x := \"b\" }}{{ end }}[{{ $x }}]", "[a]"},
+    // if条件中的声明只在if内可见
+    {"{{ $x := \"a\" }}{{ if $x := .Values.x }}<{{ $x }}>{{ end }}[{{ $x }}]", "<hello>[a]"},
+    {"{{ $x := \"a\" }}{{ if .Values.none }}{{ else }}{{ $x := \"c\" }}{{ $x }}{{ end }}[{{ $x }}]", "c[a]"},
+    {"{{ $x := \"a\" }}{{ if .Values.flag }}{{ if .Values.flag }}{{ $x := \"n\" }}{{ $x }}{{ end }}{{ $x }}{{ end }}[{{ $x }}]",
+     "na[a]"},
+    // 条件为常量、编译时展开的分支同样不泄漏声明
+    {"{{ $x := \"a\" }}{{ if true }}{{ $x := \"b\" }}{{ $x }}{{ end }}[{{ $x }}]", "b[a]"},
+    {"{{ $x := \"a\" }}{{ with false }}{{ else }}{{ $x := \"f\" }}{{ end }}[{{ $x }}]", "[a]"},
+    // 赋值修改外层变量
+    {"{{ $x := \"a\" }}{{ if .Values.flag }}{{ $x = \"b\" }}{{ end }}[{{ $x }}]", "[b]"},
+    {"{{ $x := \"a\" }}{{ with $x := .Values.x }}<{{ $x }}>{{ end }}[{{ $x }}]", "<hello>[a]"},
+    {"{{ $x := \"a\" }}{{ with .Values.none }}{{ else }}{{ $x := \"d\" }}{{ end }}[{{ $x }}]", "[a]"},
+    {"{{ $x := \"a\" }}{{ range .Values.empty }}{{ else }}{{ $x := \"e\" }}{{ end }}[{{ $x }}]", "[a]"},
+    // 声明动作不输出
+    {"A{{ $x := .Values.x }}B{{ $x }}", "ABhello"},
+    {"{{ range $i, $e := .Values.list }}{{ $i }}={{ $e }};{{ end }}", "0=p;1=q;"},
+    {"{{ range $k, $v := .Values.map }}{{ $k }}:{{ $v }},{{ end }}", "a:1,b:2,"},
+};
+
+int main() {
+    Values* data = ParseSimpleYAML(
+        "Values:\n  flag: true\n  x: hello\n  empty: []\n  list:\n    - p\n    - q\n  map:\n    b: 2\n    a: 1\n");
+    int failed = 0;
+    for (size_t i = 0; i < sizeof(kCases) / sizeof(kCases[0]); ++i) {
+        std::string out;
+        try {
+            out = ExecuteTemplate("scope" + std::to_string(i), kCases[i].text, data);
+        } catch (const std::exception& e) {
+            out = std::string("error: ") + e.what();
+        }
+        if (out != kCases[i].expected) {
+            std::cerr << "FAIL " << kCases[i].text << "\n  expected: " << kCases[i].expected
+                      << "\n  actual:   " << out << std::endl;
+            ++failed;
+        }
+    }
+    delete data;
+    std::cout << (sizeof(kCases) / sizeof(kCases[0]) - failed) << " passed, " << failed << " failed" << std::endl;
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,75 @@
+// arena.cpp
+#include "arena.h"
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+
+Arena::Arena(size_t blockSize)
+    : blockSize_(blockSize), cur_(NULL), end_(NULL), bytesUsed_(0) {
+}
+
+// 一次性释放所有块，不调用任何对象的析构函数
+Arena::~Arena() {
+    for (size_t i = 0; i < blocks_.size(); ++i) {
+        std::free(blocks_[i]);
+    }
+}
+
+void* Arena::Allocate(size_t size, size_t align) {
+    uintptr_t p = (reinterpret_cast<uintptr_t>(cur_) + align - 1) & ~(uintptr_t)(align - 1);
+    if (cur_ == NULL || p + size > reinterpret_cast<uintptr_t>(end_)) {
+        // 当前块放不下，申请新块；超大的请求单独占一块
+        size_t n = size + align > blockSize_ ? size + align : blockSize_;
+        char* block = static_cast<char*>(std::malloc(n));
+        if (block == NULL) {
+            throw std::bad_alloc();
+        }
+        blocks_.push_back(block);
+        cur_ = block;
+        end_ = block + n;
+        p = (reinterpret_cast<uintptr_t>(cur_) + align - 1) & ~(uintptr_t)(align - 1);
+    }
+    cur_ = reinterpret_cast<char*>(p + size);
+    bytesUsed_ += size;
+    return reinterpret_cast<void*>(p);
+}
+
+void Arena::Retain(std::shared_ptr<const std::string> source) {
+    for (size_t i = 0; i < sources_.size(); ++i) {
+        if (sources_[i] == source) {
+            return;
+        }
+    }
+    sources_.push_back(source);
+}
+
+// 检查视图是否完全落在某个已保留的源缓冲区内
+bool Arena::inSource(std::string_view s) const {
+    std::less_equal<const char*> le;
+    for (size_t i = 0; i < sources_.size(); ++i) {
+        const char* begin = sources_[i]->data();
+        const char* end = begin + sources_[i]->size();
+        if (le(begin, s.data()) && le(s.data() + s.size(), end)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+std::string_view Arena::Intern(std::string_view s) {
+    if (s.empty()) {
+        return std::string_view();
+    }
+    if (inSource(s)) {
+        return s;
+    }
+    std::unordered_set<std::string_view>::const_iterator it = interned_.find(s);
+    if (it != interned_.end()) {
+        return *it;
+    }
+    char* p = static_cast<char*>(Allocate(s.size(), 1));
+    std::memcpy(p, s.data(), s.size());
+    std::string_view copy(p, s.size());
+    interned_.insert(copy);
+    return copy;
+}
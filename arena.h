@@ -0,0 +1,84 @@
+// arena.h
+#ifndef TEMPLATE_ARENA_H
+#define TEMPLATE_ARENA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+// 线性(bump)分配器：一组模板树的所有节点都从这里分配
+// 对象的析构函数不会被调用，因此放进来的对象不能持有堆资源；
+// 整个Arena销毁时一次性释放所有块
+class Arena {
+public:
+    explicit Arena(size_t blockSize = 64 * 1024);
+    ~Arena();
+
+    // 分配size字节，按align对齐
+    void* Allocate(size_t size, size_t align);
+
+    // 在Arena中构造一个对象
+    template <typename T, typename... Args>
+    T* New(Args&&... args) {
+        void* p = Allocate(sizeof(T), alignof(T));
+        return new (p) T(std::forward<Args>(args)...);
+    }
+
+    // 保留一个源缓冲区，指向它的字符串视图可以直接使用而不需要复制
+    void Retain(std::shared_ptr<const std::string> source);
+
+    // 驻留字符串：位于已保留的源缓冲区内时原样返回，否则复制到Arena中（相同内容只复制一次）
+    std::string_view Intern(std::string_view s);
+
+    // 统计信息
+    size_t BlockCount() const { return blocks_.size(); }
+    size_t BytesUsed() const { return bytesUsed_; }
+
+private:
+    Arena(const Arena&);            // 禁止复制
+    Arena& operator=(const Arena&); // 禁止赋值
+
+    bool inSource(std::string_view s) const;
+
+    size_t blockSize_;
+    char* cur_;                     // 当前块中下一个可用的字节
+    char* end_;                     // 当前块的末尾
+    size_t bytesUsed_;
+    std::vector<char*> blocks_;
+    std::vector<std::shared_ptr<const std::string> > sources_;
+    std::unordered_set<std::string_view> interned_;
+};
+
+// 从Arena分配内存的STL分配器，deallocate什么也不做
+template <typename T>
+class ArenaAllocator {
+public:
+    typedef T value_type;
+
+    explicit ArenaAllocator(Arena* arena) : arena_(arena) {}
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other) : arena_(other.arena()) {}
+
+    T* allocate(size_t n) {
+        return static_cast<T*>(arena_->Allocate(n * sizeof(T), alignof(T)));
+    }
+    void deallocate(T*, size_t) {}
+
+    Arena* arena() const { return arena_; }
+
+    template <typename U>
+    bool operator==(const ArenaAllocator<U>& other) const { return arena_ == other.arena(); }
+    template <typename U>
+    bool operator!=(const ArenaAllocator<U>& other) const { return arena_ != other.arena(); }
+
+private:
+    Arena* arena_;
+};
+
+#endif // TEMPLATE_ARENA_H
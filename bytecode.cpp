@@ -0,0 +1,219 @@
+// bytecode.cpp
+#include "bytecode.h"
+
+#include <sstream>
+
+namespace template_engine {
+
+const char* OpCodeName(OpCode op) {
+    switch (op) {
+        case OpText:        return "TEXT";
+        case OpField:       return "FIELD";
+        case OpCall:        return "CALL";
+        case OpAction:      return "ACTION";
+        case OpJumpIfFalse: return "JUMP_IF_FALSE";
+        case OpWithBegin:   return "WITH_BEGIN";
+        case OpWithEnd:     return "WITH_END";
+        case OpRangeBegin:  return "RANGE_BEGIN";
+        case OpRangeNext:   return "RANGE_NEXT";
+        case OpJump:        return "JUMP";
+        case OpScopeBegin:  return "SCOPE_BEGIN";
+        case OpScopeEnd:    return "SCOPE_END";
+        case OpTemplate:    return "TEMPLATE";
+        case OpUnknown:     return "UNKNOWN";
+        case OpHalt:        return "HALT";
+    }
+    return "?";
+}
+
+Program* Program::Compile(const Tree* tree) {
+    Program* program = new Program();
+    program->name_ = tree->GetName();
+    program->compileList(tree->GetRoot());
+    program->emit(OpHalt, NULL);
+    return program;
+}
+
+int Program::emit(OpCode op, const Node* node) {
+    code_.push_back(Instruction(op, node));
+    return here() - 1;
+}
+
+void Program::compileList(const ListNode* list) {
+    if (!list) {
+        return;
+    }
+    const NodeVector& nodes = list->Nodes();
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        if (nodes[i]) {
+            compileNode(nodes[i]);
+        }
+    }
+}
+
+void Program::compileNode(const Node* node) {
+    switch (node->Type()) {
+        case NodeText:
+            emit(OpText, node);
+            break;
+        case NodeAction:
+            compileAction(static_cast<const ActionNode*>(node));
+            break;
+        case NodeList:
+            compileList(static_cast<const ListNode*>(node));
+            break;
+        case NodeIf:
+        case NodeWith:
+        case NodeRange:
+            compileScoped(static_cast<const BranchNode*>(node));
+            break;
+        case NodeTemplate:
+            emit(OpTemplate, node);
+            break;
+        default:
+            emit(OpUnknown, node);
+            break;
+    }
+}
+
+// 只有一个命令且没有变量声明的管道直接求值这个命令，省去管道的变量标记和恢复
+void Program::compileAction(const ActionNode* action) {
+    const PipeNode* pipe = action->Pipe();
+    if (pipe && pipe->Decl().empty() && pipe->Cmds().size() == 1 &&
+        !pipe->Cmds()[0]->Args().empty()) {
+        NodeType first = pipe->Cmds()[0]->Args()[0]->Type();
+        if (first == NodeField || first == NodeChain) {
+            emit(OpField, action);
+            return;
+        }
+        if (first == NodeIdentifier) {
+            emit(OpCall, action);
+            return;
+        }
+    }
+    emit(OpAction, action);
+}
+
+// 管道声明了新变量（不是给已有变量赋值）
+static bool declares(const PipeNode* pipe) {
+    return pipe && !pipe->Decl().empty() && !pipe->IsAssign();
+}
+
+// 列表顶层的动作声明了新变量；嵌套的if/with/range和{{template}}各自管理作用域
+static bool declaresIn(const ListNode* list) {
+    if (!list) {
+        return false;
+    }
+    const NodeVector& nodes = list->Nodes();
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        if (nodes[i] && nodes[i]->Type() == NodeAction &&
+            declares(static_cast<const ActionNode*>(nodes[i])->Pipe())) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// if/with/range是一个变量作用域，与解析器一致：条件和各分支中声明的变量在{{end}}之后不可见。
+// with和range的主体由各自的执行帧限定；条件或某个分支声明了变量时，
+// 整个节点再包在SCOPE_BEGIN/SCOPE_END中，没有声明的节点不需要这两条指令
+void Program::compileScoped(const BranchNode* node) {
+    bool scoped = declaresIn(node->List()) || declaresIn(node->ElseList()) ||
+                  (node->Type() != NodeRange && declares(node->GetPipe()));
+    if (scoped) {
+        emit(OpScopeBegin, node);
+    }
+    if (node->Type() == NodeIf) {
+        compileIf(node);
+    } else if (node->Type() == NodeWith) {
+        compileWith(node);
+    } else {
+        compileRange(node);
+    }
+    if (scoped) {
+        emit(OpScopeEnd, node);
+    }
+}
+
+//     JUMP_IF_FALSE else
+//     <list>
+//     JUMP end            （有else时）
+// else:
+//     <else list>
+// end:
+void Program::compileIf(const BranchNode* node) {
+    int test = emit(OpJumpIfFalse, node);
+    compileList(node->List());
+    if (node->ElseList()) {
+        int skip = emit(OpJump, node);
+        code_[test].target = here();
+        compileList(node->ElseList());
+        code_[skip].target = here();
+    } else {
+        code_[test].target = here();
+    }
+}
+
+//     WITH_BEGIN else
+//     <list>
+//     WITH_END
+//     JUMP end            （有else时）
+// else:
+//     <else list>
+// end:
+void Program::compileWith(const BranchNode* node) {
+    int begin = emit(OpWithBegin, node);
+    compileList(node->List());
+    emit(OpWithEnd, node);
+    if (node->ElseList()) {
+        int skip = emit(OpJump, node);
+        code_[begin].target = here();
+        compileList(node->ElseList());
+        code_[skip].target = here();
+    } else {
+        code_[begin].target = here();
+    }
+}
+
+//     RANGE_BEGIN else, end
+// next:
+//     RANGE_NEXT end
+//     <list>
+//     JUMP next
+// else:
+//     <else list>
+// end:
+void Program::compileRange(const BranchNode* node) {
+    int begin = emit(OpRangeBegin, node);
+    int next = emit(OpRangeNext, node);
+    compileList(node->List());
+    int loop = emit(OpJump, node);
+    code_[loop].target = next;
+    code_[begin].target = here();
+    compileList(node->ElseList());
+    code_[begin].alt = here();
+    code_[next].target = here();
+}
+
+std::string Program::Disassemble() const {
+    std::ostringstream ss;
+    for (size_t i = 0; i < code_.size(); ++i) {
+        const Instruction& ins = code_[i];
+        ss << i << "\t" << OpCodeName(ins.op);
+        if (ins.target >= 0) {
+            ss << "\t-> " << ins.target;
+        }
+        if (ins.alt >= 0) {
+            ss << ", " << ins.alt;
+        }
+        if (ins.op == OpText) {
+            ss << "\t" << static_cast<const TextNode*>(ins.node)->Text().size() << " bytes";
+        } else if (ins.node && ins.op != OpHalt && ins.op != OpJump) {
+            ss << "\t" << ins.node->String();
+        }
+        ss << "\n";
+    }
+    return ss.str();
+}
+
+} // namespace template_engine
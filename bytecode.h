@@ -0,0 +1,76 @@
+// bytecode.h
+#ifndef TEMPLATE_BYTECODE_H
+#define TEMPLATE_BYTECODE_H
+
+#include "parse.h"
+
+#include <string>
+#include <vector>
+
+namespace template_engine {
+
+// 指令操作码
+enum OpCode {
+    OpText,        // 输出文本节点的内容
+    OpField,       // 求值单个字段路径（.a 或 .a.b）并输出
+    OpCall,        // 调用函数（单个命令，第一个参数是标识符）并输出
+    OpAction,      // 求值完整管道并输出
+    OpJumpIfFalse, // if：求值条件管道，为假时跳转到target
+    OpWithBegin,   // with：求值管道，为假时跳转到target；为真时把结果设为新的"."
+    OpWithEnd,     // with：恢复进入with之前的"."
+    OpRangeBegin,  // range：求值集合；求值失败跳转到alt，为空或不是集合时跳转到target
+    OpRangeNext,   // range：取下一项作为"."；没有更多项时结束循环并跳转到target
+    OpJump,        // 无条件跳转到target
+    OpScopeBegin,  // 记录变量栈位置，进入if/with/range的变量作用域
+    OpScopeEnd,    // 丢弃作用域内声明的变量
+    OpTemplate,    // {{template}}调用
+    OpUnknown,     // 不支持的节点，执行时报错
+    OpHalt         // 程序结束
+};
+
+// 单条指令
+struct Instruction {
+    OpCode op;
+    const Node* node; // 对应的语法树节点，用于求值和错误定位
+    int target;       // 跳转目标
+    int alt;          // 第二个跳转目标（仅OpRangeBegin使用）
+
+    Instruction(OpCode o, const Node* n) : op(o), node(n), target(-1), alt(-1) {}
+};
+
+// 编译后的模板：由解析树生成的线性指令序列
+// 指令引用树中的节点，因此树必须比Program活得更久
+class Program {
+public:
+    // 把解析树编译为指令序列
+    static Program* Compile(const Tree* tree);
+
+    const std::vector<Instruction>& Code() const { return code_; }
+    const std::string& Name() const { return name_; }
+
+    // 反汇编，用于调试
+    std::string Disassemble() const;
+
+private:
+    Program() {}
+
+    int emit(OpCode op, const Node* node);
+    int here() const { return static_cast<int>(code_.size()); }
+    void compileNode(const Node* node);
+    void compileList(const ListNode* list);
+    void compileAction(const ActionNode* action);
+    void compileIf(const BranchNode* node);
+    void compileWith(const BranchNode* node);
+    void compileRange(const BranchNode* node);
+    void compileScoped(const BranchNode* node);
+
+    std::string name_;
+    std::vector<Instruction> code_;
+};
+
+// 操作码名称
+const char* OpCodeName(OpCode op);
+
+} // namespace template_engine
+
+#endif // TEMPLATE_BYTECODE_H
@@ -1,12 +1,18 @@
 #include "chart_processor.h"
 #include "values.h" // 需要 Values 和 ParseSimpleYAMLFile
 #include "exec.h"   // 需要 ExecuteTemplate
-#include <fstream>  // C++98 文件流
+#include "template_cache.h" // 需要 TemplateCache 和 TemplateNamespace
+#include "output_sink.h" // 需要 StringSink
+#include "file_loader.h" // 需要 ReadFile
 #include <sstream>  // C++98 字符串流
 #include <sys/stat.h> // C++98 POSIX stat
 #include <dirent.h>   // C++98 POSIX 目录操作
 #include <errno.h>    // errno
 #include <string.h>   // strerror
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <thread>
 
 // 辅助函数，检查路径类型 (来自 chart_validator.cpp，避免重复定义)
 // 返回值: 0 = 不存在或错误, 1 = 文件, 2 = 目录
@@ -26,196 +32,367 @@ static int getPathType_Processor(const std::string& path) {
 
 namespace chart_processor {
 
-bool ProcessChartTemplates(
-    const std::string& chartPath,
-    std::map<std::string, std::string>& renderedResults,
-    std::vector<std::string>& errors) {
+namespace {
 
-    renderedResults.clear();
-    errors.clear();
+// 模板渲染任务的结果
+enum JobStatus {
+    JobPending,
+    JobOpenFailed, // 无法打开模板文件
+    JobEmpty,      // 空模板，渲染为空字符串
+    JobCompiled,   // 已解析编译，等待渲染
+    JobRendered,
+    JobFailed      // 解析或渲染出错，错误信息在 error 中
+};
+
+// 一个待渲染的模板文件
+struct RenderJob {
+    std::string fullPath;
+    std::string relativePath;          // 模板名，也是结果 Map 的键
+    bool helper;                       // _*.tpl 辅助模板：只解析，为命名空间提供 define 块，不渲染
+    template_engine::ValuesSnapshot root; // 所属 Chart 的顶层上下文，所有模板共享借用
+    template_engine::CompiledTemplatePtr compiled;
+    template_engine::TemplateNamespacePtr templates; // 所属 Chart 的具名模板命名空间
+    JobStatus status;
+    std::string output;
+    std::string error;
 
+    RenderJob() : helper(false), status(JobPending) {}
+};
+
+// 一个 Chart 的处理计划：记录渲染前就能确定的错误、模板任务和子 Chart，
+// 渲染完成后按这里记录的顺序合并，结果与线程数无关
+struct ChartPlan {
+    bool ok;                                  // false 表示遇到严重错误，对应 ProcessChartTemplates 返回 false
+    template_engine::ValuesSnapshot root;     // 顶层上下文 {"Values": values}，每个 Chart 只构造一次
+    std::vector<std::string> errors;          // values.yaml / templates 目录相关的错误
+    std::vector<size_t> jobs;                 // 本 Chart 的模板任务，包括辅助模板（按文件名排序）
+    template_engine::TemplateNamespacePtr templates; // 本 Chart 所有模板的具名模板，解析完成后构建一次
+    std::vector<std::string> chartsErrors;    // charts 目录相关的错误
+    std::vector<std::pair<std::string, ChartPlan*> > subcharts; // 子 Chart 相对路径和计划
+
+    ChartPlan() : ok(true) {}
+    ~ChartPlan() {
+        for (size_t i = 0; i < subcharts.size(); ++i) {
+            delete subcharts[i].second;
+        }
+    }
+};
+
+// 列出目录项（不含 '.' 和 '..'），按名称排序；目录无法打开时返回 false
+static bool listDirectory(const std::string& path, std::vector<std::string>& names) {
+    DIR* dir = opendir(path.c_str());
+    if (!dir) {
+        return false;
+    }
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        std::string name = entry->d_name;
+        if (name != "." && name != "..") {
+            names.push_back(name);
+        }
+    }
+    closedir(dir);
+    std::sort(names.begin(), names.end());
+    return true;
+}
+
+// 收集 Chart 的 values、模板任务和子 Chart，不做渲染
+static void planChart(const std::string& chartPath, ChartPlan& plan, std::vector<RenderJob>& jobs) {
     // 1. 解析 values.yaml
     std::string valuesPath = chartPath + "/values.yaml";
     template_engine::Values* values = NULL;
     try {
         // 检查 values.yaml 是否存在
         if (getPathType_Processor(valuesPath) == 1) {
-             values = template_engine::ParseSimpleYAMLFile(valuesPath);
+            values = template_engine::ParseSimpleYAMLFile(valuesPath);
         } else {
             // values.yaml 不存在或不是文件，使用空的 Values 对象
-            errors.push_back("警告: '" + valuesPath + "' 未找到或不是文件，使用空 Values。 ");
+            plan.errors.push_back("警告: '" + valuesPath + "' 未找到或不是文件，使用空 Values。 ");
             values = template_engine::Values::MakeMap(std::map<std::string, template_engine::Values*>());
         }
     } catch (const std::exception& e) {
-        errors.push_back("错误: 解析 '" + valuesPath + "' 失败: " + e.what());
-        return false; // Values 解析失败是严重错误
+        plan.errors.push_back("错误: 解析 '" + valuesPath + "' 失败: " + e.what());
+        plan.ok = false; // Values 解析失败是严重错误
+        return;
     }
 
+    // 创建顶层上下文，键 "Values" 直接接管解析结果（MakeMap 会深拷贝，这里不用它）
+    template_engine::Values* root = template_engine::Values::MakeMap(std::map<std::string, template_engine::Values*>());
+    (*root)["Values"] = values;
+    plan.root = template_engine::MakeValuesSnapshot(root);
+
     // 2. 遍历 templates/ 目录
     std::string templatesPath = chartPath + "/templates";
     if (getPathType_Processor(templatesPath) != 2) {
-        errors.push_back("错误: 'templates' 目录 '" + templatesPath + "' 不存在或不是一个目录。");
-        delete values; // 清理已分配的 Values 对象
-        return false; // templates 目录不存在是严重错误
+        plan.errors.push_back("错误: 'templates' 目录 '" + templatesPath + "' 不存在或不是一个目录。");
+        plan.ok = false; // templates 目录不存在是严重错误
+        return;
     }
 
-    DIR* dir = opendir(templatesPath.c_str());
-    if (!dir) {
-        errors.push_back("错误: 无法打开 'templates' 目录 '" + templatesPath + "': " + strerror(errno));
-        delete values;
-        return false;
+    std::vector<std::string> entries;
+    if (!listDirectory(templatesPath, entries)) {
+        plan.errors.push_back("错误: 无法打开 'templates' 目录 '" + templatesPath + "': " + strerror(errno));
+        plan.ok = false;
+        return;
     }
 
-    struct dirent* entry;
-    bool hasRenderingErrors = false;
-    while ((entry = readdir(dir)) != NULL) {
-        std::string entryName = entry->d_name;
+    for (size_t i = 0; i < entries.size(); ++i) {
+        const std::string& entryName = entries[i];
 
-        // 跳过 '.' 和 '..'
-        if (entryName == "." || entryName == "..") {
+        // 以下划线 '_' 开头的文件不渲染 (Helm 约定)，其中的 _*.tpl 是只提供 define 块的辅助模板
+        // 其余只处理普通的 YAML 文件，忽略目录、非 YAML 文件和其他类型的文件
+        std::string fullEntryPath = templatesPath + "/" + entryName;
+        size_t nameLen = entryName.length();
+        bool isHelper = entryName[0] == '_' && nameLen > 4 && entryName.substr(nameLen - 4) == ".tpl";
+        bool isYaml = entryName[0] != '_' &&
+                      ((nameLen > 5 && entryName.substr(nameLen - 5) == ".yaml") ||
+                       (nameLen > 4 && entryName.substr(nameLen - 4) == ".yml"));
+        if ((!isHelper && !isYaml) || getPathType_Processor(fullEntryPath) != 1) {
             continue;
         }
 
-        // 跳过以下划线 '_' 开头的文件/目录 (Helm 约定)
-        if (!entryName.empty() && entryName[0] == '_') {
+        RenderJob job;
+        job.fullPath = fullEntryPath;
+        job.relativePath = "templates/" + entryName;
+        job.helper = isHelper;
+        job.root = plan.root;
+        plan.jobs.push_back(jobs.size());
+        jobs.push_back(job);
+    }
+
+    // 3. 收集子 Chart (charts/ 目录下的子目录)
+    std::string chartsPath = chartPath + "/charts";
+    int chartsPathType = getPathType_Processor(chartsPath);
+    if (chartsPathType == 0) {
+        return; // 'charts' 目录是可选的
+    }
+    if (chartsPathType != 2) {
+        plan.chartsErrors.push_back("警告: 'charts' 在 '" + chartPath + "' 中存在但不是一个目录，跳过子 Chart 处理。");
+        return;
+    }
+    std::vector<std::string> subChartNames;
+    if (!listDirectory(chartsPath, subChartNames)) {
+        plan.chartsErrors.push_back("错误: 无法打开 'charts' 目录 '" + chartsPath + "': " + strerror(errno));
+        return;
+    }
+    for (size_t i = 0; i < subChartNames.size(); ++i) {
+        std::string subChartPath = chartsPath + "/" + subChartNames[i];
+        // 只处理子目录 (未压缩的子 Chart)，忽略 .tgz 压缩包等文件
+        if (getPathType_Processor(subChartPath) != 2) {
             continue;
         }
+        ChartPlan* subPlan = new ChartPlan();
+        plan.subcharts.push_back(std::make_pair("charts/" + subChartNames[i], subPlan));
+        planChart(subChartPath, *subPlan, jobs);
+    }
+}
 
-        std::string fullEntryPath = templatesPath + "/" + entryName;
-        std::string relativeTemplatePath = "templates/" + entryName; // 用于结果 Map 的键
-
-        // 只处理普通文件
-        if (getPathType_Processor(fullEntryPath) == 1) {
-
-            // --- 检查文件扩展名 --- 
-            size_t nameLen = entryName.length();
-            bool isYaml = (nameLen > 5 && entryName.substr(nameLen - 5) == ".yaml") ||
-                          (nameLen > 4 && entryName.substr(nameLen - 4) == ".yml");
-            
-            if (isYaml) { // 只处理 YAML 文件
-                // 读取模板文件内容
-                std::ifstream tplFile(fullEntryPath.c_str());
-                if (!tplFile.is_open()) {
-                    errors.push_back("错误: 无法打开模板文件 '" + fullEntryPath + "'");
-                    hasRenderingErrors = true;
-                    continue; // 继续处理下一个文件
-                }
-                std::stringstream buffer;
-                buffer << tplFile.rdbuf();
-                std::string templateContent = buffer.str();
-                tplFile.close();
-
-                if (templateContent.empty()) {
-                    // Helm 对于空模板文件通常渲染为空字符串
-                    renderedResults[relativeTemplatePath] = "";
-                    continue;
-                }
-
-                // 创建顶层上下文，它是一个 Map
-                std::map<std::string, template_engine::Values*> rootContextMap;
-                // 将解析得到的 values 对象放入顶层 Map 中，键为 "Values"
-                rootContextMap["Values"] = values; 
-                template_engine::Values* rootContext = template_engine::Values::MakeMap(rootContextMap);
-
-                // 渲染模板
-                try {
-                    // 使用 ExecuteTemplate 进行渲染
-                    // 注意：模板名称可以简单地使用相对路径，或者根据需要生成更复杂的名称
-                    std::string renderedOutput = template_engine::ExecuteTemplate(
-                        relativeTemplatePath, // 使用相对路径作为模板名
-                        templateContent,
-                        rootContext, // <--- 传递封装后的 rootContext
-                        "{{", // 默认左定界符
-                        "}}"  // 默认右定界符
-                        // 如果需要传递 ExecOptions，在这里添加
-                    );
-                    renderedResults[relativeTemplatePath] = renderedOutput;
-
-                } catch (const std::exception& e) {
-                    errors.push_back("错误: 渲染模板 '" + relativeTemplatePath + "' 失败: " + e.what());
-                    hasRenderingErrors = true;
-                    // 即使单个模板失败，也继续处理其他模板
-                }
-                // 清理封装对象 (假设 MakeMap 返回的是堆分配的对象)
-                 if (rootContext) { // 检查指针是否有效
-                     delete rootContext;
-                     rootContext = NULL; // 防止悬空指针
-                 }
-            } // --- 结束 YAML 文件处理块 ---
+// 读取并解析编译一个模板文件，结果写回 job；可以在任意线程上调用
+static void loadJob(RenderJob& job) {
+    // 读取模板文件内容（一次读入）；这个缓冲区由解析出的树直接持有，词法分析器在其上工作，不再复制
+    std::shared_ptr<std::string> templateContent = std::make_shared<std::string>();
+    if (!template_engine::ReadFile(job.fullPath, *templateContent)) {
+        job.status = JobOpenFailed;
+        return;
+    }
+
+    if (templateContent->empty()) {
+        // Helm 对于空模板文件通常渲染为空字符串
+        job.status = JobEmpty;
+        return;
+    }
+
+    try {
+        // 模板名使用相对路径；经由进程共享的缓存，内容相同的文件只解析一次
+        job.compiled = template_engine::TemplateCache::Instance().Get(
+            job.relativePath, std::shared_ptr<const std::string>(templateContent), "{{", "}}");
+        job.status = JobCompiled;
+    } catch (const std::exception& e) {
+        job.error = e.what();
+        job.status = JobFailed;
+    } catch (...) {
+        job.error = "unknown error";
+        job.status = JobFailed;
+    }
+}
+
+// 渲染一个已编译的模板，结果写回 job；可以在任意线程上调用
+static void renderJob(RenderJob& job) {
+    if (job.status != JobCompiled || job.helper) {
+        return;
+    }
+
+    try {
+        // 顶层上下文只读借用，不复制；{{template}} 在 Chart 的命名空间中查找
+        template_engine::ExecOptions options;
+        options.templates = job.templates.get();
+        template_engine::StringSink sink(job.output);
+        template_engine::ExecuteTemplate(*job.compiled, job.root.get(), sink, options);
+        job.status = JobRendered;
+    } catch (const std::exception& e) {
+        job.output.clear();
+        job.error = e.what();
+        job.status = JobFailed;
+    } catch (...) {
+        job.output.clear();
+        job.error = "unknown error";
+        job.status = JobFailed;
+    }
+}
+
+// 用 Chart 所有解析成功的模板构建只读的具名模板命名空间，交给各任务借用；子 Chart 各有自己的命名空间
+static void linkChart(ChartPlan& plan, std::vector<RenderJob>& jobs) {
+    template_engine::TemplateNamespace* templates = new template_engine::TemplateNamespace();
+    for (size_t i = 0; i < plan.jobs.size(); ++i) {
+        const RenderJob& job = jobs[plan.jobs[i]];
+        if (job.status == JobCompiled) {
+            templates->Add(job.compiled);
         }
-        // 忽略目录、非 YAML 文件和其他类型的文件
     }
+    plan.templates.reset(templates);
+    for (size_t i = 0; i < plan.jobs.size(); ++i) {
+        jobs[plan.jobs[i]].templates = plan.templates;
+    }
+    for (size_t i = 0; i < plan.subcharts.size(); ++i) {
+        linkChart(*plan.subcharts[i].second, jobs);
+    }
+}
 
-    closedir(dir);
+// 在 workers 个线程上对所有任务执行 fn；workers <= 1 时在调用线程上依次执行
+static void runJobs(std::vector<RenderJob>& jobs, int workers, void (*fn)(RenderJob&)) {
+    if (workers <= 1 || jobs.size() <= 1) {
+        for (size_t i = 0; i < jobs.size(); ++i) {
+            fn(jobs[i]);
+        }
+        return;
+    }
 
-    // 3. 递归处理子 Chart (charts/ 目录下的子目录)
-    std::string chartsPath = chartPath + "/charts";
-    int chartsPathType = getPathType_Processor(chartsPath);
-    if (chartsPathType != 0) { // 'charts' 目录或文件存在
-        if (chartsPathType != 2) {
-            errors.push_back("警告: 'charts' 在 '" + chartPath + "' 中存在但不是一个目录，跳过子 Chart 处理。");
-        } else {
-            // 是目录，遍历查找子 Chart 目录
-            DIR* chartsDir = opendir(chartsPath.c_str());
-            if (!chartsDir) {
-                errors.push_back("错误: 无法打开 'charts' 目录 '" + chartsPath + "': " + strerror(errno));
-                // 即使无法打开 charts 目录，也认为顶层处理可能部分成功，继续
-                hasRenderingErrors = true; // 标记存在问题
-            } else {
-                struct dirent* chartsEntry;
-                while ((chartsEntry = readdir(chartsDir)) != NULL) {
-                    std::string subChartName = chartsEntry->d_name;
-                    if (subChartName == "." || subChartName == "..") {
-                        continue;
-                    }
-
-                    std::string subChartPath = chartsPath + "/" + subChartName;
-                    int subChartType = getPathType_Processor(subChartPath);
-
-                    // 只处理子目录 (未压缩的子 Chart)
-                    if (subChartType == 2) {
-                        std::map<std::string, std::string> subRenderedResults;
-                        std::vector<std::string> subErrors;
-                        std::string subChartRelativePath = "charts/" + subChartName;
-
-                        errors.push_back("信息: 开始处理子 Chart: " + subChartRelativePath);
-
-                        // 递归调用
-                        bool subResult = ProcessChartTemplates(subChartPath, subRenderedResults, subErrors);
-
-                        // 合并结果 (调整路径)
-                        for (std::map<std::string, std::string>::const_iterator it = subRenderedResults.begin(); it != subRenderedResults.end(); ++it) {
-                            renderedResults[subChartRelativePath + "/" + it->first] = it->second;
-                        }
-
-                        // 合并错误 (添加上下文)
-                        for (size_t i = 0; i < subErrors.size(); ++i) {
-                            errors.push_back("子 Chart[" + subChartRelativePath + "]: " + subErrors[i]);
-                            // 如果子Chart处理失败，标记顶层处理也有问题
-                            if (subErrors[i].rfind("错误:", 0) == 0) {
-                                hasRenderingErrors = true;
-                            }
-                        }
-
-                        if (!subResult) {
-                             errors.push_back("错误: 子 Chart[" + subChartRelativePath + "] 处理过程中发生严重错误。 ");
-                            hasRenderingErrors = true;
-                        }
-                         errors.push_back("信息: 完成处理子 Chart: " + subChartRelativePath);
-                    }
-                    // 忽略 charts/ 目录下的文件 (如 .tgz 压缩包) 和其他类型
-                }
-                closedir(chartsDir);
+    // 各线程从共享计数器领取下一个任务，每个任务只写自己的结果
+    std::atomic<size_t> next(0);
+    size_t threadCount = std::min(static_cast<size_t>(workers), jobs.size());
+    std::vector<std::thread> threads;
+    threads.reserve(threadCount);
+    for (size_t t = 0; t < threadCount; ++t) {
+        threads.push_back(std::thread([&jobs, &next, fn]() {
+            for (size_t i = next++; i < jobs.size(); i = next++) {
+                fn(jobs[i]);
             }
+        }));
+    }
+    for (size_t t = 0; t < threads.size(); ++t) {
+        threads[t].join();
+    }
+}
+
+// 按计划顺序合并渲染结果和错误；返回值同 ProcessChartTemplates
+static bool collectChart(
+    const ChartPlan& plan,
+    const std::vector<RenderJob>& jobs,
+    std::map<std::string, std::string>& renderedResults,
+    std::vector<std::string>& errors) {
+
+    errors.insert(errors.end(), plan.errors.begin(), plan.errors.end());
+    if (!plan.ok) {
+        return false;
+    }
+
+    for (size_t i = 0; i < plan.jobs.size(); ++i) {
+        const RenderJob& job = jobs[plan.jobs[i]];
+        if (job.helper) {
+            // 辅助模板不产生输出，只报告无法读取或解析的情况
+            if (job.status == JobOpenFailed) {
+                errors.push_back("错误: 无法打开模板文件 '" + job.fullPath + "'");
+            } else if (job.status == JobFailed) {
+                errors.push_back("错误: 解析辅助模板 '" + job.relativePath + "' 失败: " + job.error);
+            }
+            continue;
+        }
+        switch (job.status) {
+            case JobOpenFailed:
+                errors.push_back("错误: 无法打开模板文件 '" + job.fullPath + "'");
+                break;
+            case JobEmpty:
+                renderedResults[job.relativePath] = "";
+                break;
+            case JobRendered:
+                renderedResults[job.relativePath] = job.output;
+                break;
+            case JobFailed:
+                // 即使单个模板失败，也继续处理其他模板
+                errors.push_back("错误: 渲染模板 '" + job.relativePath + "' 失败: " + job.error);
+                break;
+            case JobPending:
+            case JobCompiled:
+                break;
         }
     }
-    // 如果 'charts' 目录不存在，则忽略，是可选的
 
-    delete values; // 清理顶层的 Values 对象
+    errors.insert(errors.end(), plan.chartsErrors.begin(), plan.chartsErrors.end());
+
+    for (size_t i = 0; i < plan.subcharts.size(); ++i) {
+        const std::string& subChartRelativePath = plan.subcharts[i].first;
+        std::map<std::string, std::string> subRenderedResults;
+        std::vector<std::string> subErrors;
+
+        errors.push_back("信息: 开始处理子 Chart: " + subChartRelativePath);
+        bool subResult = collectChart(*plan.subcharts[i].second, jobs, subRenderedResults, subErrors);
+
+        // 合并结果 (调整路径)
+        for (std::map<std::string, std::string>::const_iterator it = subRenderedResults.begin(); it != subRenderedResults.end(); ++it) {
+            renderedResults[subChartRelativePath + "/" + it->first] = it->second;
+        }
+
+        // 合并错误 (添加上下文)
+        for (size_t j = 0; j < subErrors.size(); ++j) {
+            errors.push_back("子 Chart[" + subChartRelativePath + "]: " + subErrors[j]);
+        }
+
+        if (!subResult) {
+            errors.push_back("错误: 子 Chart[" + subChartRelativePath + "] 处理过程中发生严重错误。 ");
+        }
+        errors.push_back("信息: 完成处理子 Chart: " + subChartRelativePath);
+    }
 
     // 返回 true 表示主流程完成，具体错误看 errors 向量
-    // 如果需要更严格的成功/失败定义（例如，任何子chart失败都返回false），可以修改这里
     return true;
 }
 
-} // namespace chart_processor 
\ No newline at end of file
+} // namespace
+
+bool ProcessChartTemplates(
+    const std::string& chartPath,
+    std::map<std::string, std::string>& renderedResults,
+    std::vector<std::string>& errors) {
+    return ProcessChartTemplates(chartPath, renderedResults, errors, ProcessOptions());
+}
+
+bool ProcessChartTemplates(
+    const std::string& chartPath,
+    std::map<std::string, std::string>& renderedResults,
+    std::vector<std::string>& errors,
+    const ProcessOptions& options) {
+
+    renderedResults.clear();
+    errors.clear();
+
+    // 1. 收集整个 Chart 树的模板任务
+    ChartPlan plan;
+    std::vector<RenderJob> jobs;
+    planChart(chartPath, plan, jobs);
+
+    // 2. 并行读取、解析所有模板（包括辅助模板和子 Chart 的模板），每个文件只解析一次
+    int workers = options.workers;
+    if (workers == 0) {
+        workers = static_cast<int>(std::thread::hardware_concurrency());
+    }
+    runJobs(jobs, workers, loadJob);
+
+    // 3. 每个 Chart 构建一次具名模板命名空间，然后渲染所有模板
+    linkChart(plan, jobs);
+    runJobs(jobs, workers, renderJob);
+
+    // 4. 按固定顺序合并
+    return collectChart(plan, jobs, renderedResults, errors);
+}
+
+} // namespace chart_processor
@@ -11,7 +11,9 @@ namespace chart_processor {
  * @brief 处理给定 Helm Chart 目录中的所有模板文件。
  *
  * 该函数会解析 Chart 的 values.yaml 文件，然后遍历 templates/ 目录，
- * 对每个符合条件的模板文件（非下划线开头的文件）进行渲染。
+ * 对每个符合条件的模板文件（非下划线开头的文件）进行渲染。下划线开头的 _*.tpl
+ * 辅助模板不渲染，它们和所有模板文件中的 define 块组成 Chart 的具名模板命名空间，
+ * 供 {{ template "name" . }} 调用。
  *
  * @param chartPath Chart 根目录的路径。
  * @param renderedResults 输出参数，用于存储每个模板文件渲染后的结果。
@@ -26,6 +28,29 @@ bool ProcessChartTemplates(
     std::map<std::string, std::string>& renderedResults,
     std::vector<std::string>& errors);
 
+/**
+ * @brief Chart 处理选项。
+ */
+struct ProcessOptions {
+    int workers; // 渲染线程数；1 表示在调用线程上串行渲染，0 表示使用硬件线程数
+
+    ProcessOptions() : workers(1) {}
+};
+
+/**
+ * @brief 同上，可以指定渲染线程数。
+ *
+ * 先遍历 Chart 及其所有子 Chart，收集 values 和模板文件；然后在一个工作线程池上
+ * 并行解析全部模板，每个 Chart 构建一次只读的具名模板命名空间（子 Chart 各自独立），
+ * 再并行渲染全部模板（包括子 Chart 的模板）；最后按目录项名称顺序合并结果和错误。
+ * 因此无论线程数多少，renderedResults 和 errors 的内容与顺序都相同。
+ */
+bool ProcessChartTemplates(
+    const std::string& chartPath,
+    std::map<std::string, std::string>& renderedResults,
+    std::vector<std::string>& errors,
+    const ProcessOptions& options);
+
 } // namespace chart_processor
 
 #endif // CHART_PROCESSOR_H 
\ No newline at end of file
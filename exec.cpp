@@ -1,5 +1,7 @@
 // exec.cpp
 #include "exec.h"
+#include "trace.h"
+#include "template_cache.h"
 #include <stdarg.h>
 #include <algorithm>
 #include <iostream>
@@ -15,32 +17,6 @@ static std::string formatErrorMessage(const char* format, va_list args) {
     return std::string(buffer);
 }
 
-// 工具函数：去除所有空行（C++98 兼容，直接删除所有空行）
-static std::string RemoveAllEmptyLines(const std::string& input) {
-    std::istringstream in(input);
-    std::string line;
-    std::string result;
-    bool firstLine = true;
-    while (std::getline(in, line)) {
-        // 判断本行是否全是空白字符
-        bool thisLineEmpty = true;
-        for (size_t i = 0; i < line.size(); ++i) {
-            if (line[i] != ' ' && line[i] != '\t' && line[i] != '\r') {
-                thisLineEmpty = false;
-                break;
-            }
-        }
-        if (!thisLineEmpty) {
-            if (!firstLine) {
-                result += "\n";
-            }
-            result += line;
-            firstLine = false;
-        }
-    }
-    return result;
-}
-
 // 工具函数：去除多余空行（C++98 兼容版）
 static std::string RemoveExtraEmptyLines(const std::string& input) {
     std::istringstream in(input);
@@ -85,10 +61,16 @@ static std::string RemoveExtraEmptyLines(const std::string& input) {
 }
 
 // 内置函数实现
+// 内置函数都是纯函数
+class BuiltinFn : public TemplateFn {
+public:
+    bool Pure() const { return true; }
+};
+
 // 等于函数
-class EqFunction : public TemplateFn {
+class EqFunction : public BuiltinFn {
 public:
-    Values* operator()(const std::vector<Values*>& args) {
+    Values* operator()(ExecContext&, const std::vector<Values*>& args) const {
         if (args.size() < 2) {
             return Values::MakeBool(false);
         }
@@ -121,29 +103,29 @@ public:
 };
 
 // 不等于函数
-class NeFunction : public TemplateFn {
+class NeFunction : public BuiltinFn {
 public:
-    NeFunction(FunctionLib& lib) : lib_(lib) {}
+    NeFunction(const FunctionLib& lib) : lib_(lib) {}
     
-    Values* operator()(const std::vector<Values*>& args) {
+    Values* operator()(ExecContext& ctx, const std::vector<Values*>& args) const {
         if (args.size() < 2) {
             return Values::MakeBool(true);
         }
         
-        Values* eqResult = lib_.GetFunction("eq")->operator()(args);
+        Values* eqResult = (*lib_.GetFunction("eq"))(ctx, args);
         Values* result = Values::MakeBool(!eqResult->AsBool());
         delete eqResult; // 释放临时结果
         return result;
     }
     
 private:
-    FunctionLib& lib_;
+    const FunctionLib& lib_;
 };
 
 // 大于函数
-class GtFunction : public TemplateFn {
+class GtFunction : public BuiltinFn {
 public:
-    Values* operator()(const std::vector<Values*>& args) {
+    Values* operator()(ExecContext&, const std::vector<Values*>& args) const {
         if (args.size() < 2) {
             return Values::MakeBool(false);
         }
@@ -165,9 +147,9 @@ public:
 };
 
 // 小于函数
-class LtFunction : public TemplateFn {
+class LtFunction : public BuiltinFn {
 public:
-    Values* operator()(const std::vector<Values*>& args) {
+    Values* operator()(ExecContext&, const std::vector<Values*>& args) const {
         if (args.size() < 2) {
             return Values::MakeBool(false);
         }
@@ -189,53 +171,51 @@ public:
 };
 
 // 大于等于函数
-class GeFunction : public TemplateFn {
+class GeFunction : public BuiltinFn {
 public:
-    GeFunction(FunctionLib& lib) : lib_(lib) {}
+    GeFunction(const FunctionLib& lib) : lib_(lib) {}
     
-    Values* operator()(const std::vector<Values*>& args) {
+    Values* operator()(ExecContext& ctx, const std::vector<Values*>& args) const {
         if (args.size() < 2) {
             return Values::MakeBool(false);
         }
         
         // 使用 lt 函数的否定
-        Values* ltResult = lib_.GetFunction("lt")->operator()(args);
+        Values* ltResult = (*lib_.GetFunction("lt"))(ctx, args);
         Values* result = Values::MakeBool(!ltResult->AsBool());
         delete ltResult; // 释放临时结果
         return result;
     }
     
 private:
-    FunctionLib& lib_;
+    const FunctionLib& lib_;
 };
 
 // 小于等于函数
-class LeFunction : public TemplateFn {
+class LeFunction : public BuiltinFn {
 public:
-    LeFunction(FunctionLib& lib) : lib_(lib) {}
+    LeFunction(const FunctionLib& lib) : lib_(lib) {}
     
-    Values* operator()(const std::vector<Values*>& args) {
+    Values* operator()(ExecContext& ctx, const std::vector<Values*>& args) const {
         if (args.size() < 2) {
             return Values::MakeBool(false);
         }
         
         // 使用 gt 函数的否定
-        Values* gtResult = lib_.GetFunction("gt")->operator()(args);
+        Values* gtResult = (*lib_.GetFunction("gt"))(ctx, args);
         Values* result = Values::MakeBool(!gtResult->AsBool());
         delete gtResult; // 释放临时结果
         return result;
     }
     
 private:
-    FunctionLib& lib_;
+    const FunctionLib& lib_;
 };
 
 // 新增：and函数实现
-class AndFunction : public TemplateFn {
+class AndFunction : public BuiltinFn {
 public:
-    AndFunction(FunctionLib& lib) : lib_(lib) {}
-
-    Values* operator()(const std::vector<Values*>& args) {
+    Values* operator()(ExecContext& ctx, const std::vector<Values*>& args) const {
         // 如果没有参数，返回true（空and为true）
         if (args.empty()) {
             return Values::MakeBool(true);
@@ -243,7 +223,7 @@ public:
         
         // 短路逻辑：任何一个参数为假时立即返回false
         for (size_t i = 0; i < args.size(); ++i) {
-            if (lib_.GetContext() && !lib_.GetContext()->isTrue(args[i])) {
+            if (!ctx.isTrue(args[i])) {
                 return Values::MakeBool(false);
             }
         }
@@ -251,17 +231,12 @@ public:
         // 所有参数都为真，返回true
         return Values::MakeBool(true);
     }
-    
-private:
-    FunctionLib& lib_;
 };
 
 // 新增：or函数实现
-class OrFunction : public TemplateFn {
+class OrFunction : public BuiltinFn {
 public:
-    OrFunction(FunctionLib& lib) : lib_(lib) {}
-
-    Values* operator()(const std::vector<Values*>& args) {
+    Values* operator()(ExecContext& ctx, const std::vector<Values*>& args) const {
         // 如果没有参数，返回false（空or为false）
         if (args.empty()) {
             return Values::MakeBool(false);
@@ -269,7 +244,7 @@ public:
         
         // 短路逻辑：任何一个参数为真时立即返回true
         for (size_t i = 0; i < args.size(); ++i) {
-            if (lib_.GetContext() && lib_.GetContext()->isTrue(args[i])) {
+            if (ctx.isTrue(args[i])) {
                 return Values::MakeBool(true);
             }
         }
@@ -277,35 +252,27 @@ public:
         // 所有参数都为假，返回false
         return Values::MakeBool(false);
     }
-    
-private:
-    FunctionLib& lib_;
 };
 
 // 新增：not函数实现
-class NotFunction : public TemplateFn {
+class NotFunction : public BuiltinFn {
 public:
-    NotFunction(FunctionLib& lib) : lib_(lib) {}
-
-    Values* operator()(const std::vector<Values*>& args) {
+    Values* operator()(ExecContext& ctx, const std::vector<Values*>& args) const {
         // 如果没有参数，返回true（非空为真）
         if (args.empty()) {
             return Values::MakeBool(true);
         }
         
         // 对第一个参数取反
-        bool value = lib_.GetContext() ? !lib_.GetContext()->isTrue(args[0]) : true;
+        bool value = !ctx.isTrue(args[0]);
         return Values::MakeBool(value);
     }
-    
-private:
-    FunctionLib& lib_;
 };
 
 // default函数实现（支持两个参数）
-class DefaultFunction : public TemplateFn {
+class DefaultFunction : public BuiltinFn {
 public:
-    Values* operator()(const std::vector<Values*>& args) {
+    Values* operator()(ExecContext&, const std::vector<Values*>& args) const {
         if (args.empty()) return Values::MakeNull();
         Values* value = args[0];
         Values* def = args.size() > 1 ? args[1] : Values::MakeNull();
@@ -320,29 +287,29 @@ public:
 };
 
 // FunctionLib实现
-FunctionLib::FunctionLib() : ctx_(NULL) {
-    // 延迟初始化内置函数，等到有了ExecContext
-}
-
-void FunctionLib::SetContext(ExecContext* ctx) {
-    ctx_ = ctx;
-    
-    // 现在有了context，可以初始化内置函数
-    if (ctx_) {
+FunctionLib::FunctionLib() {
     initBuiltinFunctions();
-    }
 }
 
 FunctionLib::~FunctionLib() {
     // 清理所有函数
-    for (std::map<std::string, TemplateFn*>::iterator it = functions_.begin(); 
+    for (std::map<std::string, TemplateFn*, std::less<> >::iterator it = functions_.begin(); 
          it != functions_.end(); ++it) {
         delete it->second;
     }
 }
 
 void FunctionLib::AddFunction(const std::string& name, TemplateFn* func) {
-    functions_[name] = func;
+    // 替换同名函数时释放旧的
+    std::map<std::string, TemplateFn*, std::less<> >::iterator it = functions_.find(name);
+    if (it != functions_.end()) {
+        if (it->second != func) {
+            delete it->second;
+        }
+        it->second = func;
+    } else {
+        functions_[name] = func;
+    }
 }
 
 bool FunctionLib::HasFunction(const std::string& name) const {
@@ -350,13 +317,30 @@ bool FunctionLib::HasFunction(const std::string& name) const {
 }
 
 TemplateFn* FunctionLib::GetFunction(const std::string& name) const {
-    std::map<std::string, TemplateFn*>::const_iterator it = functions_.find(name);
-    if (it != functions_.end()) {
-        return it->second;
+    TemplateFn* func = FindFunction(name);
+    if (func) {
+        return func;
     }
     throw ExecError(RuntimeError, "", "function not found: " + name);
 }
 
+TemplateFn* FunctionLib::FindFunction(std::string_view name) const {
+    std::map<std::string, TemplateFn*, std::less<> >::const_iterator it = functions_.find(name);
+    return it != functions_.end() ? it->second : NULL;
+}
+
+void FunctionLib::Bind(const Tree* tree) const {
+    const std::vector<IdentifierNode*>& identifiers = tree->Identifiers();
+    for (size_t i = 0; i < identifiers.size(); ++i) {
+        identifiers[i]->BindFunction(this, FindFunction(identifiers[i]->Ident()));
+    }
+}
+
+const FunctionLib& FunctionLib::Builtins() {
+    static const FunctionLib builtins;
+    return builtins;
+}
+
 // 内置函数初始化
 void FunctionLib::initBuiltinFunctions() {
     // 添加内置函数
@@ -368,9 +352,9 @@ void FunctionLib::initBuiltinFunctions() {
     AddFunction("le", new LeFunction(*this));
     
     // 添加逻辑函数
-    AddFunction("and", new AndFunction(*this));
-    AddFunction("or", new OrFunction(*this));
-    AddFunction("not", new NotFunction(*this));
+    AddFunction("and", new AndFunction());
+    AddFunction("or", new OrFunction());
+    AddFunction("not", new NotFunction());
     
     // 新增：default函数
     AddFunction("default", new DefaultFunction());
@@ -379,50 +363,92 @@ void FunctionLib::initBuiltinFunctions() {
 }
 
 // ExecContext实现
+// 一次渲染内具名模板的输出缓存，键为具名模板和参数的地址。
+// 只缓存参数借用自输入数据的调用：输入数据在整个渲染期间不变也不释放，地址相同即内容相同
+struct TemplateMemo {
+    typedef std::pair<const NamedTemplate*, const Values*> Key;
+    std::map<Key, std::string> outputs;
+    size_t impureCalls; // 非纯函数的调用次数；具名模板执行期间有增加时，其输出不缓存
+
+    TemplateMemo() : impureCalls(0) {}
+};
+
 ExecContext::ExecContext(
     Tree* tmpl,
     std::ostream& writer,
-    Values* data,
-    FunctionLib& funcs,
+    const Values* data,
+    const FunctionLib& funcs,
     const ExecOptions& options)
-    : tmpl_(tmpl), writer_(writer), funcs_(funcs), options_(options),
-      currentNode_(0), depth_(0) {
-    
-    // 设置FunctionLib的context指针
-    funcs_.SetContext(this);
-    
-    // 初始化顶层变量("$") - 创建 data 的深拷贝
-    Values* dataCopy = data ? data->DeepCopy() : Values::MakeNull();
-    PushVariable("$", dataCopy); // 推入副本，ExecContext 现在拥有 dataCopy
+    : tmpl_(tmpl), ownsTemplate_(true), writer_(&writer), currentNode_(0), varBase_(0),
+      funcs_(funcs), options_(options), depth_(0), compiled_(NULL), memo_(NULL),
+      dataStable_(data != NULL), program_(NULL), ownedProgram_(NULL) {
+    init(data);
+}
+
+ExecContext::ExecContext(
+    const Tree* tmpl,
+    const Program* program,
+    std::ostream& writer,
+    const Values* data,
+    const FunctionLib& funcs,
+    const ExecOptions& options)
+    : tmpl_(tmpl), ownsTemplate_(false), writer_(&writer), currentNode_(0), varBase_(0),
+      funcs_(funcs), options_(options), depth_(0), compiled_(NULL), memo_(NULL),
+      dataStable_(data != NULL), program_(program), ownedProgram_(NULL) {
+    init(data);
+}
+
+ExecContext::ExecContext(
+    const CompiledTemplate& compiled,
+    std::ostream& writer,
+    const Values* data,
+    const FunctionLib& funcs,
+    const ExecOptions& options)
+    : tmpl_(compiled.Main()), ownsTemplate_(false), writer_(&writer), currentNode_(0), varBase_(0),
+      funcs_(funcs), options_(options), depth_(0), compiled_(&compiled), memo_(NULL),
+      dataStable_(data != NULL), program_(compiled.MainProgram()), ownedProgram_(NULL) {
+    init(data);
+}
+
+void ExecContext::init(const Values* data) {
+    // 初始化顶层变量("$") - 借用调用者的数据，执行期间只读，调用者保证其生命周期
+    // 变量栈存放的是可变指针，但借用的数据在执行中从不被修改
+    if (data) {
+        PushVariable("$", const_cast<Values*>(data), false);
+    } else {
+        PushVariable("$", Values::MakeNull());
+    }
 }
 
 ExecContext::~ExecContext() {
     // 释放所有变量 (包括我们拷贝的 $)
     try {
         for (size_t i = 0; i < vars_.size(); ++i) {
-            delete vars_[i].value;
+            if (vars_[i].owned) {
+                delete vars_[i].value;
+            }
             vars_[i].value = NULL;
         }
         vars_.clear();
         
+        // 释放编译结果（必须在模板之前，指令引用模板中的节点）
+        delete ownedProgram_;
+        ownedProgram_ = NULL;
+        program_ = NULL;
+        
         // 释放模板
-        if (tmpl_) {
+        if (tmpl_ && ownsTemplate_) {
             delete tmpl_;
-            tmpl_ = NULL;
         }
+        tmpl_ = NULL;
         
-        // 释放模板缓存
-        for (std::map<std::string, Tree*>::iterator it = templateCache_.begin();
-             it != templateCache_.end(); ++it) {
-            delete it->second;
-            it->second = NULL;
-        }
-        templateCache_.clear();
+        delete memo_;
+        memo_ = NULL;
     } catch (const std::exception& e) {
-        std::cerr << "析构函数中发生异常: " << e.what() << std::endl;
+        TE_TRACE(TraceExec, TraceError, "析构函数中发生异常: " << e.what());
         // 析构函数中不应抛出异常，只记录错误
     } catch (...) {
-        std::cerr << "析构函数中发生未知异常" << std::endl;
+        TE_TRACE(TraceExec, TraceError, "析构函数中发生未知异常");
     }
 }
 
@@ -432,36 +458,57 @@ void ExecContext::Execute() {
     }
     
     // 检查模板中的所有节点 - 使用新的递归打印
-    std::cout << "\n=== 检查模板节点 (递归) ===" << std::endl;
-    printNodeTree(tmpl_->GetRoot(), 0); // <--- 调用新的递归函数
-    std::cout << "===========================\n" << std::endl;
+    if (TE_TRACE_ENABLED(TraceExec, TraceVerbose)) {
+        std::ostream& os = TraceStream(TraceExec);
+        os << "=== 检查模板节点 (递归) ===" << std::endl;
+        printNodeTree(os, tmpl_->GetRoot(), 0);
+        os << "===========================" << std::endl;
+    }
     
+    // 没有预先设置编译结果时，在这里编译一次；模板归本上下文所有时顺便绑定函数
+    if (!program_) {
+        ownedProgram_ = Program::Compile(tmpl_);
+        program_ = ownedProgram_;
+        if (ownsTemplate_) {
+            funcs_.Bind(tmpl_);
+        }
+    }
+
+    // "."初始为"$"，直接借用，不复制
+    Values* root = vars_.front().value;
     try {
-        walk(GetVariable("$"), tmpl_->GetRoot());
+        run(*program_, root);
     } catch (const ExecError& e) {
-        std::cerr << "执行错误: " << e.what() << std::endl;
+        TE_TRACE(TraceExec, TraceError, "执行错误: " << e.what());
         throw;
     } catch (const std::exception& e) {
-        std::cerr << "未处理的异常: " << e.what() << std::endl;
+        TE_TRACE(TraceExec, TraceError, "未处理的异常: " << e.what());
         Error(RuntimeError, "execution error: %s", e.what());
     } catch (...) {
-        std::cerr << "未知异常" << std::endl;
+        TE_TRACE(TraceExec, TraceError, "未知异常");
         Error(RuntimeError, "unknown execution error");
     }
 }
 
+void ExecContext::SetProgram(const Program* program) {
+    program_ = program;
+}
+
 Tree* ExecContext::GetTemplate() {
-    Tree* result = tmpl_;
+    if (!ownsTemplate_) {
+        return NULL;
+    }
+    Tree* result = const_cast<Tree*>(tmpl_);
     tmpl_ = NULL; // 转移所有权
     return result;
 }
 
 std::ostream& ExecContext::GetWriter() {
-    return writer_;
+    return *writer_;
 }
 
-void ExecContext::PushVariable(const std::string& name, Values* value) {
-    vars_.push_back(Variable(name, value));
+void ExecContext::PushVariable(const std::string& name, Values* value, bool owned) {
+    vars_.push_back(Variable(name, value, owned));
 }
 
 int ExecContext::MarkVariables() {
@@ -472,17 +519,22 @@ void ExecContext::PopVariables(int mark) {
     if (mark >= 0 && mark <= (int)vars_.size()) {
         // 删除从mark到末尾的所有变量
         for (size_t i = mark; i < vars_.size(); ++i) {
-            delete vars_[i].value;
+            if (vars_[i].owned) {
+                delete vars_[i].value;
+            }
         }
         vars_.resize(mark);
     }
 }
 
 void ExecContext::SetVariable(const std::string& name, Values* value) {
-    for (int i = vars_.size() - 1; i >= 0; --i) {
+    for (int i = vars_.size() - 1; i >= (int)varBase_; --i) {
         if (vars_[i].name == name) {
-            delete vars_[i].value; // 释放旧值
+            if (vars_[i].owned) {
+                delete vars_[i].value; // 释放旧值
+            }
             vars_[i].value = value;
+            vars_[i].owned = true;
             return;
         }
     }
@@ -492,17 +544,21 @@ void ExecContext::SetVariable(const std::string& name, Values* value) {
     Error(UndefinedVariable, "undefined variable: %s", name.c_str());
 }
 
-void ExecContext::SetTopVariable(int n, Values* value) {
+void ExecContext::SetTopVariable(int n, Values* value, bool owned) {
     if (n > 0 && vars_.size() >= (size_t)n) {
-        delete vars_[vars_.size() - n].value; // 释放旧值
-        vars_[vars_.size() - n].value = value;
-    } else {
+        Variable& var = vars_[vars_.size() - n];
+        if (var.owned) {
+            delete var.value; // 释放旧值
+        }
+        var.value = value;
+        var.owned = owned;
+    } else if (owned) {
         delete value; // 未使用，释放
     }
 }
 
 Values* ExecContext::GetVariable(const std::string& name) {
-    for (int i = vars_.size() - 1; i >= 0; --i) {
+    for (int i = vars_.size() - 1; i >= (int)varBase_; --i) {
         if (vars_[i].name == name) {
             // 创建副本返回
             return new Values(*vars_[i].value);
@@ -539,7 +595,7 @@ void ExecContext::Error(ExecErrorType type, const std::string& format, ...) {
     throw ExecError(type, templateName, msg);
 }
 
-FunctionLib& ExecContext::GetFunctions() {
+const FunctionLib& ExecContext::GetFunctions() const {
     return funcs_;
 }
 
@@ -554,308 +610,400 @@ void ExecContext::DecrementDepth() {
     depth_--;
 }
 
-void ExecContext::walk(Values* dot, const Node* node) {
-    // 保存当前节点
-    const Node* savedNode = currentNode_;
-    currentNode_ = node;
-    
-    try {
-        // 根据节点类型进行处理
-        std::cout << "walk: 处理节点类型 " << node->Type() << std::endl;
-        switch (node->Type()) {
-            case NodeText:
-                writer_ << static_cast<const TextNode*>(node)->Text();
+// 所有缺失字段共用的空值，只借出不释放
+static Values* sharedNull() {
+    static Values null;
+    return &null;
+}
+
+// 在映射value中查找一段字段，不复制；value不是映射或字段不存在时返回NULL。
+// cached为true时先试segment上缓存的位置，位置变化时才写回，命中时不写共享的节点
+static Values* lookupSegment(const Values* value, const FieldSegment& segment, bool cached) {
+    if (!value || !value->IsMap()) {
+        return NULL;
+    }
+    const ValuesMap& map = value->AsMap();
+    ValuesMap::const_iterator it;
+    if (cached) {
+        uint32_t slot = segment.slot.load(std::memory_order_relaxed);
+        uint32_t hint = slot;
+        it = map.find(segment.name, segment.hash, hint);
+        if (hint != slot) {
+            segment.slot.store(hint, std::memory_order_relaxed);
+        }
+    } else {
+        it = map.find(segment.name, segment.hash);
+    }
+    return it == map.end() ? NULL : it->second;
+}
+
+// 从value开始沿各段字段逐级借用
+static Values* lookupPath(Values* value, const FieldPath& path, bool cached) {
+    for (FieldPath::const_iterator it = path.begin(); it != path.end() && value; ++it) {
+        value = lookupSegment(value, *it, cached);
+    }
+    return value;
+}
+
+// 执行编译后的指令序列
+// with和range进入时把新的"."压入变量栈，并在frames中记录恢复所需的状态；
+// SCOPE_BEGIN只记录变量栈位置。循环体和分支都是平铺的指令，不再按节点递归
+void ExecContext::run(const Program& program, Values* dot) {
+    // with/range/变量作用域 的执行帧
+    struct Frame {
+        Values* savedDot;  // 进入前的"."
+        bool savedStable;  // 进入前的"."是否借用自输入数据
+        int mark;          // 进入前的变量栈位置
+        Values* items;     // range 遍历的集合（with 为 NULL）
+        bool ownsItems;    // items是否需要在循环结束时释放
+        size_t index;      // 列表的下一个下标
+        ValuesMap::const_iterator next; // 映射的下一个键值对
+    };
+    std::vector<Frame> frames;
+    // "."是否借用自整个渲染期间不变的输入数据（决定{{template}}的输出能否按地址缓存）
+    bool dotStable = dataStable_;
+
+    const std::vector<Instruction>& code = program.Code();
+    size_t pc = 0;
+    for (;;) {
+        const Instruction& ins = code[pc];
+        currentNode_ = ins.node;
+        switch (ins.op) {
+            case OpText:
+                *writer_ << static_cast<const TextNode*>(ins.node)->Text();
+                ++pc;
                 break;
-                
-            case NodeAction: {
-                const ActionNode* action = static_cast<const ActionNode*>(node);
-                const PipeNode* pipe = action->Pipe();
-                Values* value = evalPipeline(dot, pipe);
-                PrintValue(node, value);
-                delete value;
+
+            case OpField:
+            case OpCall: {
+                // 单命令管道：直接求值命令，省去管道层的变量标记；字段直接借用输入数据输出
+                const PipeNode* pipe = static_cast<const ActionNode*>(ins.node)->Pipe();
+                bool owned = true;
+                Values* value = evalCommandRef(dot, pipe->Cmds()[0], owned, true);
+                if (!value) {
+                    value = Values::MakeNull();
+                    owned = true;
+                }
+                PrintValue(ins.node, value);
+                if (owned) {
+                    delete value;
+                }
+                ++pc;
                 break;
             }
-                
-            case NodeList: {
-                const ListNode* list = static_cast<const ListNode*>(node);
-                const std::vector<Node*>& nodes = list->Nodes();
-                // 添加详细日志
-                std::cout << "  Walking list node at " << node << " containing " << nodes.size() << " children." << std::endl;
-                for (size_t i = 0; i < nodes.size(); ++i) {
-                    // 添加空指针检查
-                    if (!nodes[i]) { 
-                         std::cout << "  WARNING: Child node at index " << i << " is NULL!" << std::endl;
-                         continue;
-                    }
-                    // 打印正在处理的子节点信息
-                    std::cout << "  Walking child " << i << " (Type " << nodes[i]->Type() << ") at " << nodes[i] << std::endl;
-                    walk(dot, nodes[i]);
+
+            case OpAction: {
+                // 声明或给变量赋值的动作不输出
+                const PipeNode* pipe = static_cast<const ActionNode*>(ins.node)->Pipe();
+                bool owned = true;
+                Values* value = evalPipelineRef(dot, pipe, owned, true);
+                if (!pipe || pipe->Decl().empty()) {
+                    PrintValue(ins.node, value);
+                }
+                if (owned) {
+                    delete value;
                 }
+                ++pc;
                 break;
             }
-                
-            case NodeIf:
-                walkIfOrWith(NodeIf, dot, static_cast<const IfNode*>(node));
+
+            case OpJumpIfFalse: {
+                bool owned = true;
+                Values* value = evalPipelineRef(dot, static_cast<const BranchNode*>(ins.node)->GetPipe(), owned, true);
+                bool cond = isTrue(value);
+                if (owned) {
+                    delete value;
+                }
+                pc = cond ? pc + 1 : ins.target;
                 break;
-                
-            case NodeWith:
-                walkIfOrWith(NodeWith, dot, static_cast<const WithNode*>(node));
+            }
+
+            case OpWithBegin: {
+                // with体内可能给变量重新赋值，新的"."只借用输入数据，不借用变量
+                bool owned = true;
+                Values* value = evalPipelineRef(dot, static_cast<const BranchNode*>(ins.node)->GetPipe(), owned, false);
+                if (!isTrue(value)) {
+                    if (owned) {
+                        delete value;
+                    }
+                    pc = ins.target;
+                    break;
+                }
+                Frame frame;
+                frame.savedDot = dot;
+                frame.savedStable = dotStable;
+                frame.mark = MarkVariables();
+                frame.items = NULL;
+                frame.ownsItems = false;
+                frame.index = 0;
+                frames.push_back(frame);
+                PushVariable(".", value, owned); // 变量栈接管自己求值出来的value
+                dot = vars_.back().value;
+                dotStable = dotStable && !owned;
+                ++pc;
                 break;
-                
-            case NodeRange:
-                std::cout << "执行NodeRange(15)节点" << std::endl;
-                walkRange(dot, static_cast<const RangeNode*>(node));
+            }
+
+            case OpWithEnd: {
+                Frame& frame = frames.back();
+                dot = frame.savedDot;
+                dotStable = frame.savedStable;
+                PopVariables(frame.mark);
+                frames.pop_back();
+                ++pc;
                 break;
-                
-            case NodeTemplate:
-                walkTemplate(dot, static_cast<const TemplateNode*>(node));
+            }
+
+            case OpRangeBegin: {
+                bool failed = false;
+                bool owned = true;
+                Values* items = evalRangeItems(dot, static_cast<const BranchNode*>(ins.node), failed, owned);
+                if (failed) {
+                    pc = ins.alt;
+                    break;
+                }
+                bool empty = !items ||
+                             (items->IsList() ? items->AsList().empty()
+                                              : (!items->IsMap() || items->AsMap().empty()));
+                if (empty) {
+                    if (owned) {
+                        delete items;
+                    }
+                    pc = ins.target;
+                    break;
+                }
+                Frame frame;
+                frame.savedDot = dot;
+                frame.savedStable = dotStable;
+                frame.mark = MarkVariables();
+                frame.items = items;
+                frame.ownsItems = owned;
+                frame.index = 0;
+                if (items->IsMap()) {
+                    frame.next = items->AsMap().begin();
+                }
+                frames.push_back(frame);
+                // "."和声明的变量（$元素，或$下标/$键、$元素）占位，每次迭代替换
+                PushVariable(".", Values::MakeNull());
+                const VariableVector& decls = static_cast<const BranchNode*>(ins.node)->GetPipe()->Decl();
+                for (size_t i = 0; i < decls.size(); ++i) {
+                    PushVariable(std::string(decls[i]->Ident()), Values::MakeNull());
+                }
+                ++pc;
                 break;
-                
-            default:
-                std::cout << "未知节点类型: " << node->Type() << std::endl;
-                if (node->Type() == 15) { // 再次检查是否是Range
-                    std::cout << "尝试处理可能的Range节点(类型15)" << std::endl;
-                    walkRange(dot, static_cast<const RangeNode*>(node));
-                } else {
-                    Error(RuntimeError, "unknown node type: %d", static_cast<int>(node->Type()));
+            }
+
+            case OpRangeNext: {
+                Frame& frame = frames.back();
+                const VariableVector& decls = static_cast<const BranchNode*>(ins.node)->GetPipe()->Decl();
+                // 每次迭代是新的作用域：丢弃上一次循环体中声明的变量
+                PopVariables(frame.mark + 1 + decls.size());
+                Values* item = NULL;
+                bool itemOwned = false;
+                Values* key = NULL;     // 声明两个变量时的下标或键
+                Values* element = NULL; // 声明的变量中的元素，借用
+                if (frame.items->IsList()) {
+                    // 列表元素直接借用，不复制
+                    ValuesList& list = frame.items->AsList();
+                    if (frame.index < list.size()) {
+                        item = &list[frame.index];
+                        element = item;
+                        if (decls.size() > 1) {
+                            key = Values::MakeNumber(frame.index);
+                        }
+                        ++frame.index;
+                    }
+                } else if (frame.next != frame.items->AsMap().end()) {
+                    // 映射按键的顺序遍历，"."是新建的 {key, value}
+                    item = Values::MakeMap(std::map<std::string, Values*>());
+                    item->AsMap()["key"] = Values::MakeString(frame.next->first);
+                    item->AsMap()["value"] = frame.next->second ? new Values(*frame.next->second)
+                                                                : Values::MakeNull();
+                    itemOwned = true;
+                    element = item->AsMap()["value"];
+                    if (decls.size() > 1) {
+                        key = Values::MakeString(frame.next->first);
+                    }
+                    ++frame.next;
+                }
+                if (!item) {
+                    // 遍历结束，恢复进入range之前的状态
+                    dot = frame.savedDot;
+                    dotStable = frame.savedStable;
+                    PopVariables(frame.mark);
+                    if (frame.ownsItems) {
+                        delete frame.items;
+                    }
+                    frames.pop_back();
+                    pc = ins.target;
+                    break;
+                }
+                if (decls.size() > 1) {
+                    SetTopVariable(2, key);
                 }
+                if (!decls.empty()) {
+                    SetTopVariable(1, element, false);
+                }
+                SetTopVariable(1 + decls.size(), item, itemOwned);
+                dot = item;
+                // 借用的列表元素和所在列表一样稳定
+                dotStable = frame.savedStable && !frame.ownsItems && !itemOwned;
+                ++pc;
+                break;
+            }
+
+            case OpJump:
+                pc = ins.target;
+                break;
+
+            case OpScopeBegin: {
+                Frame frame;
+                frame.savedDot = dot;
+                frame.savedStable = dotStable;
+                frame.mark = MarkVariables();
+                frame.items = NULL;
+                frame.ownsItems = false;
+                frame.index = 0;
+                frames.push_back(frame);
+                ++pc;
+                break;
+            }
+
+            case OpScopeEnd:
+                PopVariables(frames.back().mark);
+                frames.pop_back();
+                ++pc;
+                break;
+
+            case OpTemplate:
+                walkTemplate(dot, dotStable, static_cast<const TemplateNode*>(ins.node));
+                ++pc;
+                break;
+
+            case OpUnknown:
+                Error(RuntimeError, "unknown node type: %d", static_cast<int>(ins.node->Type()));
+                break;
+
+            case OpHalt:
+                currentNode_ = NULL;
+                return;
         }
-    } catch (const std::exception& e) {
-        std::cout << "walk处理节点时异常: " << e.what() << std::endl;
-        // 恢复当前节点并重新抛出异常
-        currentNode_ = savedNode;
-        throw;
     }
-    
-    // 恢复当前节点
-    currentNode_ = savedNode;
 }
 
-void ExecContext::walkRange(Values* dot, const RangeNode* node) {
-    std::cout << "\n=== walkRange开始执行 ===" << std::endl;
-    
-    // 打印Range节点信息
-    std::cout << "Range节点位置: " << node->Position() << std::endl;
-    if (node->GetPipe()) {
-        std::cout << "Range管道命令数: " << node->GetPipe()->Cmds().size() << std::endl;
-    } else {
-        std::cout << "Range节点没有管道!" << std::endl;
-        return;
+// 求值range要遍历的集合，集合尽量借用输入数据
+// 求值出错时failed置为true，整个range被跳过
+Values* ExecContext::evalRangeItems(Values* dot, const BranchNode* node, bool& failed, bool& owned) {
+    owned = true;
+    const PipeNode* pipe = node->GetPipe();
+    if (!pipe) {
+        failed = true;
+        return NULL;
     }
 
-    // 获取Range管道的值，这是我们要遍历的集合
-    std::cout << "正在评估Range管道..." << std::endl;
-    Values* items = NULL;
-    
     try {
-        // 首先尝试特殊处理Items
-        if (node->GetPipe()->Cmds().size() == 1 && 
-            node->GetPipe()->Cmds()[0]->Args().size() == 1 &&
-            node->GetPipe()->Cmds()[0]->Args()[0]->Type() == NodeField) {
-            
-            const FieldNode* fieldNode = static_cast<const FieldNode*>(node->GetPipe()->Cmds()[0]->Args()[0]);
-            std::string fieldName = fieldNode->Ident();
-            if (!fieldName.empty() && fieldName[0] == '.') {
-                fieldName = fieldName.substr(1);
-            }
-            
-            std::cout << "Range字段名: " << fieldName << std::endl;
-            
-            // 直接从根数据查找Items
-            items = dot->PathValue(fieldName);
-            if (items) {
-                std::cout << "直接获取Items成功, 类型: " << items->TypeName() << std::endl;
-            } else {
-                std::cout << "直接获取Items失败!" << std::endl;
-            }
-        }
-        
-        // 如果特殊处理失败，尝试常规管道处理
-        if (!items) {
-            std::cout << "尝试管道评估..." << std::endl;
-            items = evalPipeline(dot, node->GetPipe());
-        }
-        
+        // 循环体可能给变量重新赋值，只借用输入数据，不借用变量
+        return evalPipelineRef(dot, pipe, owned, false, false);
     } catch (const std::exception& e) {
-        std::cout << "评估Range管道异常: " << e.what() << std::endl;
-        return;
+        TE_TRACE(TraceExec, TraceDebug, "评估Range管道异常: " << e.what());
+        failed = true;
+        return NULL;
     }
-    
-    if (!items) {
-        std::cout << "Range管道评估结果为NULL，将使用else分支" << std::endl;
-        if (node->ElseList()) {
-            walk(dot, node->ElseList());
-        }
-        return;
+}
+
+// 管道是否只是"$"本身
+static bool isRootVariable(const PipeNode* pipe) {
+    if (!pipe->Decl().empty() || pipe->Cmds().size() != 1 || pipe->Cmds()[0]->Args().size() != 1) {
+        return false;
+    }
+    const Node* arg = pipe->Cmds()[0]->Args()[0];
+    return arg->Type() == NodeVariable && static_cast<const VariableNode*>(arg)->Ident() == "$";
+}
+
+void ExecContext::walkTemplate(Values* dot, bool dotStable, const TemplateNode* node) {
+    const NamedTemplate* named = findTemplate(std::string(node->Name()));
+    if (options_.stats) {
+        options_.stats->templateCalls++;
     }
     
-    // 添加详细日志检查 items
-    std::cout << "Range管道评估成功，检查返回的 items:" << std::endl;
-    std::cout << "  items 指针: " << items << std::endl;
-    std::cout << "  items 类型: " << items->TypeName() << std::endl;
-    if (items->IsList()) {
-        std::cout << "  items 是列表，长度: " << items->AsList().size() << std::endl;
-        if (items->AsList().empty()) {
-             std::cout << "  items 列表为空!" << std::endl;
+    // 参数尽量借用，不复制；除"$"外不借用变量，借用的参数与"."一样稳定
+    Values* data = dot;
+    bool owned = false;
+    bool stable = dotStable;
+    if (node->Pipe()) {
+        if (isRootVariable(node->Pipe())) {
+            data = vars_[varBase_].value;
+            stable = dataStable_ && !vars_[varBase_].owned;
+        } else {
+            data = evalPipelineRef(dot, node->Pipe(), owned, false);
+            stable = dotStable && !owned;
         }
-    } else {
-        std::cout << "  items 不是列表!" << std::endl;
     }
-    // 结束添加的日志
+    if (!data) {
+        data = Values::MakeNull();
+        owned = true;
+        stable = false;
+    }
     
-    std::cout << "Range值类型: " << items->TypeName() << std::endl;
+    // 输出缓存在本次渲染第一次调用具名模板时创建
+    if (options_.memoizeTemplates && !memo_) {
+        memo_ = new TemplateMemo();
+    }
     
-    // 处理列表类型
-    if (items->IsList()) {
-        const std::vector<Values*>& list = items->AsList();
-        std::cout << "处理列表: 长度=" << list.size() << std::endl;
-        
-        if (list.empty()) {
-            std::cout << "列表为空, 使用else分支" << std::endl;
-            if (node->ElseList()) {
-                walk(dot, node->ElseList());
-            }
+    try {
+        if (!stable || !memo_) {
+            execTemplate(named, data, stable, *writer_);
         } else {
-            // 有内容，遍历列表
-            int mark = MarkVariables();
-            // 先压入一个占位符
-            PushVariable(".", Values::MakeNull()); 
-            
-            for (size_t i = 0; i < list.size(); ++i) {
-                std::cout << "\n处理列表项 " << i << std::endl;
-                
-                // 创建当前项目的值
-                Values* item = NULL;
-                if (list[i]) {
-                    item = new Values(*list[i]); // 创建副本
-                    std::cout << "  项目类型: " << item->TypeName() << std::endl;
-                    
-                    if (item->IsMap()) {
-                        const std::map<std::string, Values*>& itemMap = item->AsMap();
-                        std::cout << "  项目键: ";
-                        for (std::map<std::string, Values*>::const_iterator it = itemMap.begin();
-                             it != itemMap.end(); ++it) {
-                            std::cout << it->first << " ";
-                        }
-                        std::cout << std::endl;
-                    }
-                } else {
-                    item = Values::MakeNull();
-                    std::cout << "  项目为null" << std::endl;
+            TemplateMemo::Key key(named, data);
+            std::map<TemplateMemo::Key, std::string>::const_iterator it = memo_->outputs.find(key);
+            if (it != memo_->outputs.end()) {
+                *writer_ << it->second;
+                if (options_.stats) {
+                    options_.stats->memoHits++;
                 }
-                
-                // 更新栈顶的 "." 变量的值
-                SetTopVariable(1, item); 
-                
-                // 执行range循环体
-                std::cout << "  执行Range循环体:" << std::endl;
-                if (node->List()) {
-                    // 使用更新后的栈顶变量作为上下文
-                    walk(vars_.back().value, node->List()); 
-                } else {
-                    std::cout << "  Range节点没有循环体!" << std::endl;
+            } else {
+                // 第一次调用：输出先写入缓冲区，执行期间没有调用非纯函数时缓存
+                size_t impureCalls = memo_->impureCalls;
+                std::ostringstream output;
+                execTemplate(named, data, true, output);
+                std::string text = output.str();
+                *writer_ << text;
+                if (memo_->impureCalls == impureCalls) {
+                    memo_->outputs[key].swap(text);
                 }
-                // SetTopVariable 已经处理了旧值的释放，这里不需要额外操作
             }
-            
-            // 恢复变量状态，弹出循环开始前添加的"."变量
-            PopVariables(mark);
         }
-    }
-    // 处理映射类型
-    else if (items->IsMap()) {
-        const std::map<std::string, Values*>& mapValues = items->AsMap();
-        std::cout << "处理映射: 键数=" << mapValues.size() << std::endl;
-        
-        if (mapValues.empty()) {
-            std::cout << "映射为空, 使用else分支" << std::endl;
-            if (node->ElseList()) {
-                walk(dot, node->ElseList());
-            }
-        } else {
-            // 有内容，遍历映射
-            int mark = MarkVariables();
-            // 先压入一个占位符
-            PushVariable(".", Values::MakeNull()); 
-            
-            // 收集并排序所有键
-            std::vector<std::string> keys;
-            for (std::map<std::string, Values*>::const_iterator it = mapValues.begin(); 
-                 it != mapValues.end(); ++it) {
-                keys.push_back(it->first);
-            }
-            std::sort(keys.begin(), keys.end());
-            
-            // 遍历键值对
-            for (size_t i = 0; i < keys.size(); ++i) {
-                const std::string& key = keys[i];
-                std::cout << "\n处理映射项 " << key << std::endl;
-                
-                // 创建包含key和value的新map
-                std::map<std::string, Values*> entryMap;
-                entryMap["key"] = Values::MakeString(key);
-                
-                Values* valueCopy = nullptr;
-                auto mapIt = mapValues.find(key);
-                if (mapIt != mapValues.end() && mapIt->second) {
-                     valueCopy = new Values(*mapIt->second); // 创建值的副本
-                } else {
-                    valueCopy = Values::MakeNull();
-                }
-                entryMap["value"] = valueCopy;
-                
-                // 创建entry值
-                Values* entry = Values::MakeMap(entryMap);
-                // entry 现在拥有 valueCopy 的所有权, MakeMap 应该处理其内部值的生命周期 (假设是这样)
-                // 如果 MakeMap 不复制传入的值，则需要调整 valueCopy 的生命周期管理
-                
-                // 更新栈顶的 "." 变量的值
-                SetTopVariable(1, entry); // SetTopVariable 会 delete 旧值
-                
-                // 执行循环体
-                std::cout << "  执行Range循环体:" << std::endl;
-                if (node->List()) {
-                    // 使用更新后的栈顶变量作为上下文
-                    walk(vars_.back().value, node->List());
-                } else {
-                    std::cout << "  Range节点没有循环体!" << std::endl;
-                }
-            }
-            
-            // 恢复变量状态，弹出循环开始前添加的"."变量
-            PopVariables(mark);
+    } catch (...) {
+        if (owned) {
+            delete data;
         }
+        throw;
     }
-    // 其他类型，使用else分支
-    else {
-        std::cout << "Range值既不是列表也不是映射，使用else分支" << std::endl;
-        if (node->ElseList()) {
-            walk(dot, node->ElseList());
-        }
+    if (owned) {
+        delete data;
     }
-    
-    delete items;
-    std::cout << "=== walkRange执行完成 ===\n" << std::endl;
 }
 
-void ExecContext::walkTemplate(Values* dot, const TemplateNode* node) {
-    // 获取模板名称
-    const std::string& name = node->Name();
-    
-    // 执行管道获取数据
-    Values* pipeVal = NULL;
-    if (node->Pipe()) {
-        pipeVal = evalPipeline(dot, node->Pipe());
-    } else {
-        pipeVal = new Values(*dot); // 复制dot
-    }
-    
-    // 这里应该根据模板名称从某个存储中加载模板
-    // 在这个简化版中，我们假设通过名称可以找到模板
-    IncludeTemplate(name, pipeVal);
+Values* ExecContext::EvalPipeline(const PipeNode* pipe, Values* dot) {
+    return evalPipeline(dot, pipe);
+}
+
+Values* ExecContext::EvalArg(const Node* arg, Values* dot) {
+    return evalArg(dot, arg);
 }
 
 Values* ExecContext::evalPipeline(Values* dot, const PipeNode* pipe) {
+    bool owned = true;
+    Values* value = evalPipelineRef(dot, pipe, owned, true);
+    // 调用者拥有返回值，借用的结果在这里复制一次
+    if (!owned) {
+        value = new Values(*value);
+    }
+    return value;
+}
+
+Values* ExecContext::evalPipelineRef(Values* dot, const PipeNode* pipe, bool& owned, bool allowVariables, bool declare) {
+    owned = true;
     if (!pipe) {
         return Values::MakeNull();
     }
@@ -867,114 +1015,167 @@ Values* ExecContext::evalPipeline(Values* dot, const PipeNode* pipe) {
     Values* value = NULL;
     
     // 执行管道中的所有命令
-    const std::vector<CommandNode*>& cmds = pipe->Cmds();
-    std::cout << "执行管道(命令数: " << cmds.size() << ")" << std::endl;
-    
-    // --- 移除错误的链式字段检查逻辑 --- 
-    // if (cmds.size() == 1) { ... }
-    // if (cmds.size() >= 1) { ... } // 这个检查和内部逻辑都基于错误假设
+    const CommandVector& cmds = pipe->Cmds();
+    const VariableVector& decls = pipe->Decl();
+    size_t declCount = declare ? decls.size() : 0;
+    TE_TRACE(TraceExec, TraceDebug, "执行管道(命令数: " << cmds.size() << ")");
     
-    // --- 正确的逻辑：直接评估第一个命令 --- 
+    // 第一个命令可以借用；有变量声明时赋值可能释放被借用的变量，不借用变量
     if (!cmds.empty()) {
-        value = evalCommand(dot, cmds[0], NULL); // 使用 evalCommand 处理第一个命令
+        value = evalCommandRef(dot, cmds[0], owned, allowVariables && declCount == 0);
     }
     
-    // 处理后续命令（如果有管道符 | ）
+    // 处理后续命令（如果有管道符 | ），以上一个结果作为输入
     for (size_t i = 1; i < cmds.size(); ++i) {
-        Values* cmdResult = evalCommand(dot, cmds[i], value); // 后续命令以上一个结果作为输入
-        delete value; // 释放上一个结果
+        Values* cmdResult = evalCommand(dot, cmds[i], value);
+        if (owned) {
+            delete value; // 释放上一个结果
+        }
         value = cmdResult;
+        owned = true;
+    }
+    
+    // 如果没有结果，返回空值
+    if (!value) {
+        value = Values::MakeNull();
+        owned = true;
     }
     
     // 处理变量声明
-    const std::vector<VariableNode*>& decls = pipe->Decl();
-    for (size_t i = 0; i < decls.size(); ++i) {
+    for (size_t i = 0; i < declCount; ++i) {
         if (pipe->IsAssign()) {
-            SetVariable(decls[i]->Ident(), new Values(*value));
+            SetVariable(std::string(decls[i]->Ident()), new Values(*value));
         } else {
-            PushVariable(decls[i]->Ident(), new Values(*value));
+            PushVariable(std::string(decls[i]->Ident()), new Values(*value));
         }
     }
     
     // 如果不需要保留变量，恢复变量状态
-    if (decls.empty()) {
+    if (declCount == 0) {
         PopVariables(mark);
     }
     
-    // 如果没有结果，返回空值
-    if (!value) {
-        value = Values::MakeNull();
-    }
-    
     return value;
 }
 
-Values* ExecContext::evalChainedField(Values* dot, const ChainNode* chainNode, Values* final) {
-    // 改进：确保链式字段的基础节点被正确处理
-    Node* baseNode = chainNode->GetNode();
-    
-    // 处理基础节点
-    if (baseNode->Type() == NodeField) {
-        // 基础节点是字段，获取字段标识符
-        std::string basePath = static_cast<const FieldNode*>(baseNode)->Ident();
-        if (!basePath.empty() && basePath[0] == '.') {
-            basePath = basePath.substr(1);  // 去掉开头的点
+Values* ExecContext::evalCommandRef(Values* dot, const CommandNode* cmd, bool& owned, bool allowVariables) {
+    if (!cmd->Args().empty()) {
+        Values* ref = lookupRef(dot, cmd->Args()[0], allowVariables);
+        if (ref) {
+            owned = false;
+            return ref;
         }
+    }
+    owned = true;
+    return evalCommand(dot, cmd, NULL);
+}
+
+Values* ExecContext::lookupRef(Values* dot, const Node* n, bool allowVariables) {
+    switch (n->Type()) {
+        case NodeDot:
+            return dot ? dot : sharedNull();
         
-        // 获取完整的字段路径
-        std::string fullPath = basePath;
-        
-        // 添加链式字段部分
-        const std::vector<std::string>& fields = chainNode->Fields();
-        for (size_t i = 0; i < fields.size(); ++i) {
-            fullPath += "." + fields[i];
+        case NodeField: {
+            // 与evalField一致：在"."中查找单级字段
+            const FieldSegment& segment = static_cast<const FieldNode*>(n)->Segment();
+            if (segment.name.empty()) {
+                return NULL; // 交给evalField报错
+            }
+            Values* value = lookupSegment(dot, segment, options_.fieldCache);
+            return value ? value : sharedNull();
         }
         
-        std::cout << "  构建链式字段路径: " << fullPath << std::endl;
+        case NodeChain: {
+            const ChainNode* chainNode = static_cast<const ChainNode*>(n);
+            const Node* baseNode = chainNode->GetNode();
+            Values* current;
+            if (baseNode->Type() == NodeField) {
+                // 与evalChainedField一致：从"."开始按段查找
+                current = lookupSegment(dot, static_cast<const FieldNode*>(baseNode)->Segment(), options_.fieldCache);
+            } else {
+                current = lookupRef(dot, baseNode, allowVariables);
+                if (!current) {
+                    return NULL;
+                }
+            }
+            current = lookupPath(current, chainNode->Fields(), options_.fieldCache);
+            return current ? current : sharedNull();
+        }
         
-        // 使用PathValue解析完整路径
-        Values* result = dot->PathValue(fullPath);
-        if (result) {
-            std::cout << "成功评估链式字段: " << fullPath << " = " << result->ToString() << std::endl;
-        } else {
-            std::cout << "链式字段访问失败: " << fullPath << std::endl;
-            result = Values::MakeNull();
+        case NodeVariable: {
+            if (!allowVariables) {
+                return NULL;
+            }
+            std::string_view name = static_cast<const VariableNode*>(n)->Ident();
+            for (int i = vars_.size() - 1; i >= (int)varBase_; --i) {
+                if (vars_[i].name == name) {
+                    return vars_[i].value;
+                }
+            }
+            return NULL; // 交给GetVariable报错
         }
         
-        return result;
+        default:
+            return NULL;
+    }
+}
+
+Values* ExecContext::evalArgRef(Values* dot, const Node* n, bool& owned) {
+    Values* ref = n ? lookupRef(dot, n, true) : NULL;
+    if (ref) {
+        owned = false;
+        return ref;
+    }
+    owned = true;
+    Values* value = evalArg(dot, n);
+    return value ? value : Values::MakeNull();
+}
+
+// 求值函数参数；管道左值final不复制，直接借给函数
+void ExecContext::evalArgs(Values* dot, const std::vector<const Node*>& args, Values* final, bool finalIsFirst,
+                           std::vector<Values*>& values, std::vector<bool>& owned) {
+    values.reserve(args.size() + 1);
+    owned.reserve(args.size() + 1);
+    if (finalIsFirst && final) {
+        values.push_back(final);
+        owned.push_back(false);
+    }
+    for (size_t i = 0; i < args.size(); ++i) {
+        bool argOwned = true;
+        values.push_back(evalArgRef(dot, args[i], argOwned));
+        owned.push_back(argOwned);
+    }
+}
+
+Values* ExecContext::evalChainedField(Values* dot, const ChainNode* chainNode, Values* final) {
+    // 改进：确保链式字段的基础节点被正确处理
+    Node* baseNode = chainNode->GetNode();
+    
+    // 处理基础节点
+    if (baseNode->Type() == NodeField) {
+        // 基础节点是字段：从"."开始按解析时拆好的各段逐级借用，只复制最终结果
+        const FieldSegment& base = static_cast<const FieldNode*>(baseNode)->Segment();
+        const Values* found = lookupPath(lookupSegment(dot, base, options_.fieldCache), chainNode->Fields(),
+                                         options_.fieldCache);
+        if (found) {
+            TE_TRACE(TraceExec, TraceDebug, "成功评估链式字段: ." << base.name << "... = " << found->ToString());
+            return new Values(*found);
+        }
+        TE_TRACE(TraceExec, TraceDebug, "链式字段访问失败: ." << base.name << "...");
+        return Values::MakeNull();
     } else {
         // 其他情况，先处理基础节点，后面再通过链式访问
-        Values* baseValue = evalArg(dot, baseNode);
-        if (!baseValue) {
-            return Values::MakeNull();
-        }
+        bool owned = true;
+        Values* baseValue = evalArgRef(dot, baseNode, owned);
         
-        // 通过链式字段逐级访问
-        Values* currentValue = baseValue;
-        const std::vector<std::string>& fields = chainNode->Fields();
+        // 通过链式字段逐级借用，只复制最终结果
+        const Values* currentValue = lookupPath(baseValue, chainNode->Fields(), options_.fieldCache);
         
-        for (size_t i = 0; i < fields.size() && currentValue; ++i) {
-            if (!currentValue->IsMap()) {
-                delete currentValue;
-                return Values::MakeNull();
-            }
-            
-            // 查找下一级字段
-            const std::map<std::string, Values*>& map = currentValue->AsMap();
-            std::map<std::string, Values*>::const_iterator it = map.find(fields[i]);
-            
-            if (it == map.end() || !it->second) {
-                delete currentValue;
-                return Values::MakeNull();
-            }
-            
-            // 更新当前值为下一级字段
-            Values* nextValue = new Values(*(it->second));
-            delete currentValue;
-            currentValue = nextValue;
+        Values* result = currentValue ? new Values(*currentValue) : Values::MakeNull();
+        if (owned) {
+            delete baseValue;
         }
-        
-        return currentValue;
+        return result;
     }
 }
 
@@ -987,52 +1188,48 @@ Values* ExecContext::evalCommand(
         Error(RuntimeError, "empty command");
     }
     const Node* firstArg = cmd->Args()[0];
-    std::cout << "evalCommand: 第一个参数类型: " << firstArg->Type() << std::endl;
+    TE_TRACE(TraceExec, TraceDebug, "evalCommand: 第一个参数类型: " << firstArg->Type());
     if (firstArg->Type() == NodeIdentifier) {
-        std::string funcName = static_cast<const IdentifierNode*>(firstArg)->Ident();
-        std::cout << "  函数调用: " << funcName << std::endl;
+        const IdentifierNode* ident = static_cast<const IdentifierNode*>(firstArg);
+        TE_TRACE(TraceExec, TraceDebug, "  函数调用: " << ident->Ident());
         std::vector<const Node*> funcArgs;
         for (size_t i = 1; i < cmd->Args().size(); ++i) {
             funcArgs.push_back(cmd->Args()[i]);
         }
         // 管道左值final作为第一个参数
-        return evalFunction(dot, funcName, cmd, funcArgs, final, true);
+        return evalFunction(dot, ident, funcArgs, final, true);
     }
     
-    // 准备空的参数列表 (evalField 可能需要，暂时保留)
-    std::vector<const Node*> emptyArgs;
-    
     // 处理不同类型的第一个参数
     switch (firstArg->Type()) {
         case NodeField: {
             // 处理字段访问
             const FieldNode* fieldNode = static_cast<const FieldNode*>(firstArg);
-            std::string fieldPath = fieldNode->Ident();
-            std::cout << "  字段访问 (NodeField): " << fieldPath << std::endl;
-            return evalField(dot, fieldPath, firstArg, emptyArgs, final, NULL);
+            TE_TRACE(TraceExec, TraceDebug, "  字段访问 (NodeField): " << fieldNode->Ident());
+            return evalField(dot, fieldNode, final, NULL);
         }
         
         case NodeChain: { // <--- 添加处理 ChainNode (假设类型 3)
             const ChainNode* chainNode = static_cast<const ChainNode*>(firstArg);
-            std::cout << "  链式字段访问 (NodeChain)" << std::endl;
+            TE_TRACE(TraceExec, TraceDebug, "  链式字段访问 (NodeChain)");
             // 使用 evalChainedField 处理
             return evalChainedField(dot, chainNode, final); 
         }
         
         case NodeDot:
             // 如果命令仅是'.'，返回当前管道值(final)或dot
-            std::cout << "  点访问 (.)" << std::endl;
+            TE_TRACE(TraceExec, TraceDebug, "  点访问 (.)");
             return final ? new Values(*final) : new Values(*dot);
         
         case NodePipe: {
             // 新增：支持PipeNode参数，递归求值
             const PipeNode* pipeNode = static_cast<const PipeNode*>(firstArg);
-            std::cout << "  递归求值PipeNode参数 (括号表达式)" << std::endl;
+            TE_TRACE(TraceExec, TraceDebug, "  递归求值PipeNode参数 (括号表达式)");
             return evalPipeline(dot, pipeNode);
         }
         
         default: // 处理其他简单参数类型 (Bool, Number, String etc.)
-             std::cout << "  评估简单参数 (Type: " << firstArg->Type() << ")" << std::endl;
+             TE_TRACE(TraceExec, TraceDebug, "  评估简单参数 (Type: " << firstArg->Type() << ")");
             return evalArg(dot, firstArg);
     }
 }
@@ -1064,114 +1261,82 @@ bool ExecContext::areEqual(const Values* a, const Values* b) {
 
 Values* ExecContext::evalFunction(
     Values* dot, 
-    const std::string& name, 
-    const CommandNode* cmd, 
+    const IdentifierNode* ident, 
     const std::vector<const Node*>& args, 
     Values* final,
     bool finalIsFirst) {
     
-    if (!funcs_.HasFunction(name)) {
-        Error(RuntimeError, "function not found: %s", name.c_str());
+    // 绑定到本函数库的节点直接取函数，否则按名称查找
+    std::string_view name = ident->Ident();
+    TemplateFn* func = ident->BoundLibrary() == &funcs_ ? ident->BoundFunction() : funcs_.FindFunction(name);
+    if (!func) {
+        Error(RuntimeError, "function not found: %s", std::string(name).c_str());
     }
-    if (name == "and" || name == "or" || name == "not") {
-        std::vector<Values*> funcArgs;
-        if (finalIsFirst && final) {
-            funcArgs.push_back(new Values(*final));
-        }
-        for (size_t i = 0; i < args.size(); ++i) {
-            Values* argValue = evalArg(dot, args[i]);
-            std::cout << "  函数参数 " << (finalIsFirst ? i+2 : i+1) << " 类型: " << (argValue ? argValue->TypeName() : "null");
-            if (argValue) {
-                if (argValue->IsBool()) {
-                    std::cout << ", 值: " << (argValue->AsBool() ? "true" : "false");
-                } else if (argValue->IsString()) {
-                    std::cout << ", 值: \"" << argValue->AsString() << "\"";
-                } else if (argValue->IsNumber()) {
-                    std::cout << ", 值: " << argValue->AsNumber();
-                }
-            }
-            std::cout << std::endl;
-            funcArgs.push_back(argValue ? argValue : Values::MakeNull());
-        }
-        TemplateFn* func = funcs_.GetFunction(name);
-        Values* result = func->operator()(funcArgs);
-        for (size_t i = 0; i < funcArgs.size(); ++i) {
-            delete funcArgs[i];
+    if (name == "eq" && args.size() < 2 && !(finalIsFirst && final)) {
+        Error(RuntimeError, "eq function requires at least two arguments");
+    }
+    
+    // 参数尽量借用输入数据，只释放求值时新建的值
+    std::vector<Values*> funcArgs;
+    std::vector<bool> owned;
+    evalArgs(dot, args, final, finalIsFirst, funcArgs, owned);
+    for (size_t i = 0; TE_TRACE_ENABLED(TraceExec, TraceVerbose) && i < funcArgs.size(); ++i) {
+        std::ostream& os = TraceStream(TraceExec);
+        os << "  函数参数 " << i + 1 << " 类型: " << funcArgs[i]->TypeName();
+        if (funcArgs[i]->IsBool()) {
+            os << ", 值: " << (funcArgs[i]->AsBool() ? "true" : "false");
+        } else if (funcArgs[i]->IsString()) {
+            os << ", 值: \"" << funcArgs[i]->AsString() << "\"";
+        } else if (funcArgs[i]->IsNumber()) {
+            os << ", 值: " << funcArgs[i]->AsNumber();
         }
-        return result;
+        os << std::endl;
     }
+    
+    Values* result = NULL;
     if (name == "eq") {
-        if (args.size() < 2 && !(finalIsFirst && final)) {
-            Error(RuntimeError, "eq function requires at least two arguments");
-        }
-        std::vector<Values*> evaluatedArgs;
-        if (finalIsFirst && final) {
-            evaluatedArgs.push_back(new Values(*final));
-        }
-        for (size_t i = 0; i < args.size(); ++i) {
-            Values* argValue = evalArg(dot, args[i]);
-            if (argValue) {
-                evaluatedArgs.push_back(argValue);
-            } else {
-                evaluatedArgs.push_back(Values::MakeNull());
-            }
-        }
         bool equal = true;
-        for (size_t i = 1; i < evaluatedArgs.size(); ++i) {
-            if (!areEqual(evaluatedArgs[0], evaluatedArgs[i])) {
+        for (size_t i = 1; i < funcArgs.size(); ++i) {
+            if (!areEqual(funcArgs[0], funcArgs[i])) {
                 equal = false;
                 break;
             }
         }
-        for (size_t i = 0; i < evaluatedArgs.size(); ++i) {
-            delete evaluatedArgs[i];
-        }
-        return Values::MakeBool(equal);
-    }
-    std::vector<Values*> funcArgs;
-    if (finalIsFirst && final) {
-        funcArgs.push_back(new Values(*final));
-    }
-    for (size_t i = 0; i < args.size(); ++i) {
-        Values* argValue = evalArg(dot, args[i]);
-        if (argValue) {
-            std::cout << "  函数参数 " << (finalIsFirst ? i+2 : i+1) << " 类型: " << argValue->TypeName();
-            if (argValue->IsBool()) {
-                std::cout << ", 值: " << (argValue->AsBool() ? "true" : "false");
-            } else if (argValue->IsString()) {
-                std::cout << ", 值: \"" << argValue->AsString() << "\"";
-            } else if (argValue->IsNumber()) {
-                std::cout << ", 值: " << argValue->AsNumber();
+        result = Values::MakeBool(equal);
+    } else {
+        try {
+            if (memo_ && !func->Pure()) {
+                memo_->impureCalls++;
             }
-            std::cout << std::endl;
-        } else {
-            std::cout << "  函数参数 " << (finalIsFirst ? i+2 : i+1) << " 为null" << std::endl;
+            result = (*func)(*this, funcArgs);
+        } catch (...) {
+            for (size_t i = 0; i < funcArgs.size(); ++i) {
+                if (owned[i]) {
+                    delete funcArgs[i];
+                }
+            }
+            throw;
         }
-        funcArgs.push_back(argValue ? argValue : Values::MakeNull());
     }
-    TemplateFn* func = funcs_.GetFunction(name);
-    Values* result = func->operator()(funcArgs);
     for (size_t i = 0; i < funcArgs.size(); ++i) {
-        delete funcArgs[i];
+        if (owned[i]) {
+            delete funcArgs[i];
+        }
     }
     return result;
 }
 
 Values* ExecContext::evalField(
     Values* dot,
-    const std::string& fieldNameInput, // 这个参数现在只包含单级字段名
-    const Node* node, // 这个参数现在可能没用了
-    const std::vector<const Node*>& args, // 这个参数现在可能没用了
+    const FieldNode* field, // 单级字段
     Values* final, 
     Values* receiver) {
 
-    std::cout << "evalField: 处理单级字段 " << fieldNameInput << std::endl;
+    TE_TRACE(TraceExec, TraceDebug, "evalField: 处理单级字段 " << field->Ident());
     
-    // 去除前导点
-    std::string fieldName = fieldNameInput;
-    if (!fieldName.empty() && fieldName[0] == '.') {
-        fieldName = fieldName.substr(1);
-    }
+    // 字段名在解析时已去掉前导点
+    const FieldSegment& segment = field->Segment();
+    std::string_view fieldName = segment.name;
     
     if (fieldName.empty()) {
         Error(RuntimeError, "empty field name");
@@ -1182,65 +1347,65 @@ Values* ExecContext::evalField(
     Values* context = receiver ? receiver : (final ? final : dot);
     
     if (!context) {
-        std::cout << "  上下文为空" << std::endl;
+        TE_TRACE(TraceExec, TraceDebug, "  上下文为空");
         return Values::MakeNull();
     }
     
-    std::cout << "  在上下文类型 " << context->TypeName() << " 中查找字段: " << fieldName << std::endl;
+    TE_TRACE(TraceExec, TraceDebug, "  在上下文类型 " << context->TypeName() << " 中查找字段: " << fieldName);
     
     // 单级字段访问
     if (!context->IsMap()) {
-        std::cout << "  上下文不是map，无法访问字段" << std::endl;
+        TE_TRACE(TraceExec, TraceDebug, "  上下文不是map，无法访问字段");
         return Values::MakeNull();
     }
     
-    const std::map<std::string, Values*>& map = context->AsMap();
-    std::map<std::string, Values*>::const_iterator it = map.find(fieldName);
+    const Values* found = lookupSegment(context, segment, options_.fieldCache);
     
-    if (it == map.end() || !it->second) {
-        std::cout << "  字段 '" << fieldName << "' 未找到" << std::endl;
+    if (!found) {
+        TE_TRACE(TraceExec, TraceDebug, "  字段 '" << fieldName << "' 未找到");
         return Values::MakeNull();
     }
     
-    std::cout << "  找到字段 '" << fieldName << "', 类型: " << it->second->TypeName();
-    if (it->second->IsString()) {
-        std::cout << ", 值: \"" << it->second->AsString() << "\"";
-    }
-    std::cout << std::endl;
+    TE_TRACE(TraceExec, TraceDebug, "  找到字段 '" << fieldName << "', 类型: " << found->TypeName()
+             << (found->IsString() ? ", 值: \"" + std::string(found->AsString()) + "\"" : std::string()));
     
     // 返回找到字段的副本
-    return new Values(*(it->second));
+    return new Values(*found);
 }
 
 void ExecContext::debugPrintValue(const char* prefix, Values* value) {
+    if (!TE_TRACE_ENABLED(TraceExec, TraceVerbose)) {
+        return;
+    }
     if (!value) {
-        std::cout << prefix << "值为NULL" << std::endl;
+        TE_TRACE(TraceExec, TraceVerbose, prefix << "值为NULL");
         return;
     }
     
-    std::cout << prefix << "类型: " << value->TypeName();
+    std::ostream& os = TraceStream(TraceExec);
+    os << prefix << "类型: " << value->TypeName();
     
     if (value->IsString()) {
-        std::cout << ", 字符串值: \"" << value->AsString() << "\"";
+        os << ", 字符串值: \"" << value->AsString() << "\"";
     } else if (value->IsNumber()) {
-        std::cout << ", 数值: " << value->AsNumber();
+        os << ", 数值: " << value->AsNumber();
     } else if (value->IsBool()) {
-        std::cout << ", 布尔值: " << (value->AsBool() ? "true" : "false");
+        os << ", 布尔值: " << (value->AsBool() ? "true" : "false");
     } else if (value->IsMap()) {
-        const std::map<std::string, Values*>& map = value->AsMap();
-        std::cout << ", Map大小: " << map.size() << ", 键: {";
+        const ValuesMap& map = value->AsMap();
+        os << ", Map大小: " << map.size() << ", 键: {";
         bool first = true;
-        for (std::map<std::string, Values*>::const_iterator it = map.begin(); it != map.end(); ++it) {
-            if (!first) std::cout << ", ";
+        for (ValuesMap::const_iterator it = map.begin(); it != map.end(); ++it) {
+            if (!first) os << ", ";
             first = false;
-            std::cout << it->first;
+            os << it->first;
         }
-        std::cout << "}";
+        os << "}";
     } else if (value->IsList()) {
-        std::cout << ", List大小: " << value->AsList().size();
+        os << ", List大小: " << value->AsList().size();
     }
     
-    std::cout << std::endl;
+    os << std::endl;
 }
 
 Values* ExecContext::evalCall(
@@ -1265,7 +1430,10 @@ Values* ExecContext::evalCall(
     // 调用函数
     Values* result = NULL;
     try {
-        result = func->operator()(funcArgs);
+        if (memo_ && !func->Pure()) {
+            memo_->impureCalls++;
+        }
+        result = (*func)(*this, funcArgs);
     } catch (const std::exception& e) {
         // 清理参数
         for (size_t i = 0; i < funcArgs.size(); ++i) {
@@ -1295,12 +1463,10 @@ Values* ExecContext::evalArg(Values* dot, const Node* n) {
             return Values::MakeNumber(atof(static_cast<const NumberNode*>(n)->String().c_str()));
             
         case NodeString:
-            return Values::MakeString(static_cast<const StringNode*>(n)->Text());
+            return Values::MakeString(std::string(static_cast<const StringNode*>(n)->Text()));
             
         case NodeField: {
-            const FieldNode* fieldNode = static_cast<const FieldNode*>(n);
-            std::string fieldName = fieldNode->Ident();
-            return evalField(dot, fieldName, n, std::vector<const Node*>(), NULL, NULL);
+            return evalField(dot, static_cast<const FieldNode*>(n), NULL, NULL);
         }
             
         case NodeChain: {
@@ -1310,10 +1476,10 @@ Values* ExecContext::evalArg(Values* dot, const Node* n) {
         }
             
         case NodeIdentifier:
-            return Values::MakeString(static_cast<const IdentifierNode*>(n)->Ident());
+            return Values::MakeString(std::string(static_cast<const IdentifierNode*>(n)->Ident()));
             
         case NodeVariable: {
-            std::string name = static_cast<const VariableNode*>(n)->Ident();
+            std::string name(static_cast<const VariableNode*>(n)->Ident());
             return GetVariable(name);
         }
         
@@ -1324,7 +1490,7 @@ Values* ExecContext::evalArg(Values* dot, const Node* n) {
         }
             
         default:
-            std::cout << "  未处理的节点类型: " << n->Type() << std::endl;
+            TE_TRACE(TraceExec, TraceDebug, "  未处理的节点类型: " << n->Type());
             return Values::MakeNull();
     }
 }
@@ -1334,151 +1500,156 @@ Values* ExecContext::FindField(Values* value, const std::string& name) {
         return NULL;
     }
     
-    // 处理链式访问 (如 "Name.first")
-    std::string fieldName = name;
-    if (!fieldName.empty() && fieldName[0] == '.') {
-        fieldName = fieldName.substr(1);
-    }
-    
-    size_t dotPos = fieldName.find('.');
-    if (dotPos != std::string::npos) {
-        std::string firstPart = fieldName.substr(0, dotPos);
-        std::string remainingPart = fieldName.substr(dotPos + 1);
-        
-        const std::map<std::string, Values*>& map = value->AsMap();
-        std::map<std::string, Values*>::const_iterator it = map.find(firstPart);
-        if (it != map.end() && it->second != NULL) {
-            // 递归查找剩余路径
-            return FindField(it->second, remainingPart);
+    // 处理链式访问 (如 "Name.first")：逐段借用，只复制最终结果
+    std::string_view path(name);
+    for (;;) {
+        if (!path.empty() && path[0] == '.') {
+            path.remove_prefix(1);
         }
-        return NULL;
-    }
-    
-    // 处理单一字段
-    const std::map<std::string, Values*>& map = value->AsMap();
-    std::map<std::string, Values*>::const_iterator it = map.find(fieldName);
-    if (it != map.end() && it->second) {
-        return new Values(*it->second);
+        size_t dotPos = path.find('.');
+        const ValuesMap& map = value->AsMap();
+        ValuesMap::const_iterator it = map.find(path.substr(0, dotPos));
+        if (it == map.end() || !it->second) {
+            return NULL;
+        }
+        if (dotPos == std::string_view::npos) {
+            return new Values(*it->second);
+        }
+        value = it->second;
+        if (!value->IsMap()) {
+            return NULL;
+        }
+        path.remove_prefix(dotPos + 1);
     }
-    
-    return NULL;
 }
 
-void ExecContext::IncludeTemplate(const std::string& name, Values* data) {
-    // 在真实场景中，这将从模板存储中加载模板
-    // 在这个简化版中，我们假设模板已在缓存中
-    std::map<std::string, Tree*>::iterator it = templateCache_.find(name);
-    if (it == templateCache_.end()) {
-        delete data;
+// 先在共享的命名空间（如chart的所有模板）中查找，再查找当前模板文件自身的define块
+const NamedTemplate* ExecContext::findTemplate(const std::string& name) {
+    const NamedTemplate* named = NULL;
+    if (options_.templates) {
+        named = options_.templates->Find(name);
+    }
+    if (!named && compiled_) {
+        named = compiled_->FindTemplate(name);
+    }
+    if (!named) {
         Error(RuntimeError, "template not found: %s", name.c_str());
     }
-    
-    // 增加执行深度
+    return named;
+}
+
+// 在当前上下文中执行已编译的具名模板：变量栈上压入新的"$"作为调用帧，
+// 被调用的模板只能看到这一帧内的变量；执行完（或出错时）恢复调用者的状态。
+// 深度随调用链累加，递归调用同一模板时在maxExecDepth处停止
+void ExecContext::execTemplate(const NamedTemplate* named, Values* data, bool dataStable, std::ostream& writer) {
+    if (!named->tree->GetRoot()) {
+        Error(RuntimeError, "incomplete or empty template");
+    }
     IncrementDepth();
     
-    // 创建新上下文并执行模板
-    ExecContext newCtx(it->second, writer_, data, funcs_, options_);
-    newCtx.Execute();
+    const Tree* savedTmpl = tmpl_;
+    const Node* savedNode = currentNode_;
+    std::ostream* savedWriter = writer_;
+    size_t savedBase = varBase_;
+    bool savedStable = dataStable_;
+    int mark = MarkVariables();
+    
+    PushVariable("$", data, false);
+    varBase_ = mark;
+    tmpl_ = named->tree;
+    writer_ = &writer;
+    dataStable_ = dataStable;
+    try {
+        run(*named->program, data);
+    } catch (...) {
+        PopVariables(mark);
+        tmpl_ = savedTmpl;
+        currentNode_ = savedNode;
+        writer_ = savedWriter;
+        varBase_ = savedBase;
+        dataStable_ = savedStable;
+        DecrementDepth();
+        throw;
+    }
+    PopVariables(mark);
+    tmpl_ = savedTmpl;
+    currentNode_ = savedNode;
+    writer_ = savedWriter;
+    varBase_ = savedBase;
+    dataStable_ = savedStable;
     
-    // 减少执行深度
     DecrementDepth();
 }
 
-std::string ExecuteTemplate(
+void ExecContext::IncludeTemplate(const std::string& name, Values* data) {
+    if (!data) {
+        data = Values::MakeNull();
+    }
+    const NamedTemplate* named = NULL;
+    try {
+        named = findTemplate(name);
+        execTemplate(named, data, false, *writer_);
+    } catch (...) {
+        delete data;
+        throw;
+    }
+    delete data;
+}
+
+void ExecuteTemplate(
     const std::string& templateName,
     const std::string& templateContent,
-    Values* data,
+    const Values* data,
+    OutputSink& sink,
     const std::string& leftDelim,
     const std::string& rightDelim,
     const ExecOptions& options) {
     
-    // 解析模板
-    std::map<std::string, Tree*> templateMap;
-    Tree* mainTemplate = NULL;
-    std::string result;
-    
     try {
-        // 解析模板
-        templateMap = Tree::Parse(templateName, templateContent, leftDelim, rightDelim);
-        
-        if (templateMap.empty()) {
-            throw ExecError(RuntimeError, templateName, "failed to parse template");
-        }
-        
-        std::map<std::string, Tree*>::iterator it = templateMap.find(templateName);
-        if (it == templateMap.end() || !it->second) {
-            // 清理未使用的模板
-            for (std::map<std::string, Tree*>::iterator cleanup = templateMap.begin(); 
-                 cleanup != templateMap.end(); ++cleanup) {
-                delete cleanup->second;
-            }
-            throw ExecError(RuntimeError, templateName, "template not found after parsing");
-        }
-        
-        // 设置函数库 - 不再需要在这里初始化，会在ExecContext创建时设置
-        FunctionLib funcs;
-        
-        // 准备输出流
-        std::stringstream output;
-        
-        // 保存主模板
-        mainTemplate = it->second;
-        it->second = NULL; // 防止被下面的循环删除
-        
-        // 从templateMap中移除主模板，以防止被下面的循环删除
-        templateMap.erase(it);
-        
-        // 清理未使用的模板
-        for (std::map<std::string, Tree*>::iterator cleanup = templateMap.begin(); 
-             cleanup != templateMap.end(); ++cleanup) {
-            delete cleanup->second;
-        }
-        templateMap.clear();
-        
-        // 创建执行上下文并执行模板
-        {
-            ExecContext ctx(mainTemplate, output, data, funcs, options);
-            ctx.Execute();
-            
-            // 获取模板输出
-            result = output.str();
-            // 去除所有空行
-            result = RemoveAllEmptyLines(result);
-        } // ctx在这里被销毁
-        
-        // 不需要删除mainTemplate，因为它由ExecContext接管
-        
-        return result;
+        // 从缓存取得编译好的模板，内容相同时不再重复解析
+        CompiledTemplatePtr compiled = TemplateCache::Instance().Get(
+            templateName, templateContent, leftDelim, rightDelim);
+        ExecuteTemplate(*compiled, data, sink, options);
     } catch (const ExecError& e) {
-        // 确保在发生异常时也释放资源
-        std::cerr << "模板执行出错: " << e.what() << std::endl;
-        
-        // 清理模板Map中的所有Tree对象
-        for (std::map<std::string, Tree*>::iterator cleanup = templateMap.begin(); 
-             cleanup != templateMap.end(); ++cleanup) {
-            delete cleanup->second;
-        }
-        
-        // 如果mainTemplate还没被释放，则释放它
-        delete mainTemplate;
-        
+        TE_TRACE(TraceExec, TraceError, "模板执行出错: " << e.what());
         throw; // 重新抛出异常
     } catch (const std::exception& e) {
-        std::cerr << "执行过程中发生未处理的异常: " << e.what() << std::endl;
-        
-        // 清理模板Map中的所有Tree对象
-        for (std::map<std::string, Tree*>::iterator cleanup = templateMap.begin(); 
-             cleanup != templateMap.end(); ++cleanup) {
-            delete cleanup->second;
-        }
-        
-        // 如果mainTemplate还没被释放，则释放它
-        delete mainTemplate;
-        
+        TE_TRACE(TraceExec, TraceError, "执行过程中发生未处理的异常: " << e.what());
         throw; // 重新抛出异常
     }
 }
 
+void ExecuteTemplate(
+    const CompiledTemplate& compiled,
+    const Values* data,
+    OutputSink& sink,
+    const ExecOptions& options) {
+    
+    // 输出流边写边去除空行，攒满一块就交给sink
+    SinkStream output(sink);
+    
+    // 创建执行上下文并执行模板；模板由compiled持有，ctx只借用
+    {
+        // 函数库是共享的只读内置库，编译时已把模板中的函数名绑定到它
+        ExecContext ctx(compiled, output, data, FunctionLib::Builtins(), options);
+        ctx.Execute();
+    }
+    output.Finish();
+}
+
+std::string ExecuteTemplate(
+    const std::string& templateName,
+    const std::string& templateContent,
+    const Values* data,
+    const std::string& leftDelim,
+    const std::string& rightDelim,
+    const ExecOptions& options) {
+    std::string result;
+    StringSink sink(result);
+    ExecuteTemplate(templateName, templateContent, data, sink, leftDelim, rightDelim, options);
+    return result;
+}
+
 Values* ExecContext::getFieldValue(Values* context, const std::string& field) {
     if (!context || !context->IsMap()) {
         return Values::MakeNull();
@@ -1491,8 +1662,8 @@ Values* ExecContext::getFieldValue(Values* context, const std::string& field) {
     }
 
     // 直接访问字段
-    const std::map<std::string, Values*>& contextMap = context->AsMap();
-    std::map<std::string, Values*>::const_iterator it = contextMap.find(fieldName);
+    const ValuesMap& contextMap = context->AsMap();
+    ValuesMap::const_iterator it = contextMap.find(fieldName);
     if (it != contextMap.end() && it->second) {
         return new Values(*it->second);
     }
@@ -1505,18 +1676,18 @@ void ExecContext::PrintValue(const Node* node, Values* value) {
         debugPrintValue("打印值: ", value);
         
         if (!value) {
-            writer_ << "<nil>";
+            *writer_ << "<nil>";
             return;
         }
         
         if (value->IsNull()) {
             // 不输出任何内容
         } else if (value->IsString()) {
-            writer_ << value->AsString();
+            *writer_ << value->AsString();
         } else if (value->IsNumber()) {
-            writer_ << value->AsNumber();
+            *writer_ << value->AsNumber();
         } else if (value->IsBool()) {
-            writer_ << (value->AsBool() ? "true" : "false");
+            *writer_ << (value->AsBool() ? "true" : "false");
         } else if (value->IsMap()) {
             // 如果这是一个动作节点，可能需要特殊处理
             if (node && node->Type() == NodeAction) {
@@ -1524,9 +1695,9 @@ void ExecContext::PrintValue(const Node* node, Values* value) {
                 const PipeNode* pipe = action->Pipe();
                 
                 // 输出第一个有意义的值，而不是整个map
-                const std::map<std::string, Values*>& map = value->AsMap();
+                const ValuesMap& map = value->AsMap();
                 if (!map.empty()) {
-                    std::map<std::string, Values*>::const_iterator it = map.begin();
+                    ValuesMap::const_iterator it = map.begin();
                     if (it->second) {
                         PrintValue(node, it->second);
                         return;
@@ -1535,14 +1706,14 @@ void ExecContext::PrintValue(const Node* node, Values* value) {
             }
             
             // 如果没有特殊处理，使用普通的toString输出
-            writer_ << value->ToString();
+            *writer_ << value->ToString();
         } else if (value->IsList()) {
-            writer_ << value->ToString();
+            *writer_ << value->ToString();
         } else {
-            writer_ << value->ToString();
+            *writer_ << value->ToString();
         }
     } catch (const std::exception& e) {
-        std::cerr << "打印值时发生异常: " << e.what() << std::endl;
+        TE_TRACE(TraceExec, TraceError, "打印值时发生异常: " << e.what());
         Error(WriteError, "error printing value: %s", e.what());
     }
 }
@@ -1579,104 +1750,44 @@ bool ExecContext::isTrue(Values* val) {
     return false;
 }
 
-void ExecContext::walkIfOrWith(NodeType type, Values* dot, const BranchNode* node) {
-    // 评估条件
-    Values* pipeValue = evalPipeline(dot, node->GetPipe());
-    
-    // 检查条件是否为真
-    bool cond = isTrue(pipeValue);
-    std::cout << "Checking if value is true: ";
-    if (pipeValue->IsNull()) {
-        std::cout << "null value -> false" << std::endl;
-    } else if (pipeValue->IsBool()) {
-        std::cout << "bool value " << (pipeValue->AsBool() ? "true" : "false") << " -> " 
-                 << (pipeValue->AsBool() ? "true" : "false") << std::endl;
-    } else if (pipeValue->IsNumber()) {
-        bool nonZero = fabs(pipeValue->AsNumber()) > 1e-10;
-        std::cout << "number value " << pipeValue->AsNumber() << " -> " 
-                 << (nonZero ? "true" : "false") << std::endl;
-    } else if (pipeValue->IsString()) {
-        bool nonEmpty = !pipeValue->AsString().empty();
-        std::cout << "string value \"" << pipeValue->AsString() << "\" -> " 
-                 << (nonEmpty ? "true" : "false") << std::endl;
-    } else {
-        std::cout << "other type -> " << (cond ? "true" : "false") << std::endl;
-    }
-    
-    // 根据条件执行相应分支
-    if (cond) {
-        if (type == NodeWith) {
-            // With节点处理：创建新的变量上下文
-            std::cout << "执行with节点，创建新的上下文环境" << std::endl;
-            int mark = MarkVariables();
-            
-            // 创建pipeValue副本作为新的"."变量
-            Values* newContext = new Values(*pipeValue);
-            PushVariable(".", newContext);
-            
-            // 使用新上下文执行列表
-            const ListNode* list = node->List();
-            if (list) {
-                walk(vars_.back().value, list);
-            } else {
-                std::cout << "with节点没有主体内容" << std::endl;
-            }
-            
-            // 恢复变量状态
-            PopVariables(mark);
-            std::cout << "with节点执行完成，恢复原上下文" << std::endl;
-        } else {
-            // If节点处理：使用原始上下文
-        const ListNode* list = node->List();
-        walk(dot, list);
-        }
-    } else if (node->ElseList() != NULL) {
-        // 条件为假且有else，执行else列表（使用原始上下文）
-        const ListNode* elseList = node->ElseList();
-        walk(dot, elseList);
-    }
-    
-    delete pipeValue;
-}
-
 // 新增：递归打印 AST 节点的辅助函数
-void ExecContext::printNodeTree(const Node* node, int indent) {
+void ExecContext::printNodeTree(std::ostream& os, const Node* node, int indent) {
     if (!node) {
-        std::cout << std::string(indent * 2, ' ') << "[NULL Node]" << std::endl;
+        os << std::string(indent * 2, ' ') << "[NULL Node]" << std::endl;
         return;
     }
 
     // 打印当前节点信息
-    std::cout << std::string(indent * 2, ' ') << "Node Type: " << node->Type()
+    os << std::string(indent * 2, ' ') << "Node Type: " << node->Type()
               << " (Pos: " << node->Position() << ")";
 
     // 打印特定类型节点的额外信息（可选，增强可读性）
     if (node->Type() == NodeText) {
-         std::cout << " Text: \"" << static_cast<const TextNode*>(node)->Text() << "\"";
+         os << " Text: \"" << static_cast<const TextNode*>(node)->Text() << "\"";
     } else if (node->Type() == NodeField) {
-         std::cout << " Field: " << static_cast<const FieldNode*>(node)->Ident();
+         os << " Field: " << static_cast<const FieldNode*>(node)->Ident();
     } else if (node->Type() == NodeIdentifier) {
-         std::cout << " Ident: " << static_cast<const IdentifierNode*>(node)->Ident();
+         os << " Ident: " << static_cast<const IdentifierNode*>(node)->Ident();
     } else if (node->Type() == NodeVariable) {
-         std::cout << " Var: " << static_cast<const VariableNode*>(node)->String(); // String() includes '$'
+         os << " Var: " << static_cast<const VariableNode*>(node)->String(); // String() includes '$'
     } else if (node->Type() == NodeString) {
-        std::cout << " Str: \"" << static_cast<const StringNode*>(node)->Text() << "\"";
+        os << " Str: \"" << static_cast<const StringNode*>(node)->Text() << "\"";
     } else if (node->Type() == NodeNumber) {
-         std::cout << " Num: " << static_cast<const NumberNode*>(node)->String();
+         os << " Num: " << static_cast<const NumberNode*>(node)->String();
     } else if (node->Type() == NodeBool) {
-         std::cout << " Bool: " << (static_cast<const BoolNode*>(node)->Value() ? "true" : "false");
+         os << " Bool: " << (static_cast<const BoolNode*>(node)->Value() ? "true" : "false");
     }
-    std::cout << std::endl;
+    os << std::endl;
 
 
     // 递归打印子节点
     switch (node->Type()) {
         case NodeList: {
             const ListNode* listNode = static_cast<const ListNode*>(node);
-            const std::vector<Node*>& children = listNode->Nodes();
+            const NodeVector& children = listNode->Nodes();
             // std::cout << std::string((indent + 1) * 2, ' ') << "List Children (" << children.size() << ")" << std::endl;
             for (const Node* child : children) {
-                printNodeTree(child, indent + 1);
+                printNodeTree(os, child, indent + 1);
             }
             break;
         }
@@ -1685,24 +1796,24 @@ void ExecContext::printNodeTree(const Node* node, int indent) {
         case NodeWith: {
             const BranchNode* branchNode = static_cast<const BranchNode*>(node);
             if (branchNode->GetPipe()) {
-                 std::cout << std::string((indent + 1) * 2, ' ') << "Condition Pipe:" << std::endl;
-                printNodeTree(branchNode->GetPipe(), indent + 1);
+                 os << std::string((indent + 1) * 2, ' ') << "Condition Pipe:" << std::endl;
+                printNodeTree(os, branchNode->GetPipe(), indent + 1);
             }
             if (branchNode->List()) {
-                 std::cout << std::string((indent + 1) * 2, ' ') << "Main List:" << std::endl;
-                printNodeTree(branchNode->List(), indent + 1);
+                 os << std::string((indent + 1) * 2, ' ') << "Main List:" << std::endl;
+                printNodeTree(os, branchNode->List(), indent + 1);
             }
             if (branchNode->ElseList()) {
-                 std::cout << std::string((indent + 1) * 2, ' ') << "Else List:" << std::endl;
-                printNodeTree(branchNode->ElseList(), indent + 1);
+                 os << std::string((indent + 1) * 2, ' ') << "Else List:" << std::endl;
+                printNodeTree(os, branchNode->ElseList(), indent + 1);
             }
             break;
         }
          case NodeAction: {
              const ActionNode* actionNode = static_cast<const ActionNode*>(node);
              if (actionNode->Pipe()) {
-                 std::cout << std::string((indent + 1) * 2, ' ') << "Action Pipe:" << std::endl;
-                printNodeTree(actionNode->Pipe(), indent + 1);
+                 os << std::string((indent + 1) * 2, ' ') << "Action Pipe:" << std::endl;
+                printNodeTree(os, actionNode->Pipe(), indent + 1);
              }
              break;
          }
@@ -1711,14 +1822,14 @@ void ExecContext::printNodeTree(const Node* node, int indent) {
              const auto& cmds = pipeNode->Cmds();
              const auto& decls = pipeNode->Decl();
              if (!decls.empty()) {
-                 std::cout << std::string((indent + 1) * 2, ' ') << "Pipe Declarations (" << decls.size() << ")" << (pipeNode->IsAssign() ? " (Assign =):" : " (Declare :=):") << std::endl;
+                 os << std::string((indent + 1) * 2, ' ') << "Pipe Declarations (" << decls.size() << ")" << (pipeNode->IsAssign() ? " (Assign =):" : " (Declare :=):") << std::endl;
                  for (const VariableNode* decl : decls) {
-                     printNodeTree(decl, indent + 1);
+                     printNodeTree(os, decl, indent + 1);
                  }
              }
              // std::cout << std::string((indent + 1) * 2, ' ') << "Pipe Commands (" << cmds.size() << ")" << std::endl;
              for (const CommandNode* cmd : cmds) {
-                printNodeTree(cmd, indent + 1);
+                printNodeTree(os, cmd, indent + 1);
              }
              break;
          }
@@ -1727,20 +1838,20 @@ void ExecContext::printNodeTree(const Node* node, int indent) {
              const auto& args = cmdNode->Args();
               // std::cout << std::string((indent + 1) * 2, ' ') << "Command Arguments (" << args.size() << ")" << std::endl;
              for (const Node* arg : args) {
-                printNodeTree(arg, indent + 1);
+                printNodeTree(os, arg, indent + 1);
              }
              break;
          }
          case NodeChain: {
             const ChainNode* chainNode = static_cast<const ChainNode*>(node);
-             std::cout << std::string((indent + 1) * 2, ' ') << "Chain Base:" << std::endl;
-            printNodeTree(chainNode->GetNode(), indent + 1);
-             std::cout << std::string((indent + 1) * 2, ' ') << "Chain Fields: ";
+             os << std::string((indent + 1) * 2, ' ') << "Chain Base:" << std::endl;
+            printNodeTree(os, chainNode->GetNode(), indent + 1);
+             os << std::string((indent + 1) * 2, ' ') << "Chain Fields: ";
              const auto& fields = chainNode->Fields();
              for(size_t i=0; i< fields.size(); ++i) {
-                 std::cout << fields[i] << (i == fields.size()-1 ? "" : ", ");
+                 os << fields[i].name << (i == fields.size()-1 ? "" : ", ");
              }
-             std::cout << std::endl;
+             os << std::endl;
              break;
          }
         // 其他叶子节点类型不需要递归
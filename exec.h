@@ -3,7 +3,9 @@
 #define TEMPLATE_EXEC_H
 
 #include "parse.h"
+#include "bytecode.h"
 #include "values.h"
+#include "output_sink.h"
 
 #include <sstream>
 #include <vector>
@@ -27,11 +29,12 @@ enum ExecErrorType {
 struct Variable {
     std::string name;
     Values* value;
+    bool owned;     // false表示value借用自输入数据或外层变量，出栈时不释放
     
-    Variable() : name(""), value(NULL) {}
+    Variable() : name(""), value(NULL), owned(true) {}
     
-    Variable(const std::string& n, Values* v)
-        : name(n), value(v) {}
+    Variable(const std::string& n, Values* v, bool o = true)
+        : name(n), value(v), owned(o) {}
         
     ~Variable() {
         // 不在这里删除value，因为它的生命周期由ExecContext管理
@@ -54,14 +57,26 @@ private:
     std::string templateName_;
 };
 
+class ExecContext;
+class CompiledTemplate;
+class TemplateNamespace;
+struct NamedTemplate;
+struct TemplateMemo;
+
 // 函数类型定义
+// 函数对象不保存执行状态，正在执行的上下文由ctx传入，因此可以被多个线程同时调用
 class TemplateFn {
 public:
     virtual ~TemplateFn() {}
-    virtual Values* operator()(const std::vector<Values*>& args) = 0;
+    virtual Values* operator()(ExecContext& ctx, const std::vector<Values*>& args) const = 0;
+
+    // 纯函数：结果只取决于参数，没有副作用。调用过非纯函数的具名模板，其输出不会被缓存
+    virtual bool Pure() const { return false; }
 };
 
 // 函数库
+// 构造时注册内置函数，之后可以用AddFunction添加自定义函数；开始执行模板后不再修改，
+// 同一个函数库可以被多个线程上的ExecContext同时使用
 class FunctionLib {
 public:
     FunctionLib();
@@ -70,37 +85,74 @@ public:
     void AddFunction(const std::string& name, TemplateFn* func);
     bool HasFunction(const std::string& name) const;
     TemplateFn* GetFunction(const std::string& name) const;
-    
-    // 提供一个可以设置ExecContext的方法
-    void SetContext(class ExecContext* ctx);
-    
-    // 获取上下文
-    class ExecContext* GetContext() const { return ctx_; }
+    // 找不到时返回NULL
+    TemplateFn* FindFunction(std::string_view name) const;
+
+    // 把tree中的函数名节点绑定到本库中的函数，执行时不再按名称查找。
+    // 必须在树被多个ExecContext共享之前调用，绑定期间本库不能被修改
+    void Bind(const Tree* tree) const;
+
+    // 只含内置函数的共享函数库，第一次使用时构建，之后只读
+    static const FunctionLib& Builtins();
     
 private:
-    std::map<std::string, TemplateFn*> functions_;
-    class ExecContext* ctx_; // 保存ExecContext指针，而不是引用
+    std::map<std::string, TemplateFn*, std::less<> > functions_;
     
     // 初始化内置函数
     void initBuiltinFunctions();
+
+    FunctionLib(const FunctionLib&);
+    FunctionLib& operator=(const FunctionLib&);
+};
+
+// 执行统计：由调用者提供，多次渲染间累加；不能被多个线程同时使用
+struct ExecStats {
+    size_t templateCalls;   // {{template}}调用次数
+    size_t memoHits;        // 直接使用缓存输出的调用次数
+    
+    ExecStats() : templateCalls(0), memoHits(0) {}
 };
 
 // 执行选项
 struct ExecOptions {
     bool missingKeyError;   // 是否对缺失的键报错
     int maxExecDepth;       // 最大执行深度
+    bool fieldCache;        // 字段查找是否使用节点上的内联缓存
+    const TemplateNamespace* templates; // {{template}}查找具名模板的命名空间（借用，可以为NULL）
+    bool memoizeTemplates;  // 一次渲染内缓存纯具名模板对同一输入数据的输出
+    ExecStats* stats;       // 非NULL时累加执行统计
     
-    ExecOptions() : missingKeyError(false), maxExecDepth(100) {}
+    ExecOptions()
+        : missingKeyError(false), maxExecDepth(100), fieldCache(true), templates(NULL),
+          memoizeTemplates(true), stats(NULL) {}
 };
 
 // 执行上下文
 class ExecContext {
 public:
+    // data在执行期间只被借用（不复制也不释放），调用者保证其生命周期覆盖Execute
     ExecContext(
         Tree* tmpl,
         std::ostream& writer,
-        Values* data,
-        FunctionLib& funcs,
+        const Values* data,
+        const FunctionLib& funcs,
+        const ExecOptions& options = ExecOptions());
+    
+    // 执行已编译的模板：tmpl和program只被借用，可以由多个ExecContext同时执行
+    ExecContext(
+        const Tree* tmpl,
+        const Program* program,
+        std::ostream& writer,
+        const Values* data,
+        const FunctionLib& funcs,
+        const ExecOptions& options = ExecOptions());
+    
+    // 执行编译好的模板的主模板；{{template}}先在options.templates中查找，再查找compiled自身的define块
+    ExecContext(
+        const CompiledTemplate& compiled,
+        std::ostream& writer,
+        const Values* data,
+        const FunctionLib& funcs,
         const ExecOptions& options = ExecOptions());
     
     ~ExecContext(); // 析构函数，负责清理资源
@@ -108,25 +160,28 @@ public:
     // 执行模板
     void Execute();
     
-    // 当前模板
+    // 使用预先编译好的指令序列（调用者保证其生命周期覆盖Execute）
+    void SetProgram(const Program* program);
+    
+    // 当前模板（转移所有权；借用的模板返回NULL）
     Tree* GetTemplate();
     
     // 输出器
     std::ostream& GetWriter();
     
     // 变量管理
-    void PushVariable(const std::string& name, Values* value);
+    void PushVariable(const std::string& name, Values* value, bool owned = true);
     int MarkVariables();
     void PopVariables(int mark);
     void SetVariable(const std::string& name, Values* value);
-    void SetTopVariable(int n, Values* value);
+    void SetTopVariable(int n, Values* value, bool owned = true);
     Values* GetVariable(const std::string& name);
     
     // 错误管理
     void Error(ExecErrorType type, const std::string& format, ...);
     
     // 获取函数库
-    FunctionLib& GetFunctions();
+    const FunctionLib& GetFunctions() const;
     
     // 执行深度管理
     void IncrementDepth();
@@ -141,6 +196,11 @@ public:
     // 打印值
     void PrintValue(const Node* node, Values* value);
     
+    // 以dot为"."求值管道，调用者拥有返回值；优化遍历用它对常量管道求值
+    Values* EvalPipeline(const PipeNode* pipe, Values* dot = NULL);
+    // 以dot为"."求值单个参数，调用者拥有返回值
+    Values* EvalArg(const Node* arg, Values* dot = NULL);
+    
     // 辅助函数
     Values* getFieldValue(Values* context, const std::string& field);
     void debugPrintValue(const char* prefix, Values* value);
@@ -149,31 +209,37 @@ public:
     bool isTrue(Values* val);
     
 private:
-    Tree* tmpl_;
-    std::ostream& writer_;
+    const Tree* tmpl_;
+    bool ownsTemplate_;       // tmpl_是否由ExecContext释放
+    std::ostream* writer_;    // 当前输出；缓存具名模板的输出时临时指向缓冲区
     const Node* currentNode_;
     std::vector<Variable> vars_;
-    FunctionLib& funcs_;
+    size_t varBase_;          // 当前调用帧的"$"在vars_中的位置，变量查找不越过它
+    const FunctionLib& funcs_;
     ExecOptions options_;
     int depth_;
-    std::map<std::string, Tree*> templateCache_;
+    const CompiledTemplate* compiled_; // 当前模板所属的编译结果，{{template}}的后备查找范围（借用）
+    TemplateMemo* memo_;      // 本次渲染的具名模板输出缓存，第一次调用具名模板时创建
+    bool dataStable_;         // 当前调用帧的"$"是否借用自整个渲染期间不变的输入数据
+    const Program* program_;  // 正在执行的指令序列
+    Program* ownedProgram_;   // Execute中自行编译的指令序列，由ExecContext释放
+    
+    void init(const Values* data);
     
     // 核心执行函数
-    void walk(Values* dot, const Node* node);
-    void walkIfOrWith(NodeType type, Values* dot, const BranchNode* node);
-    void walkRange(Values* dot, const RangeNode* node);
-    void walkTemplate(Values* dot, const TemplateNode* node);
+    void run(const Program& program, Values* dot);
+    Values* evalRangeItems(Values* dot, const BranchNode* node, bool& failed, bool& owned);
+    void walkTemplate(Values* dot, bool dotStable, const TemplateNode* node);
+    const NamedTemplate* findTemplate(const std::string& name);
+    void execTemplate(const NamedTemplate* named, Values* data, bool dataStable, std::ostream& writer);
     
     // 求值函数
     Values* evalPipeline(Values* dot, const PipeNode* pipe);
     Values* evalCommand(Values* dot, const CommandNode* cmd, 
                                     Values* final = NULL);
-    Values* evalFunction(Values* dot, const std::string& name, 
-                                    const CommandNode* cmd, const std::vector<const Node*>& args, 
+    Values* evalFunction(Values* dot, const IdentifierNode* ident, const std::vector<const Node*>& args, 
                                     Values* final = NULL, bool finalIsFirst = false);
-    Values* evalField(Values* dot, const std::string& fieldNameInput, 
-                                  const Node* node, const std::vector<const Node*>& args, 
-                                  Values* final, Values* receiver);
+    Values* evalField(Values* dot, const FieldNode* field, Values* final, Values* receiver);
     Values* evalChainedField(Values* dot, const ChainNode* chainNode, Values* final);
     Values* evalCall(Values* dot, TemplateFn* func, 
                                 const Node* node, const std::string& name,
@@ -181,21 +247,50 @@ private:
                                 Values* final);
 
     
+    // 借用求值：字段、链式字段、"."和变量直接返回输入数据中的指针，不复制。
+    // owned为false时调用者不能释放返回值；无法借用时退回普通求值，owned为true。
+    // 借用的指针在变量被重新赋值后失效，因此跨越循环体/分支体使用时allowVariables应为false
+    Values* lookupRef(Values* dot, const Node* n, bool allowVariables);
+    Values* evalArgRef(Values* dot, const Node* n, bool& owned);
+    Values* evalCommandRef(Values* dot, const CommandNode* cmd, bool& owned, bool allowVariables);
+    // declare为false时不处理管道的变量声明（range自己按每次迭代绑定）
+    Values* evalPipelineRef(Values* dot, const PipeNode* pipe, bool& owned, bool allowVariables, bool declare = true);
+    void evalArgs(Values* dot, const std::vector<const Node*>& args, Values* final, bool finalIsFirst,
+                  std::vector<Values*>& values, std::vector<bool>& owned);
+    
     // 辅助函数
     Values* evalArg(Values* dot, const Node* n);
     bool areEqual(const Values* a, const Values* b);
-    void printNodeTree(const Node* node, int indent);
+    void printNodeTree(std::ostream& os, const Node* node, int indent);
     
     // 禁止拷贝和赋值
     ExecContext(const ExecContext&);
     ExecContext& operator=(const ExecContext&);
 };
 
+// 执行模板并把输出（已去除空行）流式写入sink；
+// 输出按块写入，执行出错时sink可能已经收到部分输出
+void ExecuteTemplate(
+    const std::string& templateName,
+    const std::string& templateContent,
+    const Values* data,
+    OutputSink& sink,
+    const std::string& leftDelim = "{{",
+    const std::string& rightDelim = "}}",
+    const ExecOptions& options = ExecOptions());
+
+// 执行编译好的模板，{{template}}可以调用options.templates中的具名模板
+void ExecuteTemplate(
+    const CompiledTemplate& compiled,
+    const Values* data,
+    OutputSink& sink,
+    const ExecOptions& options = ExecOptions());
+
 // 执行模板函数 - 便捷API
 std::string ExecuteTemplate(
     const std::string& templateName,
     const std::string& templateContent,
-    Values* data,
+    const Values* data,
     const std::string& leftDelim = "{{",
     const std::string& rightDelim = "}}",
     const ExecOptions& options = ExecOptions());
@@ -0,0 +1,122 @@
+// file_loader.cpp
+#include "file_loader.h"
+
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace template_engine {
+
+const size_t FileBuffer::kMapThreshold;
+
+// 打开文件并取得大小；只接受普通文件
+static int openRegularFile(const std::string& path, size_t& size) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        ::close(fd);
+        return -1;
+    }
+    size = static_cast<size_t>(st.st_size);
+    return fd;
+}
+
+// 读满size个字节；read()可能提前返回，循环直到读完或遇到文件末尾
+static bool readFully(int fd, char* buffer, size_t size, size_t& got) {
+    got = 0;
+    while (got < size) {
+        ssize_t n = ::read(fd, buffer + got, size - got);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        if (n == 0) {
+            break; // 文件在fstat之后变短
+        }
+        got += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+FileBuffer::FileBuffer() : data_(NULL), size_(0), mapped_(false) {
+}
+
+FileBuffer::~FileBuffer() {
+    release();
+}
+
+void FileBuffer::release() {
+    if (mapped_) {
+        ::munmap(const_cast<char*>(data_), size_);
+    } else {
+        delete[] data_;
+    }
+    data_ = NULL;
+    size_ = 0;
+    mapped_ = false;
+}
+
+bool FileBuffer::Load(const std::string& path) {
+    release();
+
+    size_t size = 0;
+    int fd = openRegularFile(path, size);
+    if (fd < 0) {
+        return false;
+    }
+    if (size == 0) {
+        ::close(fd);
+        return true;
+    }
+
+    if (size >= kMapThreshold) {
+        void* addr = ::mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr != MAP_FAILED) {
+            ::close(fd);
+            data_ = static_cast<const char*>(addr);
+            size_ = size;
+            mapped_ = true;
+            return true;
+        }
+        // 映射失败时退回读取
+    }
+
+    char* buffer = new char[size];
+    size_t got = 0;
+    bool ok = readFully(fd, buffer, size, got);
+    ::close(fd);
+    if (!ok) {
+        delete[] buffer;
+        return false;
+    }
+    data_ = buffer;
+    size_ = got;
+    return true;
+}
+
+bool ReadFile(const std::string& path, std::string& out) {
+    size_t size = 0;
+    int fd = openRegularFile(path, size);
+    if (fd < 0) {
+        return false;
+    }
+    out.resize(size);
+    size_t got = 0;
+    bool ok = size == 0 || readFully(fd, &out[0], size, got);
+    ::close(fd);
+    if (!ok) {
+        out.clear();
+        return false;
+    }
+    out.resize(got);
+    return true;
+}
+
+} // namespace template_engine
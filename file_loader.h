@@ -0,0 +1,42 @@
+// file_loader.h
+#ifndef TEMPLATE_FILE_LOADER_H
+#define TEMPLATE_FILE_LOADER_H
+
+#include <string>
+
+namespace template_engine {
+
+// 只读加载的文件内容：大文件用mmap映射，小文件用一次read()读入大小正好的缓冲区
+class FileBuffer {
+public:
+    FileBuffer();
+    ~FileBuffer();
+
+    // 加载文件；无法打开或读取时返回false。可以重复调用，之前的内容被释放
+    bool Load(const std::string& path);
+
+    const char* Data() const { return data_; }
+    size_t Size() const { return size_; }
+    bool Empty() const { return size_ == 0; }
+    bool IsMapped() const { return mapped_; }
+
+    // 小于此大小的文件直接读取，映射的开销比复制更大
+    static const size_t kMapThreshold = 64 * 1024;
+
+private:
+    void release();
+
+    const char* data_;
+    size_t size_;
+    bool mapped_;
+
+    FileBuffer(const FileBuffer&);
+    FileBuffer& operator=(const FileBuffer&);
+};
+
+// 把整个文件读入out（按文件大小一次分配，一次read()）；无法打开或读取时返回false
+bool ReadFile(const std::string& path, std::string& out);
+
+} // namespace template_engine
+
+#endif // TEMPLATE_FILE_LOADER_H
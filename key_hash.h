@@ -0,0 +1,25 @@
+// key_hash.h
+#ifndef TEMPLATE_KEY_HASH_H
+#define TEMPLATE_KEY_HASH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace template_engine {
+
+// 映射键的哈希（FNV-1a）
+// ValuesMap用它索引键，解析器用它预先算好字段路径各段的哈希，两边必须一致；
+// 放在独立的头文件中，解析器不必依赖Values库
+inline uint32_t HashKey(std::string_view key) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < key.size(); ++i) {
+        h ^= static_cast<unsigned char>(key[i]);
+        h *= 16777619u;
+    }
+    return h;
+}
+
+} // namespace template_engine
+
+#endif // TEMPLATE_KEY_HASH_H
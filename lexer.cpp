@@ -1,4 +1,5 @@
 #include "lexer.h"
+#include "trace.h"
 #include <iostream>
 #include <sstream>
 #include <cstdarg>
@@ -8,13 +9,16 @@
 #include <cctype>
 #include <cstdio>
 #include <cstring>
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
 
 // Item 类构造函数实现
 Item::Item() : type(ItemError), pos(0), val(""), line(0) {}
 
 Item::Item(ItemType t, Pos p, const std::string& v, int l) 
     : type(t), pos(p), val(v), line(l) {
-    std::cout << "Token: " << itemTypeToString(t) << " 行=" << l << " 值=\"" << v << "\"" << std::endl;
+    TE_TRACE(TraceLexer, TraceVerbose, "Token: " << itemTypeToString(t) << " 行=" << l << " 值=\"" << v << "\"");
 }
 
 // 常量定义
@@ -28,27 +32,92 @@ const Pos TRIM_MARKER_LEN = 2;  // 修剪标记的长度（例如 {{- 或 -}}）
 // 将 Item 转换为字符串以供调试
 std::string Item::toString() const {
     std::ostringstream oss;
-    oss << itemTypeToString(type) << "(" << val << ")";
+    oss << itemTypeToString(type) << "(" << (text.empty() ? std::string_view(val) : text) << ")";
     return oss.str();
 }
 
-// 构建关键字映射
-std::map<std::string, ItemType> buildKeywordMap() {
-    std::map<std::string, ItemType> m;
-    m["block"] = ItemBlock;
-    m["break"] = ItemBreak;
-    m["continue"] = ItemContinue;
-    m["define"] = ItemDefine;
-    m["else"] = ItemElse;
-    m["end"] = ItemEnd;
-    m["if"] = ItemIf;
-    m["nil"] = ItemNil;
-    m["range"] = ItemRange;
-    m["template"] = ItemTemplate;
-    m["with"] = ItemWith;
-    return m;
+// 为n个token预分配空间
+void TokenBuffer::reserve(size_t n) {
+    types.reserve(n);
+    pos.reserve(n);
+    len.reserve(n);
+    lines.reserve(n);
+}
+
+// 清空token，保留已分配的容量以便复用
+void TokenBuffer::clear() {
+    types.clear();
+    pos.clear();
+    len.clear();
+    lines.clear();
+    error.clear();
+}
+
+// 追加一个token；错误token的消息另存到error中
+void TokenBuffer::push(const Item& item) {
+    types.push_back(item.type);
+    pos.push_back(item.pos);
+    len.push_back(static_cast<unsigned int>(item.text.size()));
+    lines.push_back(item.line);
+    if (item.type == ItemError) {
+        error.assign(item.text.data(), item.text.size());
+    }
+}
+
+// 按下标还原token，不复制任何字符串
+Item TokenBuffer::at(size_t i) const {
+    Item item;
+    item.type = types[i];
+    item.pos = pos[i];
+    item.line = lines[i];
+    if (item.type == ItemError) {
+        item.text = error;
+    } else if (item.type == ItemEOF) {
+        item.text = "EOF";
+    } else {
+        item.text = std::string_view(*source).substr(pos[i], len[i]);
+    }
+    return item;
+}
+
+// 关键字识别：先按长度分派，再比较首字符和整个单词
+// 编译期求值，不需要在每个词法分析器中构建查找表；不是关键字时返回ItemIdentifier
+static constexpr ItemType lookupKeyword(std::string_view word) {
+    switch (word.length()) {
+    case 2:
+        return word == "if" ? ItemIf : ItemIdentifier;
+    case 3:
+        if (word[0] == 'e') return word == "end" ? ItemEnd : ItemIdentifier;
+        if (word[0] == 'n') return word == "nil" ? ItemNil : ItemIdentifier;
+        return ItemIdentifier;
+    case 4:
+        if (word[0] == 'e') return word == "else" ? ItemElse : ItemIdentifier;
+        if (word[0] == 'w') return word == "with" ? ItemWith : ItemIdentifier;
+        return ItemIdentifier;
+    case 5:
+        if (word[0] == 'b') {
+            if (word == "block") return ItemBlock;
+            if (word == "break") return ItemBreak;
+            return ItemIdentifier;
+        }
+        if (word[0] == 'r') return word == "range" ? ItemRange : ItemIdentifier;
+        return ItemIdentifier;
+    case 6:
+        return word == "define" ? ItemDefine : ItemIdentifier;
+    case 8:
+        if (word[0] == 'c') return word == "continue" ? ItemContinue : ItemIdentifier;
+        if (word[0] == 't') return word == "template" ? ItemTemplate : ItemIdentifier;
+        return ItemIdentifier;
+    default:
+        return ItemIdentifier;
+    }
 }
 
+static_assert(lookupKeyword("range") == ItemRange, "keyword lookup");
+static_assert(lookupKeyword("template") == ItemTemplate, "keyword lookup");
+static_assert(lookupKeyword("ranges") == ItemIdentifier, "keyword lookup");
+static_assert(lookupKeyword("") == ItemIdentifier, "keyword lookup");
+
 // 辅助函数
 
 bool isSpace(int r) {
@@ -61,16 +130,18 @@ bool isAlphaNumeric(int r) {
     return isalnum(r) || r == '_';
 }
 
-bool hasLeftTrimMarker(const std::string& s) {
-    return s.length() >= 2 && s[0] == '-' && s[1] == ' ';
+// s以"- "开头（左修剪标记，位于左定界符之后）
+bool hasLeftTrimMarker(std::string_view s) {
+    return s.length() >= 2 && s[0] == TRIM_MARKER && isSpace(s[1]);
 }
 
-bool hasRightTrimMarker(const std::string& s) {
-    return s.length() >= 2 && s[s.length()-2] == ' ' && s[s.length()-1] == '-';
+// s以" -"开头（右修剪标记，位于右定界符之前）
+bool hasRightTrimMarker(std::string_view s) {
+    return s.length() >= 2 && isSpace(s[0]) && s[1] == TRIM_MARKER;
 }
 
 // 计算字符串右侧的空白长度
-Pos rightTrimLength(const std::string& s) {
+Pos rightTrimLength(std::string_view s) {
     Pos i = s.length();
     while (i > 0 && isSpace(s[i-1])) {
         i--;
@@ -78,7 +149,7 @@ Pos rightTrimLength(const std::string& s) {
     return s.length() - i;
 }
 
-Pos leftTrimLength(const std::string& s) {
+Pos leftTrimLength(std::string_view s) {
     Pos i = 0;
     while (i < s.length() && isSpace(s[i])) {
         i++;
@@ -86,14 +157,136 @@ Pos leftTrimLength(const std::string& s) {
     return i;
 }
 
+// 统计32位掩码中置位的数量
+static int popCount(unsigned int mask) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_popcount(mask);
+#else
+    int n = 0;
+    for (; mask; mask &= mask - 1) {
+        ++n;
+    }
+    return n;
+#endif
+}
+
+// 32位掩码中最低置位的下标（mask非0）
+static int lowestBit(unsigned int mask) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctz(mask);
+#else
+    int i = 0;
+    while (!(mask & 1u)) {
+        mask >>= 1;
+        ++i;
+    }
+    return i;
+#endif
+}
+
+// 在s[from:]中查找delim，同时统计delim之前（未找到时为到结尾）的换行符数量。
+// 按块比较delim的首字节和'\n'，AVX2每次32字节，SSE2每次16字节，余下部分逐字节处理。
+// 返回delim的位置，未找到返回npos。
+static Pos scanToDelim(std::string_view s, Pos from, std::string_view delim, int& newlines) {
+    const char* base = s.data();
+    const char* p = base + from;
+    const char* end = base + s.length();
+    const char first = delim[0];
+    int lines = 0;
+
+#if defined(__AVX2__)
+    const __m256i firstVec = _mm256_set1_epi8(first);
+    const __m256i newlineVec = _mm256_set1_epi8('\n');
+    while (end - p >= 32) {
+        __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        unsigned int hits = static_cast<unsigned int>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, firstVec)));
+        unsigned int nl = static_cast<unsigned int>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, newlineVec)));
+        for (; hits; hits &= hits - 1) {
+            int i = lowestBit(hits);
+            if (static_cast<size_t>(end - p - i) >= delim.length() &&
+                memcmp(p + i, delim.data(), delim.length()) == 0) {
+                newlines = lines + popCount(nl & ((1u << i) - 1u));
+                return static_cast<Pos>(p + i - base);
+            }
+        }
+        lines += popCount(nl);
+        p += 32;
+    }
+#elif defined(__SSE2__)
+    const __m128i firstVec = _mm_set1_epi8(first);
+    const __m128i newlineVec = _mm_set1_epi8('\n');
+    while (end - p >= 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        unsigned int hits = static_cast<unsigned int>(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, firstVec)));
+        unsigned int nl = static_cast<unsigned int>(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, newlineVec)));
+        for (; hits; hits &= hits - 1) {
+            int i = lowestBit(hits);
+            if (static_cast<size_t>(end - p - i) >= delim.length() &&
+                memcmp(p + i, delim.data(), delim.length()) == 0) {
+                newlines = lines + popCount(nl & ((1u << i) - 1u));
+                return static_cast<Pos>(p + i - base);
+            }
+        }
+        lines += popCount(nl);
+        p += 16;
+    }
+#endif
+
+    // 标量处理剩余字节
+    for (; p < end; ++p) {
+        if (*p == first && static_cast<size_t>(end - p) >= delim.length() &&
+            memcmp(p, delim.data(), delim.length()) == 0) {
+            newlines = lines;
+            return static_cast<Pos>(p - base);
+        }
+        if (*p == '\n') {
+            ++lines;
+        }
+    }
+    newlines = lines;
+    return std::string_view::npos;
+}
+
 // Lexer 构造函数
 Lexer::Lexer(const std::string& name, const std::string& input, 
              const std::string& left, const std::string& right)
-    : name_(name), input_(input), 
+    : Lexer(name, std::make_shared<const std::string>(input), left, right) {
+}
+
+Lexer::Lexer(const std::string& name, std::shared_ptr<const std::string> source,
+             const std::string& left, const std::string& right)
+    : name_(name), source_(source), input_(*source_), 
       leftDelim_(left.empty() ? "{{" : left), 
       rightDelim_(right.empty() ? "}}" : right),
       pos_(0), start_(0), atEOF_(false), parenDepth_(0), line_(1), startLine_(1),
-      insideAction_(false), lastPos_(0), lastType_(ItemEOF), keyMap_(buildKeywordMap()) {
+      insideAction_(false), lastPos_(0), lastType_(ItemEOF) {
+}
+
+// 构造token：text总是指向源缓冲区（或静态/词法分析器自有的存储），
+// 非零拷贝模式下再复制一份到val
+Item Lexer::makeItem(ItemType t, Pos p, std::string_view text, int l) const {
+    Item item;
+    item.type = t;
+    item.pos = p;
+    item.line = l;
+    item.text = text;
+    if (!options_.zeroCopy) {
+        item.val.assign(text.data(), text.size());
+    }
+    TE_TRACE(TraceLexer, TraceVerbose, "Token: " << itemTypeToString(t) << " 行=" << l << " 值=\"" << text << "\"");
+    return item;
+}
+
+// 检查输入在位置p处是否以prefix开头
+bool Lexer::hasPrefixAt(Pos p, std::string_view prefix) const {
+    return p <= input_.length() && input_.substr(p, prefix.length()) == prefix;
+}
+
+// 跳过右修剪标记之后的空白，并更新行号
+void Lexer::skipTrimmedSpace() {
+    Pos n = leftTrimLength(input_.substr(pos_));
+    line_ += std::count(input_.begin() + pos_, input_.begin() + pos_ + n, '\n');
+    pos_ += n;
 }
 
 // 设置词法分析器选项
@@ -141,7 +334,9 @@ Item Lexer::errorItem(const std::string& format, ...) {
     vsnprintf(buf, sizeof(buf), format.c_str(), args);
     va_end(args);
     
-    return Item(ItemError, pos_, buf, line_);
+    // 错误消息不在源缓冲区中，保存在messages_里，token视图指向它
+    messages_.push_back(buf);
+    return makeItem(ItemError, pos_, messages_.back(), line_);
 }
 
 // 忽略当前累积的 token
@@ -169,23 +364,16 @@ void Lexer::acceptRun(const std::string& valid) {
     }
 }
 
-// 检查当前位置是否是右定界符，并检查是否有修剪标记
+// 检查当前位置是否是右定界符，并检查是否有修剪标记（" -}}"）
 std::pair<bool, bool> Lexer::atRightDelim() {
-    if (pos_ + rightDelim_.length() > input_.length()) {
-        return std::make_pair(false, false);
+    if (hasRightTrimMarker(input_.substr(pos_)) &&
+        hasPrefixAt(pos_ + TRIM_MARKER_LEN, rightDelim_)) {
+        return std::make_pair(true, true);
     }
-    
-    std::string rightPart = input_.substr(pos_, rightDelim_.length());
-    bool isDelim = (rightPart == rightDelim_);
-    
-    // 检查是否是修剪标记
-    bool hasTrimMarker = false;
-    if (pos_ >= TRIM_MARKER_LEN && 
-        hasRightTrimMarker(input_.substr(pos_ - TRIM_MARKER_LEN, TRIM_MARKER_LEN))) {
-        hasTrimMarker = true;
+    if (hasPrefixAt(pos_, rightDelim_)) {
+        return std::make_pair(true, false);
     }
-    
-    return std::make_pair(isDelim, hasTrimMarker);
+    return std::make_pair(false, false);
 }
 
 // 检查当前位置是否是动作命令的的终止符
@@ -241,11 +429,8 @@ bool Lexer::scanNumber() {
 // 获取下一个词法项（状态机入口）
 Item Lexer::nextItem() {
     if (pos_ >= input_.length()) {
-        if (atEOF_) {
-            return Item(ItemEOF, pos_, "EOF", line_);
-        }
         atEOF_ = true;
-        return Item(ItemEOF, pos_, "EOF", line_);
+        return makeItem(ItemEOF, pos_, "EOF", line_);
     }
 
     if (insideAction_) {
@@ -254,20 +439,51 @@ Item Lexer::nextItem() {
     return lexText();
 }
 
+// 获取所有token，直到EOF或第一个错误（含该token）
+std::vector<Item> Lexer::getAllItems() {
+    std::vector<Item> items;
+    for (;;) {
+        items.push_back(nextItem());
+        if (items.back().type == ItemEOF || items.back().type == ItemError) {
+            break;
+        }
+    }
+    return items;
+}
+
+// 批量词法分析：按源长度预估token数并一次分配，之后逐个追加
+void Lexer::tokenize(TokenBuffer& buffer) {
+    buffer.clear();
+    buffer.source = source_;
+    buffer.reserve(input_.length() / 6 + 16);
+    for (;;) {
+        Item item = nextItem();
+        buffer.push(item);
+        if (item.type == ItemEOF || item.type == ItemError) {
+            break;
+        }
+    }
+}
+
 // 解析普通文本状态
 Item Lexer::lexText() {
-    // 查找第一个定界符
-    size_t x = input_.find(leftDelim_, pos_);
-    if (x != std::string::npos) { // 找到了
-        if (x > pos_) { // 定界符不在当前位置，说明前面有文本
-            // 逐个读取字符直到定界符 x，以便更新行号
-            while (pos_ < x) {
-                next();
+    // 一次扫描：查找第一个定界符，同时统计经过的换行符
+    int newlines = 0;
+    Pos x = scanToDelim(input_, pos_, leftDelim_, newlines);
+    line_ += newlines;
+    if (x != std::string_view::npos) { // 找到了
+        pos_ = x;
+        if (x > start_) { // 定界符不在当前位置，说明前面有文本
+            // 左定界符带修剪标记时，去掉文本末尾的空白
+            Pos trimLength = 0;
+            if (hasLeftTrimMarker(input_.substr(x + leftDelim_.length()))) {
+                trimLength = rightTrimLength(input_.substr(start_, x - start_));
             }
-            // 现在 pos_ 等于 x，且 line_ 已经更新
-            Item result(ItemText, start_, input_.substr(start_, pos_ - start_), startLine_);
+            Item result = makeItem(ItemText, start_, input_.substr(start_, x - trimLength - start_), startLine_);
             ignore(); // 忽略 start_ 之前的部分，准备处理定界符
-            return result;
+            if (!result.text.empty()) {
+                return result;
+            }
         }
         // 直接处理定界符
         ignore(); // 确保start_是正确的
@@ -275,14 +491,9 @@ Item Lexer::lexText() {
     }
     
     // 没有找到定界符，处理剩余的部分
-    size_t endPos = input_.length();
-    if (endPos > pos_) { // 检查是否还有剩余文本
-        // 逐个读取剩余所有字符，以便更新行号
-        while (pos_ < endPos) {
-            next();
-        }
-        // 处理剩余的部分
-        Item result(ItemText, start_, input_.substr(start_, pos_ - start_), startLine_);
+    pos_ = input_.length();
+    if (pos_ > start_) { // 检查是否还有剩余文本
+        Item result = makeItem(ItemText, start_, input_.substr(start_, pos_ - start_), startLine_);
         // 注意：这里不需要调用 ignore()，因为后面没有 token 了
         return result;
     }
@@ -290,7 +501,7 @@ Item Lexer::lexText() {
     // 文件结束
     atEOF_ = true;
     // 文件结束时，使用当前的 line_
-    return Item(ItemEOF, pos_, "EOF", line_);
+    return makeItem(ItemEOF, pos_, "EOF", line_);
 }
 
 // 解析左定界符状态
@@ -300,10 +511,7 @@ Item Lexer::lexLeftDelim() {
     pos_ += leftDelim_.length();
     
     // 处理空格
-    bool trimSpace = false;
-    if (pos_ < input_.length() && hasLeftTrimMarker(input_.substr(pos_))) {
-        trimSpace = true;
-    }
+    bool trimSpace = hasLeftTrimMarker(input_.substr(pos_));
     
     Pos afterMarker = 0;
     if (trimSpace) {
@@ -319,7 +527,7 @@ Item Lexer::lexLeftDelim() {
     }
     
     // 处理定界符
-    Item result(ItemLeftDelim, delimStart, leftDelim_, startLine_);
+    Item result = makeItem(ItemLeftDelim, delimStart, input_.substr(delimStart, leftDelim_.length()), startLine_);
     
     // 设置状态
     insideAction_ = true;
@@ -342,13 +550,13 @@ Item Lexer::lexComment() {
     if (!delim) {
         return errorItem("comment ends before closing delimiter");
     }
-    Item result(ItemComment, start_, input_.substr(start_, pos_ - start_), startLine_);
+    Item result = makeItem(ItemComment, start_, input_.substr(start_, pos_ - start_), startLine_);
     if (trimSpace) {
         pos_ += TRIM_MARKER_LEN;
     }
     pos_ += rightDelim_.length();
-    if (trimSpace && pos_ < input_.length()) {
-        pos_ += leftTrimLength(input_.substr(pos_));
+    if (trimSpace) {
+        skipTrimmedSpace();
     }
     ignore();
     insideAction_ = false;
@@ -361,28 +569,25 @@ Item Lexer::lexComment() {
     return nextItem();
 }
 
-// 解析右定界符状态
+// 解析右定界符状态（当前位置是定界符，或者是其前面的" -"修剪标记）
 Item Lexer::lexRightDelim() {
-    // 记录起始位置
-    Pos delimStart = pos_;
-    
-    // 检查前面是否有空格
-    bool trimSpace = false;
-    if (pos_ >= TRIM_MARKER_LEN && 
-        hasRightTrimMarker(input_.substr(pos_ - TRIM_MARKER_LEN, TRIM_MARKER_LEN))) {
-        trimSpace = true;
-        pos_ = pos_ - TRIM_MARKER_LEN;
+    // 跳过修剪标记
+    bool trimSpace = atRightDelim().second;
+    if (trimSpace) {
+        pos_ += TRIM_MARKER_LEN;
+        ignore();
     }
     
     // 处理定界符
-    Item result(ItemRightDelim, delimStart, rightDelim_, startLine_);
+    Pos delimStart = pos_;
+    Item result = makeItem(ItemRightDelim, delimStart, input_.substr(delimStart, rightDelim_.length()), startLine_);
     
     // 移动到定界符之后
     pos_ += rightDelim_.length();
     
     // 处理后面是否有空格
-    if (trimSpace && pos_ < input_.length()) {
-        pos_ += leftTrimLength(input_.substr(pos_));
+    if (trimSpace) {
+        skipTrimmedSpace();
     }
     
     // 设置状态
@@ -394,11 +599,12 @@ Item Lexer::lexRightDelim() {
 
 // 解析 Action 内部状态
 Item Lexer::lexInsideAction() {
+    ignore(); // 忽略start_位置
+    
     // 处理前面的空格
     if (peek() == ' ' || peek() == '\t' || peek() == '\r' || peek() == '\n') {
         return lexSpace();
     }
-    ignore(); // 忽略start_位置
     
     // 检查是否是EOF
     if (peek() == EOF_RUNE) {
@@ -424,18 +630,18 @@ Item Lexer::lexInsideAction() {
             
         case '=':
             // 处理赋值
-            return Item(ItemAssign, start_, "=", startLine_);
+            return makeItem(ItemAssign, start_, input_.substr(start_, 1), startLine_);
             
         case ':':
             // 处理声明
             if (next() != '=') {
                 return errorItem("expected :=");
             }
-            return Item(ItemDeclare, start_, ":=", startLine_);
+            return makeItem(ItemDeclare, start_, input_.substr(start_, 2), startLine_);
             
         case '|':
             // 处理管道
-            return Item(ItemPipe, start_, "|", startLine_);
+            return makeItem(ItemPipe, start_, input_.substr(start_, 1), startLine_);
             
         case '"':
             // 处理字符串
@@ -456,7 +662,7 @@ Item Lexer::lexInsideAction() {
         case '(':
             // 处理左括号
             parenDepth_++;
-            return Item(ItemLeftParen, start_, "(", startLine_);
+            return makeItem(ItemLeftParen, start_, input_.substr(start_, 1), startLine_);
             
         case ')':
             // 处理右括号
@@ -464,7 +670,7 @@ Item Lexer::lexInsideAction() {
             if (parenDepth_ < 0) {
                 return errorItem("unexpected right paren");
             }
-            return Item(ItemRightParen, start_, ")", startLine_);
+            return makeItem(ItemRightParen, start_, input_.substr(start_, 1), startLine_);
             
         case '.':
             // 检查是否是数字
@@ -478,7 +684,7 @@ Item Lexer::lexInsideAction() {
                 return lexField();
             }
             
-            return Item(ItemDot, start_, ".", startLine_);
+            return makeItem(ItemDot, start_, input_.substr(start_, 1), startLine_);
             
         case '+': case '-': case '0': case '1': case '2': case '3': case '4':
         case '5': case '6': case '7': case '8': case '9':
@@ -494,7 +700,7 @@ Item Lexer::lexInsideAction() {
                 return lexIdentifier();
             } else if (r <= 127 && isprint(r)) {
                 // 处理可打印字符
-                return Item(ItemChar, start_, std::string(1, r), startLine_);
+                return makeItem(ItemChar, start_, input_.substr(start_, 1), startLine_);
             }
             
             // 识别未知字符
@@ -516,16 +722,16 @@ Item Lexer::lexSpace() {
     }
     
     
-    if (pos_ > 0 && hasRightTrimMarker(input_.substr(pos_-1)) && 
-        pos_-1+TRIM_MARKER_LEN+rightDelim_.length() <= input_.length() && 
-        input_.substr(pos_-1+TRIM_MARKER_LEN, rightDelim_.length()) == rightDelim_) {
+    // 空格之后是"-}}"：最后一个空格属于右修剪标记
+    if (pos_ > 0 && hasRightTrimMarker(input_.substr(pos_ - 1)) && 
+        hasPrefixAt(pos_ - 1 + TRIM_MARKER_LEN, rightDelim_)) {
         backup(); 
         if (numSpaces == 1) {
             return lexRightDelim(); 
         }
     }
     
-    Item result(ItemSpace, start_, input_.substr(start_, pos_ - start_), startLine_);
+    Item result = makeItem(ItemSpace, start_, input_.substr(start_, pos_ - start_), startLine_);
     // std::cout << "[LEX] 生成空格token: [" << result.val << "] 行:" << result.line << " pos:" << result.pos << std::endl;
     return result;
 }
@@ -537,64 +743,57 @@ Item Lexer::lexIdentifier() {
         next();
     }
     
-    std::string word = input_.substr(start_, pos_ - start_);
+    std::string_view word = input_.substr(start_, pos_ - start_);
     
     // 检查是否是关键字
-    auto it = keyMap_.find(word);
-    if (it != keyMap_.end()) {
-        // 是关键字
-        ItemType keyword = it->second;
-        
+    ItemType keyword = lookupKeyword(word);
+    if (keyword != ItemIdentifier) {
         // 处理break和continue关键字
         if ((keyword == ItemBreak && !options_.breakOK) || 
             (keyword == ItemContinue && !options_.continueOK)) {
-            return Item(ItemIdentifier, start_, word, startLine_);
+            return makeItem(ItemIdentifier, start_, word, startLine_);
         }
         
         // 返回关键字
-        return Item(keyword, start_, word, startLine_);
+        return makeItem(keyword, start_, word, startLine_);
     }
     
     // 检查是否是布尔值
     if (word == "true" || word == "false") {
-        return Item(ItemBool, start_, word, startLine_);
+        return makeItem(ItemBool, start_, word, startLine_);
     }
     
     // 返回普通标识符
-    return Item(ItemIdentifier, start_, word, startLine_);
+    return makeItem(ItemIdentifier, start_, word, startLine_);
 }
 
 Item Lexer::lexField() {
-    
-    std::string fieldName = ".";
-    
-    
+    // start_指向'.'，字段名是start_之后的字母数字串
     while (pos_ < input_.length() && isAlphaNumeric(peek())) {
-        fieldName += next();
+        next();
     }
     
+    std::string_view fieldName = input_.substr(start_, pos_ - start_);
+    TE_TRACE(TraceLexer, TraceVerbose, "解析字段: " << fieldName);
     
-    std::cout << "解析字段: " << fieldName << std::endl;
-    
-    return Item(ItemField, start_, fieldName, startLine_);
+    return makeItem(ItemField, start_, fieldName, startLine_);
 }
 
 // 解析变量状态 (以 '$' 开头)
 Item Lexer::lexVariable() {
-    std::string varName = "$";
-    
     // 检查是否只包含 $
     if (pos_ >= input_.length() || !isAlphaNumeric(peek())) {
-        return Item(ItemVariable, start_, "$", startLine_);
+        return makeItem(ItemVariable, start_, input_.substr(start_, 1), startLine_);
     }
     
-    // 获取变量名
+    // 获取变量名（start_指向'$'）
     while (pos_ < input_.length() && isAlphaNumeric(peek())) {
-        varName += next();
+        next();
     }
     
-    std::cout << "解析变量: " << varName << std::endl;
-    return Item(ItemVariable, start_, varName, startLine_);
+    std::string_view varName = input_.substr(start_, pos_ - start_);
+    TE_TRACE(TraceLexer, TraceVerbose, "解析变量: " << varName);
+    return makeItem(ItemVariable, start_, varName, startLine_);
 }
 
 // 解析单个字符状态 (Action 内部)
@@ -615,13 +814,13 @@ Item Lexer::lexChar() {
             break;
         }
     }
-    return Item(ItemCharConstant, start_, input_.substr(start_, pos_ - start_), startLine_);
+    return makeItem(ItemCharConstant, start_, input_.substr(start_, pos_ - start_), startLine_);
 }
 
 // 解析数字状态 (Action 内部)
 Item Lexer::lexNumber() {
     if (!scanNumber()) {
-        return errorItem("bad number syntax: %s", input_.substr(start_, pos_ - start_).c_str());
+        return errorItem("bad number syntax: %s", std::string(input_.substr(start_, pos_ - start_)).c_str());
     }
     
     int sign = peek();
@@ -629,12 +828,12 @@ Item Lexer::lexNumber() {
         // : 1+2i
         next();
         if (!scanNumber() || input_[pos_-1] != 'i') {
-            return errorItem("bad number syntax: %s", input_.substr(start_, pos_ - start_).c_str());
+            return errorItem("bad number syntax: %s", std::string(input_.substr(start_, pos_ - start_)).c_str());
         }
-        return Item(ItemComplex, start_, input_.substr(start_, pos_ - start_), startLine_);
+        return makeItem(ItemComplex, start_, input_.substr(start_, pos_ - start_), startLine_);
     }
     
-    return Item(ItemNumber, start_, input_.substr(start_, pos_ - start_), startLine_);
+    return makeItem(ItemNumber, start_, input_.substr(start_, pos_ - start_), startLine_);
 }
 
 // 解析带引号字符串状态
@@ -655,7 +854,7 @@ Item Lexer::lexQuote() {
             break;
         }
     }
-    return Item(ItemString, start_, input_.substr(start_, pos_ - start_), startLine_);
+    return makeItem(ItemString, start_, input_.substr(start_, pos_ - start_), startLine_);
 }
 
 // 解析反引号原始字符串状态
@@ -669,7 +868,7 @@ Item Lexer::lexRawQuote() {
             break;
         }
     }
-    return Item(ItemRawString, start_, input_.substr(start_, pos_ - start_), startLine_);
+    return makeItem(ItemRawString, start_, input_.substr(start_, pos_ - start_), startLine_);
 }
 
 // 工厂函数：创建 Lexer 实例
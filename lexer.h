@@ -2,7 +2,9 @@
 #define LEXER_H
 
 #include <string>
+#include <string_view>
 #include <map>
+#include <deque>
 #include <vector>
 #include <memory>
 
@@ -53,8 +55,9 @@ enum ItemType {
 struct Item {
     ItemType type;    // 此token的类型
     Pos pos;          // 此token在输入字符串中的起始位置
-    std::string val;  // 此token的值
+    std::string val;  // 此token的值（零拷贝模式下为空）
     int line;         // 此token开始时的行号
+    std::string_view text; // 此token的值，指向词法分析器源缓冲区的视图
 
     Item();
     Item(ItemType t, Pos p, const std::string& v, int l);
@@ -62,13 +65,31 @@ struct Item {
     std::string toString() const;
 };
 
+// 批量词法分析的结果：预分配的结构数组(SoA)token缓冲区
+// 普通token的值是source[pos, pos+len)，不单独存储字符串
+struct TokenBuffer {
+    std::shared_ptr<const std::string> source; // token指向的源缓冲区
+    std::vector<ItemType> types;               // 每个token的类型
+    std::vector<Pos> pos;                      // 每个token在源中的起始位置
+    std::vector<unsigned int> len;             // 每个token的字节长度
+    std::vector<int> lines;                    // 每个token开始时的行号
+    std::string error;                         // ItemError的消息（词法分析在第一个错误处停止）
+
+    void reserve(size_t n);
+    void clear();
+    size_t size() const { return types.size(); }
+    void push(const Item& item);
+    Item at(size_t i) const; // 按下标还原为Item，text指向source或error
+};
+
 // 词法分析器选项
 struct LexOptions {
     bool emitComment;  // 发出itemComment标记
     bool breakOK;      // 允许break关键字
     bool continueOK;   // 允许continue关键字
+    bool zeroCopy;     // 零拷贝模式：只填充Item::text视图，不复制Item::val
 
-    LexOptions() : emitComment(false), breakOK(false), continueOK(false) {}
+    LexOptions() : emitComment(false), breakOK(false), continueOK(false), zeroCopy(false) {}
 };
 
 // 词法分析器类
@@ -76,6 +97,9 @@ class Lexer {
 public:
     Lexer(const std::string& name, const std::string& input, 
           const std::string& left, const std::string& right);
+    // 共享一个不可变的源缓冲区，不复制输入
+    Lexer(const std::string& name, std::shared_ptr<const std::string> source,
+          const std::string& left, const std::string& right);
           
     // 获取下一个词法单元
     Item nextItem();
@@ -83,13 +107,17 @@ public:
     // 获取所有token
     std::vector<Item> getAllItems();
     
+    // 一次性把所有token写入结构数组缓冲区，直到EOF或第一个错误
+    void tokenize(TokenBuffer& buffer);
+    
     // 设置词法分析器选项
     void setOptions(const LexOptions& options);
 
 private:
     // 成员变量
     std::string name_;          // 输入的名称，仅用于错误报告
-    std::string input_;         // 正在扫描的字符串
+    std::shared_ptr<const std::string> source_; // 不可变的源缓冲区，token视图指向这里
+    std::string_view input_;    // 正在扫描的字符串（source_的视图）
     std::string leftDelim_;     // 动作标记的开始
     std::string rightDelim_;    // 动作标记的结束
     Pos pos_;                   // 输入中的当前位置
@@ -104,9 +132,12 @@ private:
     Pos lastPos_;               // 上一个token的位置（用于调试）
     ItemType lastType_;         // 上一个token的类型（用于调试）
     
-    std::map<std::string, ItemType> keyMap_;  // 关键字映射
+    std::deque<std::string> messages_; // 错误消息存储，错误token的视图指向这里
 
     // 词法分析器方法
+    Item makeItem(ItemType t, Pos p, std::string_view text, int l) const;
+    bool hasPrefixAt(Pos p, std::string_view prefix) const;
+    void skipTrimmedSpace();
     int next();
     int peek() const;
     void backup();
@@ -144,9 +175,9 @@ std::string itemTypeToString(ItemType type);
 // 工具函数声明
 bool isSpace(int r);
 bool isAlphaNumeric(int r);
-bool hasLeftTrimMarker(const std::string& s);
-bool hasRightTrimMarker(const std::string& s);
-Pos rightTrimLength(const std::string& s);
-Pos leftTrimLength(const std::string& s);
+bool hasLeftTrimMarker(std::string_view s);
+bool hasRightTrimMarker(std::string_view s);
+Pos rightTrimLength(std::string_view s);
+Pos leftTrimLength(std::string_view s);
 
 #endif // LEXER_H
\ No newline at end of file
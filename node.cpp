@@ -1,4 +1,6 @@
 #include "node.h"
+#include "parse.h"
+#include "key_hash.h"
 #include <algorithm>
 #include <iostream>
 #include <sstream>
@@ -20,15 +22,15 @@ std::vector<std::string> SplitString(const std::string& s, char delimiter) {
 }
 
 // 添加IdentifierNode构造函数实现
-IdentifierNode::IdentifierNode(Tree* tr, Pos pos, const std::string& ident)
-    : Node(pos), tree_(tr), ident_(ident) {}
+IdentifierNode::IdentifierNode(Tree* tr, Pos pos, std::string_view ident)
+    : Node(pos), tree_(tr), ident_(tr->GetArena()->Intern(ident)), lib_(NULL), fn_(NULL) {}
 
 std::string IdentifierNode::String() const {
-    return ident_;
+    return std::string(ident_);
 }
 
 Node* IdentifierNode::Copy() const {
-    return new IdentifierNode(tree_, pos_, ident_);
+    return tree_->GetArena()->New<IdentifierNode>(tree_, pos_, ident_);
 }
 
 void IdentifierNode::WriteTo(std::stringstream& ss) const {
@@ -36,14 +38,14 @@ void IdentifierNode::WriteTo(std::stringstream& ss) const {
 }
 
 // TextNode 类实现
-TextNode::TextNode(Tree* tr, Pos pos, const std::string& text) : Node(pos), tree_(tr), text_(text) {}
+TextNode::TextNode(Tree* tr, Pos pos, std::string_view text) : Node(pos), tree_(tr), text_(tr->GetArena()->Intern(text)) {}
 
 std::string TextNode::String() const {
-    return text_;
+    return std::string(text_);
 }
 
 Node* TextNode::Copy() const {
-    return new TextNode(tree_, pos_, text_);
+    return tree_->GetArena()->New<TextNode>(tree_, pos_, text_);
 }
 
 void TextNode::WriteTo(std::stringstream& ss) const {
@@ -51,14 +53,14 @@ void TextNode::WriteTo(std::stringstream& ss) const {
 }
 
 // CommentNode 类实现
-CommentNode::CommentNode(Tree* tr, Pos pos, const std::string& text) : Node(pos), tree_(tr), text_(text) {}
+CommentNode::CommentNode(Tree* tr, Pos pos, std::string_view text) : Node(pos), tree_(tr), text_(tr->GetArena()->Intern(text)) {}
 
 std::string CommentNode::String() const {
-    return text_;
+    return std::string(text_);
 }
 
 Node* CommentNode::Copy() const {
-    return new CommentNode(tree_, pos_, text_);
+    return tree_->GetArena()->New<CommentNode>(tree_, pos_, text_);
 }
 
 void CommentNode::WriteTo(std::stringstream& ss) const {
@@ -66,7 +68,8 @@ void CommentNode::WriteTo(std::stringstream& ss) const {
 }
 
 // ListNode 类实现
-ListNode::ListNode(Tree* tr, Pos pos) : Node(pos), tree_(tr) {}
+ListNode::ListNode(Tree* tr, Pos pos)
+    : Node(pos), tree_(tr), nodes_(ArenaAllocator<Node*>(tr->GetArena())) {}
 
 std::string ListNode::String() const {
     std::stringstream ss;
@@ -82,7 +85,7 @@ std::string ListNode::String() const {
 }
 
 Node* ListNode::Copy() const {
-    ListNode* result = new ListNode(tree_, pos_);
+    ListNode* result = tree_->GetArena()->New<ListNode>(tree_, pos_);
     for (size_t i = 0; i < nodes_.size(); ++i) {
         result->Append(nodes_[i]->Copy());
     }
@@ -108,7 +111,7 @@ std::string ActionNode::String() const {
 }
 
 Node* ActionNode::Copy() const {
-    return new ActionNode(tree_, pos_, line_, static_cast<PipeNode*>(pipe_->Copy()));
+    return tree_->GetArena()->New<ActionNode>(tree_, pos_, line_, static_cast<PipeNode*>(pipe_->Copy()));
 }
 
 void ActionNode::WriteTo(std::stringstream& ss) const {
@@ -118,7 +121,8 @@ void ActionNode::WriteTo(std::stringstream& ss) const {
 }
 
 // CommandNode 类实现
-CommandNode::CommandNode(Tree* tr, Pos pos) : Node(pos), tree_(tr) {}
+CommandNode::CommandNode(Tree* tr, Pos pos)
+    : Node(pos), tree_(tr), args_(ArenaAllocator<Node*>(tr->GetArena())) {}
 
 std::string CommandNode::String() const {
     std::stringstream ss;
@@ -132,7 +136,7 @@ std::string CommandNode::String() const {
 }
 
 Node* CommandNode::Copy() const {
-    CommandNode* result = new CommandNode(tree_, pos_);
+    CommandNode* result = tree_->GetArena()->New<CommandNode>(tree_, pos_);
     for (size_t i = 0; i < args_.size(); ++i) {
         result->Append(args_[i]->Copy());
     }
@@ -153,7 +157,10 @@ void CommandNode::WriteTo(std::stringstream& ss) const {
 }
 
 // PipeNode 类实现
-PipeNode::PipeNode(Tree* tr, Pos pos, int line) : Node(pos), tree_(tr), line_(line), is_assign_(false) {}
+PipeNode::PipeNode(Tree* tr, Pos pos, int line)
+    : Node(pos), tree_(tr), line_(line), is_assign_(false),
+      decl_(ArenaAllocator<VariableNode*>(tr->GetArena())),
+      cmds_(ArenaAllocator<CommandNode*>(tr->GetArena())) {}
 
 std::string PipeNode::String() const {
     std::stringstream ss;
@@ -176,7 +183,7 @@ std::string PipeNode::String() const {
 }
 
 Node* PipeNode::Copy() const {
-    PipeNode* result = new PipeNode(tree_, pos_, line_);
+    PipeNode* result = tree_->GetArena()->New<PipeNode>(tree_, pos_, line_);
     for (size_t i = 0; i < cmds_.size(); ++i) {
         result->Append(static_cast<CommandNode*>(cmds_[i]->Copy()));
     }
@@ -218,14 +225,14 @@ void PipeNode::WriteTo(std::stringstream& ss) const {
 }
 
 // VariableNode 类实现
-VariableNode::VariableNode(Tree* tr, Pos pos, const std::string& ident) : Node(pos), tree_(tr), ident_(ident) {}
+VariableNode::VariableNode(Tree* tr, Pos pos, std::string_view ident) : Node(pos), tree_(tr), ident_(tr->GetArena()->Intern(ident)) {}
 
 std::string VariableNode::String() const {
-    return "$" + ident_;
+    return "$" + std::string(ident_);
 }
 
 Node* VariableNode::Copy() const {
-    return new VariableNode(tree_, pos_, ident_);
+    return tree_->GetArena()->New<VariableNode>(tree_, pos_, ident_);
 }
 
 void VariableNode::WriteTo(std::stringstream& ss) const {
@@ -240,7 +247,7 @@ std::string DotNode::String() const {
 }
 
 Node* DotNode::Copy() const {
-    return new DotNode(tree_, pos_);
+    return tree_->GetArena()->New<DotNode>(tree_, pos_);
 }
 
 void DotNode::WriteTo(std::stringstream& ss) const {
@@ -255,7 +262,7 @@ std::string NilNode::String() const {
 }
 
 Node* NilNode::Copy() const {
-    return new NilNode(tree_, pos_);
+    return tree_->GetArena()->New<NilNode>(tree_, pos_);
 }
 
 void NilNode::WriteTo(std::stringstream& ss) const {
@@ -263,14 +270,28 @@ void NilNode::WriteTo(std::stringstream& ss) const {
 }
 
 // FieldNode 类实现
-FieldNode::FieldNode(Tree* tr, Pos pos, const std::string& ident) : Node(pos), tree_(tr), ident_(ident) {}
+// 字段路径的一段，name已驻留
+static FieldSegment makeSegment(std::string_view name) {
+    FieldSegment segment;
+    segment.name = name;
+    segment.hash = template_engine::HashKey(name);
+    return segment;
+}
+
+FieldNode::FieldNode(Tree* tr, Pos pos, std::string_view ident) : Node(pos), tree_(tr), ident_(tr->GetArena()->Intern(ident)) {
+    std::string_view name = ident_;
+    if (!name.empty() && name[0] == '.') {
+        name.remove_prefix(1);
+    }
+    segment_ = makeSegment(name);
+}
 
 std::string FieldNode::String() const {
-    return "." + ident_;
+    return "." + std::string(ident_);
 }
 
 Node* FieldNode::Copy() const {
-    return new FieldNode(tree_, pos_, ident_);
+    return tree_->GetArena()->New<FieldNode>(tree_, pos_, ident_);
 }
 
 void FieldNode::WriteTo(std::stringstream& ss) const {
@@ -278,14 +299,15 @@ void FieldNode::WriteTo(std::stringstream& ss) const {
 }
 
 // ChainNode 类实现
-ChainNode::ChainNode(Tree* tr, Pos pos, Node* node) : Node(pos), tree_(tr), node_(node) {}
+ChainNode::ChainNode(Tree* tr, Pos pos, Node* node)
+    : Node(pos), tree_(tr), node_(node), fields_(ArenaAllocator<FieldSegment>(tr->GetArena())) {}
 
 std::string ChainNode::String() const {
     return node_->String();
 }
 
 Node* ChainNode::Copy() const {
-    return new ChainNode(tree_, pos_, node_->Copy());
+    return tree_->GetArena()->New<ChainNode>(tree_, pos_, node_->Copy());
 }
 
 void ChainNode::WriteTo(std::stringstream& ss) const {
@@ -293,13 +315,12 @@ void ChainNode::WriteTo(std::stringstream& ss) const {
 }
 
 // 在node.cpp中添加
-void ChainNode::AddField(const std::string& field) {
+void ChainNode::AddField(std::string_view field) {
     // 去掉前导点(如果有)
     if (field.length() > 0 && field[0] == '.') {
-        fields_.push_back(field.substr(1));
-    } else {
-        fields_.push_back(field);
+        field.remove_prefix(1);
     }
+    fields_.push_back(makeSegment(tree_->GetArena()->Intern(field)));
 }
 
 // BoolNode 类实现
@@ -310,7 +331,7 @@ std::string BoolNode::String() const {
 }
 
 Node* BoolNode::Copy() const {
-    return new BoolNode(tree_, pos_, value_);
+    return tree_->GetArena()->New<BoolNode>(tree_, pos_, value_);
 }
 
 void BoolNode::WriteTo(std::stringstream& ss) const {
@@ -318,16 +339,16 @@ void BoolNode::WriteTo(std::stringstream& ss) const {
 }
 
 // NumberNode 类实现
-NumberNode::NumberNode(Tree* tr, Pos pos, const std::string& text) : Node(pos), tree_(tr), text_(text), 
+NumberNode::NumberNode(Tree* tr, Pos pos, std::string_view text) : Node(pos), tree_(tr), text_(tr->GetArena()->Intern(text)), 
       is_int_(false), is_uint_(false), is_float_(false), is_complex_(false),
       int64_(0), uint64_(0), float64_(0.0) {}
 
 std::string NumberNode::String() const {
-    return text_;
+    return std::string(text_);
 }
 
 Node* NumberNode::Copy() const {
-    return new NumberNode(tree_, pos_, text_);
+    return tree_->GetArena()->New<NumberNode>(tree_, pos_, text_);
 }
 
 void NumberNode::WriteTo(std::stringstream& ss) const {
@@ -335,15 +356,15 @@ void NumberNode::WriteTo(std::stringstream& ss) const {
 }
 
 // StringNode 类实现
-StringNode::StringNode(Tree* tr, Pos pos, const std::string& quoted, const std::string& text) 
-    : Node(pos), tree_(tr), quoted_(quoted), text_(text) {}
+StringNode::StringNode(Tree* tr, Pos pos, std::string_view quoted, std::string_view text) 
+    : Node(pos), tree_(tr), quoted_(tr->GetArena()->Intern(quoted)), text_(tr->GetArena()->Intern(text)) {}
 
 std::string StringNode::String() const {
-    return quoted_;
+    return std::string(quoted_);
 }
 
 Node* StringNode::Copy() const {
-    return new StringNode(tree_, pos_, quoted_, text_);
+    return tree_->GetArena()->New<StringNode>(tree_, pos_, quoted_, text_);
 }
 
 void StringNode::WriteTo(std::stringstream& ss) const {
@@ -358,7 +379,7 @@ std::string EndNode::String() const {
 }
 
 Node* EndNode::Copy() const {
-    return new EndNode(tree_, pos_);
+    return tree_->GetArena()->New<EndNode>(tree_, pos_);
 }
 
 void EndNode::WriteTo(std::stringstream& ss) const {
@@ -373,7 +394,7 @@ std::string ElseNode::String() const {
 }
 
 Node* ElseNode::Copy() const {
-    return new ElseNode(tree_, pos_, line_);
+    return tree_->GetArena()->New<ElseNode>(tree_, pos_, line_);
 }
 
 void ElseNode::WriteTo(std::stringstream& ss) const {
@@ -453,7 +474,7 @@ IfNode::IfNode(Tree* tr, Pos pos, int line, PipeNode* pipe,
     : BranchNode(tr, NodeIf, pos, line, pipe, list, elseList) {}
 
 Node* IfNode::Copy() const {
-    return new IfNode(tree_, pos_, line_,
+    return tree_->GetArena()->New<IfNode>(tree_, pos_, line_,
         static_cast<PipeNode*>(pipe_->Copy()),
         static_cast<ListNode*>(list_->Copy()),
         else_list_ ? static_cast<ListNode*>(else_list_->Copy()) : NULL);
@@ -465,7 +486,7 @@ RangeNode::RangeNode(Tree* tr, Pos pos, int line, PipeNode* pipe,
     : BranchNode(tr, NodeRange, pos, line, pipe, list, elseList) {}
 
 Node* RangeNode::Copy() const {
-    return new RangeNode(tree_, pos_, line_,
+    return tree_->GetArena()->New<RangeNode>(tree_, pos_, line_,
         static_cast<PipeNode*>(pipe_->Copy()),
         static_cast<ListNode*>(list_->Copy()),
         else_list_ ? static_cast<ListNode*>(else_list_->Copy()) : NULL);
@@ -477,22 +498,26 @@ WithNode::WithNode(Tree* tr, Pos pos, int line, PipeNode* pipe,
     : BranchNode(tr, NodeWith, pos, line, pipe, list, elseList) {}
 
 Node* WithNode::Copy() const {
-    return new WithNode(tree_, pos_, line_,
+    return tree_->GetArena()->New<WithNode>(tree_, pos_, line_,
         static_cast<PipeNode*>(pipe_->Copy()),
         static_cast<ListNode*>(list_->Copy()),
         else_list_ ? static_cast<ListNode*>(else_list_->Copy()) : NULL);
 }
 
 // TemplateNode 类实现
-TemplateNode::TemplateNode(Tree* tr, Pos pos, int line, const std::string& name, PipeNode* pipe)
-    : Node(pos), tree_(tr), line_(line), name_(name), pipe_(pipe) {}
+TemplateNode::TemplateNode(Tree* tr, Pos pos, int line, std::string_view name, PipeNode* pipe)
+    : Node(pos), tree_(tr), line_(line), name_(tr->GetArena()->Intern(name)), pipe_(pipe) {}
 
 std::string TemplateNode::String() const {
-    return "{{template \"" + name_ + "\" " + pipe_->String() + "}}";
+    if (!pipe_) {
+        return "{{template \"" + std::string(name_) + "\"}}";
+    }
+    return "{{template \"" + std::string(name_) + "\" " + pipe_->String() + "}}";
 }
 
 Node* TemplateNode::Copy() const {
-    return new TemplateNode(tree_, pos_, line_, name_, static_cast<PipeNode*>(pipe_->Copy()));
+    return tree_->GetArena()->New<TemplateNode>(tree_, pos_, line_, name_,
+        pipe_ ? static_cast<PipeNode*>(pipe_->Copy()) : NULL);
 }
 
 void TemplateNode::WriteTo(std::stringstream& ss) const {
@@ -511,7 +536,7 @@ std::string BreakNode::String() const {
 }
 
 Node* BreakNode::Copy() const {
-    return new BreakNode(tree_, pos_, line_);
+    return tree_->GetArena()->New<BreakNode>(tree_, pos_, line_);
 }
 
 void BreakNode::WriteTo(std::stringstream& ss) const {
@@ -526,7 +551,7 @@ std::string ContinueNode::String() const {
 }
 
 Node* ContinueNode::Copy() const {
-    return new ContinueNode(tree_, pos_, line_);
+    return tree_->GetArena()->New<ContinueNode>(tree_, pos_, line_);
 }
 
 void ContinueNode::WriteTo(std::stringstream& ss) const {
@@ -543,7 +568,7 @@ bool IsEmptyTree(const Node* n) {
         case NodeList:
             {
                 const ListNode* l = static_cast<const ListNode*>(n);
-                const std::vector<Node*>& nodes = l->Nodes();
+                const NodeVector& nodes = l->Nodes();
                 for (size_t i = 0; i < nodes.size(); ++i) {
                     if (!IsEmptyTree(nodes[i])) {
                         return false;
@@ -556,7 +581,7 @@ bool IsEmptyTree(const Node* n) {
         case NodeCommand:
             {
                 const CommandNode* c = static_cast<const CommandNode*>(n);
-                const std::vector<Node*>& args = c->Args();
+                const NodeVector& args = c->Args();
                 for (size_t i = 0; i < args.size(); ++i) {
                     if (!IsEmptyTree(args[i])) {
                         return false;
@@ -567,7 +592,7 @@ bool IsEmptyTree(const Node* n) {
         case NodePipe:
             {
                 const PipeNode* p = static_cast<const PipeNode*>(n);
-                const std::vector<CommandNode*>& cmds = p->Cmds();
+                const CommandVector& cmds = p->Cmds();
                 for (size_t i = 0; i < cmds.size(); ++i) {
                     if (!IsEmptyTree(cmds[i])) {
                         return false;
@@ -6,9 +6,17 @@
 #include <map>
 #include <sstream>
 #include <complex>
+#include <string_view>
+#include <cstdint>
+#include <atomic>
+#include "arena.h"
 
 // 前向声明
 class Tree;
+namespace template_engine {
+class TemplateFn;
+class FunctionLib;
+}
 
 // 节点类型
 enum NodeType {
@@ -40,7 +48,39 @@ enum NodeType {
 // 位置类型
 typedef size_t Pos;
 
+class Node;
+class CommandNode;
+class VariableNode;
+
+// 子节点容器：元素存放在所属树集合的Arena中
+typedef std::vector<Node*, ArenaAllocator<Node*> > NodeVector;
+typedef std::vector<CommandNode*, ArenaAllocator<CommandNode*> > CommandVector;
+typedef std::vector<VariableNode*, ArenaAllocator<VariableNode*> > VariableVector;
+
+// 字段路径的一段：不含前导点的字段名（驻留在Arena中）和它的哈希（HashKey，与ValuesMap相同），
+// 在解析时算好，求值时直接按段查找映射
+struct FieldSegment {
+    std::string_view name;
+    uint32_t hash;
+    // 内联缓存：上次找到此字段时它在映射中的位置。结构相同的映射（range的各项、各次渲染的values）
+    // 中字段通常在同一位置，命中时跳过查找。只是提示，使用前总会核对，多个线程同时执行同一棵树时也安全
+    mutable std::atomic<uint32_t> slot;
+
+    FieldSegment() : hash(0), slot(0) {}
+    FieldSegment(const FieldSegment& other)
+        : name(other.name), hash(other.hash), slot(other.slot.load(std::memory_order_relaxed)) {}
+    FieldSegment& operator=(const FieldSegment& other) {
+        name = other.name;
+        hash = other.hash;
+        slot.store(other.slot.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        return *this;
+    }
+};
+typedef std::vector<FieldSegment, ArenaAllocator<FieldSegment> > FieldPath;
+
 // 节点接口
+// 所有节点都由Tree的工厂方法在树集合共享的Arena中构造，不能单独delete；
+// 节点中的字符串是指向源文本或Arena驻留区的视图
 class Node {
 public:
     Node(Pos pos) : pos_(pos) {}
@@ -73,7 +113,7 @@ protected:
 // 文本节点
 class TextNode : public Node {
 public:
-    TextNode(Tree* tr, Pos pos, const std::string& text);
+    TextNode(Tree* tr, Pos pos, std::string_view text);
     
     NodeType Type() const { return NodeText; }
     std::string String() const;
@@ -81,17 +121,17 @@ public:
     Tree* GetTree() const { return tree_; }
     void WriteTo(std::stringstream& ss) const;
     
-    const std::string& Text() const { return text_; }
+    std::string_view Text() const { return text_; }
     
 private:
     Tree* tree_;
-    std::string text_;
+    std::string_view text_;
 };
 
 // 注释节点
 class CommentNode : public Node {
 public:
-    CommentNode(Tree* tr, Pos pos, const std::string& text);
+    CommentNode(Tree* tr, Pos pos, std::string_view text);
     
     NodeType Type() const { return NodeComment; }
     std::string String() const;
@@ -99,11 +139,11 @@ public:
     Tree* GetTree() const { return tree_; }
     void WriteTo(std::stringstream& ss) const;
     
-    const std::string& Text() const { return text_; }
+    std::string_view Text() const { return text_; }
     
 private:
     Tree* tree_;
-    std::string text_;
+    std::string_view text_;
 };
 
 // ListNode保存节点序列
@@ -119,17 +159,19 @@ public:
     
     void Append(Node* node);
     
-    const std::vector<Node*>& Nodes() const { return nodes_; }
+    const NodeVector& Nodes() const { return nodes_; }
+    // 优化遍历（见tree_optimizer.h）就地改写节点序列
+    NodeVector& Nodes() { return nodes_; }
     
 private:
     Tree* tree_;
-    std::vector<Node*> nodes_;
+    NodeVector nodes_;
 };
 
 // 变量节点
 class VariableNode : public Node {
 public:
-    VariableNode(Tree* tr, Pos pos, const std::string& ident);
+    VariableNode(Tree* tr, Pos pos, std::string_view ident);
     
     NodeType Type() const { return NodeVariable; }
     std::string String() const;
@@ -137,11 +179,11 @@ public:
     Tree* GetTree() const { return tree_; }
     void WriteTo(std::stringstream& ss) const;
     
-    const std::string& Ident() const { return ident_; }
+    std::string_view Ident() const { return ident_; }
     
 private:
     Tree* tree_;
-    std::string ident_;
+    std::string_view ident_;
 };
 
 // Dot节点
@@ -177,7 +219,7 @@ private:
 // 字段节点
 class FieldNode : public Node {
 public:
-    FieldNode(Tree* tr, Pos pos, const std::string& ident);
+    FieldNode(Tree* tr, Pos pos, std::string_view ident);
     
     NodeType Type() const { return NodeField; }
     std::string String() const;
@@ -185,11 +227,14 @@ public:
     Tree* GetTree() const { return tree_; }
     void WriteTo(std::stringstream& ss) const;
     
-    const std::string& Ident() const { return ident_; }
+    std::string_view Ident() const { return ident_; }
+    // 去掉前导点后的字段名及其哈希
+    const FieldSegment& Segment() const { return segment_; }
     
 private:
     Tree* tree_;
-    std::string ident_;
+    std::string_view ident_;
+    FieldSegment segment_;
 };
 
 // 链式节点
@@ -206,13 +251,14 @@ public:
     Node* GetNode() const { return node_; }
     
     // 添加字段方法和成员
-    void AddField(const std::string& field);
-    const std::vector<std::string>& Fields() const { return fields_; }
+    void AddField(std::string_view field);
+    // 基础节点之后的各段字段
+    const FieldPath& Fields() const { return fields_; }
     
 private:
     Tree* tree_;
     Node* node_;
-    std::vector<std::string> fields_; // 添加字段列表
+    FieldPath fields_; // 添加字段列表
 };
 
 // 布尔节点
@@ -236,7 +282,7 @@ private:
 // 数字节点
 class NumberNode : public Node {
 public:
-    NumberNode(Tree* tr, Pos pos, const std::string& text);
+    NumberNode(Tree* tr, Pos pos, std::string_view text);
     
     NodeType Type() const { return NodeNumber; }
     std::string String() const;
@@ -254,11 +300,11 @@ public:
     double Float64() const { return float64_; }
     std::complex<double> Complex() const { return complex_; }
     
-    const std::string& Text() const { return text_; }
+    std::string_view Text() const { return text_; }
     
 private:
     Tree* tree_;
-    std::string text_;
+    std::string_view text_;
     bool is_int_;
     bool is_uint_;
     bool is_float_;
@@ -275,7 +321,7 @@ private:
 // 字符串节点
 class StringNode : public Node {
 public:
-    StringNode(Tree* tr, Pos pos, const std::string& quoted, const std::string& text);
+    StringNode(Tree* tr, Pos pos, std::string_view quoted, std::string_view text);
     
     NodeType Type() const { return NodeString; }
     std::string String() const;
@@ -283,13 +329,13 @@ public:
     Tree* GetTree() const { return tree_; }
     void WriteTo(std::stringstream& ss) const;
     
-    std::string Quoted() const { return quoted_; }
-    std::string Text() const { return text_; }
+    std::string_view Quoted() const { return quoted_; }
+    std::string_view Text() const { return text_; }
     
 private:
     Tree* tree_;
-    std::string quoted_; // 带引号的原始文本
-    std::string text_;   // 经过引号处理的字符串
+    std::string_view quoted_; // 带引号的原始文本
+    std::string_view text_;   // 经过引号处理的字符串
 };
 
 // EndNode表示{{end}}动作
@@ -328,7 +374,7 @@ private:
 // 标识符节点
 class IdentifierNode : public Node {
 public:
-    IdentifierNode(Tree* tr, Pos pos, const std::string& ident);
+    IdentifierNode(Tree* tr, Pos pos, std::string_view ident);
     
     NodeType Type() const { return NodeIdentifier; }
     std::string String() const;
@@ -336,11 +382,22 @@ public:
     Tree* GetTree() const { return tree_; }
     void WriteTo(std::stringstream& ss) const;
     
-    const std::string& Ident() const { return ident_; }
+    std::string_view Ident() const { return ident_; }
+
+    // 执行前绑定的函数：lib中名为Ident()的函数（lib中没有时为NULL），执行时不再按名称查找。
+    // 只在树被共享执行之前绑定；未绑定时BoundLibrary()为NULL
+    void BindFunction(const template_engine::FunctionLib* lib, template_engine::TemplateFn* fn) {
+        lib_ = lib;
+        fn_ = fn;
+    }
+    const template_engine::FunctionLib* BoundLibrary() const { return lib_; }
+    template_engine::TemplateFn* BoundFunction() const { return fn_; }
     
 private:
     Tree* tree_;
-    std::string ident_;
+    std::string_view ident_;
+    const template_engine::FunctionLib* lib_;
+    template_engine::TemplateFn* fn_;
 };
 
 // 命令节点
@@ -356,11 +413,13 @@ public:
     
     void Append(Node* arg);
     
-    const std::vector<Node*>& Args() const { return args_; }
+    const NodeVector& Args() const { return args_; }
+    // 特化遍历（见tree_optimizer.h）把已知参数替换为字面量
+    NodeVector& Args() { return args_; }
     
 private:
     Tree* tree_;
-    std::vector<Node*> args_;
+    NodeVector args_;
 };
 
 // 管道节点
@@ -381,15 +440,15 @@ public:
     int Line() const { return line_; }
     bool IsAssign() const { return is_assign_; }
     void SetIsAssign(bool is_assign) { is_assign_ = is_assign; }
-    const std::vector<VariableNode*>& Decl() const { return decl_; }
-    const std::vector<CommandNode*>& Cmds() const { return cmds_; }
+    const VariableVector& Decl() const { return decl_; }
+    const CommandVector& Cmds() const { return cmds_; }
     
 private:
     Tree* tree_;
     int line_;
     bool is_assign_;
-    std::vector<VariableNode*> decl_;
-    std::vector<CommandNode*> cmds_;
+    VariableVector decl_;
+    CommandVector cmds_;
 };
 
 // 动作节点
@@ -428,6 +487,8 @@ public:
     const PipeNode* GetPipe() const { return pipe_; }
     const ListNode* List() const { return list_; }
     const ListNode* ElseList() const { return else_list_; }
+    ListNode* List() { return list_; }
+    ListNode* ElseList() { return else_list_; }
     
 protected:
     Tree* tree_;
@@ -514,7 +575,7 @@ private:
 class TemplateNode : public Node {
 public:
     TemplateNode(Tree* tr, Pos pos, int line, 
-                 const std::string& name, 
+                 std::string_view name, 
                  PipeNode* pipe);
     
     NodeType Type() const { return NodeTemplate; }
@@ -524,13 +585,13 @@ public:
     void WriteTo(std::stringstream& ss) const;
     
     int Line() const { return line_; }
-    std::string Name() const { return name_; }
+    std::string_view Name() const { return name_; }
     const PipeNode* Pipe() const { return pipe_; }
     
 private:
     Tree* tree_;
     int line_;
-    std::string name_;
+    std::string_view name_;
     PipeNode* pipe_;
 };
 
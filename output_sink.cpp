@@ -0,0 +1,129 @@
+// output_sink.cpp
+#include "output_sink.h"
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <unistd.h>
+
+namespace template_engine {
+
+// ================== 输出目标 ==================
+
+void BufferSink::Write(const char* data, size_t size) {
+    size_t room = capacity_ - size_;
+    if (size > room) {
+        overflowed_ = true;
+        size = room;
+    }
+    memcpy(buffer_ + size_, data, size);
+    size_ += size;
+}
+
+void FdSink::Write(const char* data, size_t size) {
+    while (size > 0) {
+        ssize_t n = ::write(fd_, data, size);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::runtime_error(std::string("write failed: ") + strerror(errno));
+        }
+        data += n;
+        size -= static_cast<size_t>(n);
+    }
+}
+
+// ================== BlankLineFoldingBuf ==================
+
+BlankLineFoldingBuf::BlankLineFoldingBuf(OutputSink& sink)
+    : sink_(sink), lineHasContent_(false), wroteAny_(false) {
+    out_.reserve(kBufferSize + 64);
+    setp(in_, in_ + kBufferSize);
+}
+
+BlankLineFoldingBuf::~BlankLineFoldingBuf() {
+    try {
+        drain();
+    } catch (...) {
+        // 析构函数中不抛出异常
+    }
+}
+
+BlankLineFoldingBuf::int_type BlankLineFoldingBuf::overflow(int_type c) {
+    drain();
+    if (!traits_type::eq_int_type(c, traits_type::eof())) {
+        *pptr() = traits_type::to_char_type(c);
+        pbump(1);
+    }
+    return traits_type::not_eof(c);
+}
+
+int BlankLineFoldingBuf::sync() {
+    drain();
+    sink_.Flush();
+    return 0;
+}
+
+// 处理写入区中的字节并交给sink
+void BlankLineFoldingBuf::drain() {
+    if (pptr() > pbase()) {
+        fold(pbase(), pptr() - pbase());
+        setp(in_, in_ + kBufferSize);
+    }
+    if (!out_.empty()) {
+        sink_.Write(out_.data(), out_.size());
+        out_.clear();
+    }
+}
+
+// 与按行读取、丢弃空白行、再以"\n"连接的结果相同：
+// 行的换行符推迟到下一个非空行开始时才输出，行首的空白推迟到行内出现其他字符时才输出
+void BlankLineFoldingBuf::fold(const char* data, size_t size) {
+    const char* p = data;
+    const char* end = data + size;
+    while (p < end) {
+        if (lineHasContent_) {
+            // 整段复制到行尾（不含换行符）
+            const char* nl = static_cast<const char*>(memchr(p, '\n', end - p));
+            if (!nl) {
+                out_.append(p, end - p);
+                return;
+            }
+            out_.append(p, nl - p);
+            lineHasContent_ = false;
+            p = nl + 1;
+            continue;
+        }
+        char c = *p;
+        if (c == '\n') {
+            pending_.clear();
+            ++p;
+        } else if (c == ' ' || c == '\t' || c == '\r') {
+            pending_ += c;
+            ++p;
+        } else {
+            if (wroteAny_) {
+                out_ += '\n';
+            }
+            out_ += pending_;
+            pending_.clear();
+            lineHasContent_ = true;
+            wroteAny_ = true;
+        }
+    }
+}
+
+// ================== SinkStream ==================
+
+SinkStream::SinkStream(OutputSink& sink) : std::ostream(NULL), buf_(sink) {
+    rdbuf(&buf_);
+    // sink抛出的异常原样传给调用者，而不是只设置badbit
+    exceptions(std::ios::badbit);
+}
+
+void SinkStream::Finish() {
+    flush();
+}
+
+} // namespace template_engine
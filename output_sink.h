@@ -0,0 +1,110 @@
+// output_sink.h
+#ifndef TEMPLATE_OUTPUT_SINK_H
+#define TEMPLATE_OUTPUT_SINK_H
+
+#include <functional>
+#include <ostream>
+#include <streambuf>
+#include <string>
+
+namespace template_engine {
+
+// 模板输出的目标
+// Write可能在模板执行期间被多次调用；写入失败时抛出std::runtime_error
+class OutputSink {
+public:
+    virtual ~OutputSink() {}
+    virtual void Write(const char* data, size_t size) = 0;
+    virtual void Flush() {}
+};
+
+// 追加到字符串
+class StringSink : public OutputSink {
+public:
+    explicit StringSink(std::string& out) : out_(out) {}
+    virtual void Write(const char* data, size_t size) { out_.append(data, size); }
+
+private:
+    std::string& out_;
+};
+
+// 写入调用者预先分配的缓冲区；空间不足时丢弃多余的字节并记录溢出
+class BufferSink : public OutputSink {
+public:
+    BufferSink(char* buffer, size_t capacity) : buffer_(buffer), capacity_(capacity), size_(0), overflowed_(false) {}
+    virtual void Write(const char* data, size_t size);
+
+    size_t Size() const { return size_; }
+    bool Overflowed() const { return overflowed_; }
+
+private:
+    char* buffer_;
+    size_t capacity_;
+    size_t size_;
+    bool overflowed_;
+};
+
+// 写入文件描述符（不负责关闭）
+class FdSink : public OutputSink {
+public:
+    explicit FdSink(int fd) : fd_(fd) {}
+    virtual void Write(const char* data, size_t size);
+
+private:
+    int fd_;
+};
+
+// 把每一块输出交给回调
+class CallbackSink : public OutputSink {
+public:
+    typedef std::function<void(const char* data, size_t size)> Callback;
+    explicit CallbackSink(const Callback& callback) : callback_(callback) {}
+    virtual void Write(const char* data, size_t size) { callback_(data, size); }
+
+private:
+    Callback callback_;
+};
+
+// 去除空行的流缓冲区：只由空格、制表符和回车组成的行被丢弃，
+// 其余的行以"\n"连接，末尾不加换行。边写边处理，每攒满一块就交给sink
+class BlankLineFoldingBuf : public std::streambuf {
+public:
+    explicit BlankLineFoldingBuf(OutputSink& sink);
+    virtual ~BlankLineFoldingBuf();
+
+protected:
+    virtual int_type overflow(int_type c);
+    virtual int sync();
+
+private:
+    static const size_t kBufferSize = 4096;
+
+    void fold(const char* data, size_t size);
+    void drain();
+
+    OutputSink& sink_;
+    char in_[kBufferSize];
+    std::string out_;     // 处理后等待交给sink的字节
+    std::string pending_; // 当前行开头的空白，行内出现其他字符前不确定是否输出
+    bool lineHasContent_; // 当前行已经有非空白字符
+    bool wroteAny_;       // 已经输出过至少一行
+
+    BlankLineFoldingBuf(const BlankLineFoldingBuf&);
+    BlankLineFoldingBuf& operator=(const BlankLineFoldingBuf&);
+};
+
+// 写入sink并去除空行的输出流；sink的写入错误会作为异常抛出
+class SinkStream : public std::ostream {
+public:
+    explicit SinkStream(OutputSink& sink);
+
+    // 把缓冲的输出全部交给sink
+    void Finish();
+
+private:
+    BlankLineFoldingBuf buf_;
+};
+
+} // namespace template_engine
+
+#endif // TEMPLATE_OUTPUT_SINK_H
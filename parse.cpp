@@ -1,4 +1,5 @@
 #include "parse.h"
+#include "trace.h"
 #include <stdexcept>
 #include <sstream>
 #include <iostream>
@@ -17,19 +18,18 @@ static std::string buildErrorMsg(const char* format, va_list args) {
 // Tree构造函数
 Tree::Tree(const std::string& name)
     : name_(name), parseName_(name), mode_(ParseNone), root_(NULL),
-      peekCount_(0), actionLine_(0), rangeDepth_(0) {
+      tokens_(NULL), tokenIndex_(0), peekCount_(0), treeSet_(NULL), actionLine_(0), rangeDepth_(0) {
     vars_.push_back("$"); // 初始变量
 }
 
 Tree::Tree(const std::string& name, const std::vector<std::map<std::string, std::string> >& funcs)
     : name_(name), parseName_(name), mode_(ParseNone), root_(NULL),
-      funcs_(funcs), peekCount_(0), actionLine_(0), rangeDepth_(0) {
+      funcs_(funcs), tokens_(NULL), tokenIndex_(0), peekCount_(0), treeSet_(NULL), actionLine_(0), rangeDepth_(0) {
     vars_.push_back("$"); // 初始变量
 }
 
-// 析构函数 - 释放自己拥有的资源
+// 析构函数 - 节点属于共享的Arena，最后一个引用它的树销毁时整体释放
 Tree::~Tree() {
-    delete root_;
 }
 
 // 创建一个新的解析树
@@ -40,18 +40,27 @@ Tree* Tree::Copy() const {
     
     Tree* copy = new Tree(name_);
     copy->parseName_ = parseName_;
+    copy->arena_ = arena_;
     copy->root_ = static_cast<ListNode*>(root_->Copy());
     copy->text_ = text_;
     
     return copy;
 }
 
+// 从token缓冲区按下标读取下一个token，越过末尾时一直返回最后的EOF/错误token
+Item Tree::nextToken() {
+    if (tokenIndex_ + 1 < tokens_->size()) {
+        return tokens_->at(tokenIndex_++);
+    }
+    return tokens_->at(tokens_->size() - 1);
+}
+
 // 获取下一个token
 Item Tree::next() {
     if (peekCount_ > 0) {
         peekCount_--;
     } else {
-        token_[0] = lex_->nextItem();
+        token_[0] = nextToken();
     }
     return token_[peekCount_];
 }
@@ -80,7 +89,7 @@ Item Tree::peek() {
         return token_[peekCount_ - 1];
     }
     peekCount_ = 1;
-    token_[0] = lex_->nextItem();
+    token_[0] = nextToken();
     return token_[0];
 }
 
@@ -110,57 +119,63 @@ std::map<std::string, Tree*> Tree::Parse(
     const std::string& leftDelim, 
     const std::string& rightDelim,
     const std::vector<std::map<std::string, std::string> >& funcs) {
+    // 源文本只复制这一次，之后词法分析器和所有子树共享同一个缓冲区
+    return Parse(name, std::make_shared<const std::string>(text), leftDelim, rightDelim, funcs);
+}
+
+std::map<std::string, Tree*> Tree::Parse(
+    const std::string& name, 
+    const std::shared_ptr<const std::string>& text, 
+    const std::string& leftDelim, 
+    const std::string& rightDelim,
+    const std::vector<std::map<std::string, std::string> >& funcs) {
     
-    std::cout << "开始解析模板: " << name << std::endl;
+    TE_TRACE(TraceParse, TraceInfo, "开始解析模板: " << name);
     // 创建结果容器
     std::map<std::string, Tree*> treeSet;
     
     try {
         // 创建树对象
         Tree* t = new Tree(name, funcs);
-        t->text_ = text;
-        std::cout << "创建Tree对象成功" << std::endl;
+        t->text_ = text ? text : std::make_shared<const std::string>();
+        TE_TRACE(TraceParse, TraceDebug, "创建Tree对象成功");
         
         try {
-            std::cout << "调用Tree::Parse实例方法" << std::endl;
+            TE_TRACE(TraceParse, TraceDebug, "调用Tree::Parse实例方法");
             // 传入 treeSet 的引用
-            Tree* result = t->Parse(text, leftDelim, rightDelim, treeSet, funcs);
-            std::cout << "Tree::Parse实例方法完成，treeSet大小: " << treeSet.size() << std::endl;
+            t->Parse(*t->text_, leftDelim, rightDelim, treeSet, funcs);
+            TE_TRACE(TraceParse, TraceDebug, "Tree::Parse实例方法完成，treeSet大小: " << treeSet.size());
             
             // 检查每个树的内容
             std::map<std::string, Tree*>::iterator it;
-            for (it = treeSet.begin(); it != treeSet.end(); ++it) {
-                std::string treeName = it->first;
+            for (it = treeSet.begin(); TE_TRACE_ENABLED(TraceParse, TraceDebug) && it != treeSet.end(); ++it) {
                 Tree* tree = it->second;
                 
-                std::cout << "树集合中的树: " << treeName << std::endl;
+                TE_TRACE(TraceParse, TraceDebug, "树集合中的树: " << it->first);
                 if (tree && tree->GetRoot()) {
-                    std::cout << "  根节点类型: " << static_cast<int>(tree->GetRoot()->Type()) << std::endl;
-                    std::cout << "  子节点数量: " << (tree->GetRoot()->Type() == NodeList ? 
-                             static_cast<const ListNode*>(tree->GetRoot())->Nodes().size() : 0) << std::endl;
+                    TE_TRACE(TraceParse, TraceDebug, "  根节点类型: " << static_cast<int>(tree->GetRoot()->Type()));
+                    TE_TRACE(TraceParse, TraceDebug, "  子节点数量: " << (tree->GetRoot()->Type() == NodeList ? 
+                             static_cast<const ListNode*>(tree->GetRoot())->Nodes().size() : 0));
                 } else {
-                    std::cout << "  树为空或没有根节点" << std::endl;
+                    TE_TRACE(TraceParse, TraceDebug, "  树为空或没有根节点");
                 }
             }
             
-            // 如果 treeSet 为空，则手动添加主树
-            if (treeSet.empty() && t->GetRoot()) {
-                treeSet[name] = t;
-                std::cout << "手动添加主树，现在treeSet大小: " << treeSet.size() << std::endl;
-            } else {
-                // 如果已经添加到treeSet，就不需要原始树了
+            // 主树已经由add()交给treeSet；没有被接管时（例如与已有的非空定义同名且自身为空）才释放
+            std::map<std::string, Tree*>::iterator self = treeSet.find(name);
+            if (self == treeSet.end() || self->second != t) {
                 delete t;
             }
             
             // 返回 treeSet
             return treeSet;
         } catch (const ParseError& e) {
-            std::cerr << "解析错误: " << e.what() << std::endl;
+            TE_TRACE(TraceParse, TraceError, "解析错误: " << e.what());
             delete t; // 清理资源
             throw;
         }
     } catch (const std::exception& e) {
-        std::cerr << "异常: " << e.what() << std::endl;
+        TE_TRACE(TraceParse, TraceError, "异常: " << e.what());
         // 清理已生成的树
         std::map<std::string, Tree*>::iterator it;
         for (it = treeSet.begin(); it != treeSet.end(); ++it) {
@@ -178,14 +193,34 @@ Tree* Tree::Parse(
     std::map<std::string, Tree*>& treeSet,
     const std::vector<std::map<std::string, std::string> >& funcs) {
     
-    // 创建词法分析器
-    Lexer* lex = createLexer(name_, text, leftDelim, rightDelim);
+    // 如果text不是已共享的源缓冲区，则复制一份
+    if (!text_ || text_->data() != text.data()) {
+        text_ = std::make_shared<const std::string>(text);
+    }
+    
+    // 所有节点从Arena分配；节点字符串直接引用保留在Arena中的源文本
+    if (!arena_) {
+        arena_ = std::make_shared<Arena>();
+    }
+    arena_->Retain(text_);
+    
+    // 创建零拷贝词法分析器，一次性把所有token写入结构数组缓冲区
+    TokenBuffer tokens;
+    {
+        Lexer lex(name_, text_, leftDelim, rightDelim);
+        LexOptions options;
+        options.zeroCopy = true;
+        lex.setOptions(options);
+        lex.tokenize(tokens);
+    }
     
     // 开始解析
-    startParse(funcs, lex, treeSet);
+    startParse(funcs, &tokens, 0, treeSet);
     
-    // 执行解析过程
-        parse();
+    // 执行解析过程，完成后把自己交给treeSet
+    parse();
+    add();
+    stopParse();
     
     // 返回这个树
     return this;
@@ -194,24 +229,36 @@ Tree* Tree::Parse(
 // 开始解析，设置初始环境
 void Tree::startParse(
     const std::vector<std::map<std::string, std::string> >& funcs,
-    Lexer* lex,
+    const TokenBuffer* tokens,
+    size_t tokenIndex,
     std::map<std::string, Tree*>& treeSet) {
     
     funcs_ = funcs;
-    lex_ = lex;
-    treeSet_ = treeSet;
+    tokens_ = tokens;
+    tokenIndex_ = tokenIndex;
+    treeSet_ = &treeSet;
 }
 
 // 停止解析，清理资源
 void Tree::stopParse() {
-    lex_ = NULL; // 不负责Lexer的释放
-    treeSet_.clear(); // 清除引用
+    tokens_ = NULL; // 不负责token缓冲区的释放
+    treeSet_ = NULL; // 不负责treeSet的释放
 }
 
-// 将当前树添加到treeSet
+// 将当前树添加到treeSet，treeSet直接接管这棵树（不复制）
+// 同名的树已存在时：旧树为空则被替换，新树为空则忽略，否则报重复定义
 void Tree::add() {
-    std::string name = name_;  // 获取正在解析的模板名称
-    treeSet_[name] = Copy();
+    std::map<std::string, Tree*>::iterator it = treeSet_->find(name_);
+    if (it == treeSet_->end() || it->second == NULL || IsEmptyTree(it->second->GetRoot())) {
+        if (it != treeSet_->end() && it->second != this) {
+            delete it->second;
+        }
+        (*treeSet_)[name_] = this;
+        return;
+    }
+    if (!IsEmptyTree(root_)) {
+        errorf("template: multiple definition of template %s", name_.c_str());
+    }
 }
 
 // 抛出错误
@@ -224,7 +271,6 @@ void Tree::errorf(const char* format, ...) {
                       buildErrorMsg(format, args);
     va_end(args);
     
-    delete root_;
     root_ = NULL;
     throw ParseError(msg);
 }
@@ -261,7 +307,7 @@ void Tree::unexpected(const Item& token, const std::string& context) {
             oss << actionLine_;
             extra = " in action started at " + parseName_ + ":" + oss.str();
         }
-        errorf("%s%s", token.val.c_str(), extra.c_str());
+        errorf("%s%s", std::string(token.text).c_str(), extra.c_str());
     }
     errorf("unexpected %s in %s", token.toString().c_str(), context.c_str());
 }
@@ -288,15 +334,14 @@ void Tree::popVars(size_t n) {
 }
 
 // 使用变量，如果未定义则报错
-VariableNode* Tree::useVar(Pos pos, const std::string& name) {
+VariableNode* Tree::useVar(Pos pos, std::string_view name) {
     VariableNode* v = newVariable(pos, name);
     for (size_t i = 0; i < vars_.size(); ++i) {
         if (vars_[i] == v->Ident()) {
             return v;
         }
     }
-    std::string ident = v->Ident();
-    delete v;
+    std::string ident(v->Ident());
     errorf("undefined variable %s", ident.c_str());
     return NULL; // 不会到达这里
 }
@@ -309,7 +354,7 @@ std::pair<std::string, std::string> Tree::ErrorContext(const Node* n) const {
         nodeTree = const_cast<Tree*>(this);
     }
     
-    std::string text = nodeTree->text_.substr(0, pos);
+    std::string text = nodeTree->text_ ? nodeTree->text_->substr(0, pos) : std::string();
     size_t byteNum = text.find_last_of('\n');
     if (byteNum == std::string::npos) {
         byteNum = pos; // 在第一行
@@ -335,7 +380,7 @@ std::pair<std::string, std::string> Tree::ErrorContext(const Node* n) const {
 
 // 主解析方法
 void Tree::parse() {
-    std::cout << "开始解析模板: " << name_ << std::endl;
+    TE_TRACE(TraceParse, TraceInfo, "开始解析模板: " << name_);
     
     // 创建根节点
     root_ = newList(peek().pos);
@@ -344,9 +389,9 @@ void Tree::parse() {
     while (peek().type != ItemEOF) {
         // 输出当前标记信息
         Item token = peek();
-        std::cout << "当前标记: 类型=" << itemTypeToString(token.type) 
-                 << " 值=\"" << token.val << "\" 行=" << token.line 
-                 << " 位置=" << token.pos << std::endl;
+        TE_TRACE(TraceParse, TraceDebug, "当前标记: 类型=" << itemTypeToString(token.type) 
+                 << " 值=\"" << token.text << "\" 行=" << token.line 
+                 << " 位置=" << token.pos);
 
         // 处理模板定义
         if (token.type == ItemLeftDelim) {
@@ -355,44 +400,49 @@ void Tree::parse() {
             
             // 查看后续是否是定义
             Item next = nextNonSpace();
-            std::cout << "  检查是否是定义: " << itemTypeToString(next.type) << std::endl;
+            TE_TRACE(TraceParse, TraceDebug, "  检查是否是定义: " << itemTypeToString(next.type));
             
             if (next.type == ItemDefine) {
                 // 处理模板定义
-                std::cout << "  发现模板定义，创建子模板" << std::endl;
-                Tree* newT = new Tree("definition");
+                TE_TRACE(TraceParse, TraceDebug, "  发现模板定义，创建子模板");
+                std::unique_ptr<Tree> newT(new Tree("definition"));
                 newT->text_ = text_;
+                newT->arena_ = arena_;
                 newT->mode_ = mode_;
                 newT->parseName_ = parseName_;
-                newT->startParse(funcs_, lex_, treeSet_);
+                newT->startParse(funcs_, tokens_, tokenIndex_, *treeSet_);
                 newT->parseDefinition();
+                tokenIndex_ = newT->tokenIndex_; // 子树消费过的token不再重复读取
+                // parseDefinition通过add()把子树交给treeSet；被忽略的空定义在这里释放
+                std::map<std::string, Tree*>::iterator added = treeSet_->find(newT->name_);
+                if (added != treeSet_->end() && added->second == newT.get()) {
+                    newT.release();
+                }
                 continue;
             }
             
             // 不是定义，回退所有token
-            std::cout << "  不是定义，回退token" << std::endl;
+            TE_TRACE(TraceParse, TraceDebug, "  不是定义，回退token");
             backup2(delim);
         }
         
         // 解析文本或动作
-        std::cout << "解析文本或动作..." << std::endl;
+        TE_TRACE(TraceParse, TraceDebug, "解析文本或动作...");
         Node* n = textOrAction();
         
         // 处理end和else特殊情况
         if (n->Type() == NodeEnd || n->Type() == NodeElse) {
             std::string errorStr = n->String();
-            delete n;
             errorf("unexpected %s", errorStr.c_str());
         } else {
             // 打印节点信息
-            std::cout << "添加节点: 类型=" << n->Type() 
-                     << " 位置=" << n->Position() << std::endl;
-            std::cout << std::endl; // 打印空行
+            TE_TRACE(TraceParse, TraceDebug, "添加节点: 类型=" << n->Type() 
+                     << " 位置=" << n->Position());
             root_->Append(n);
         }
     }
     
-    std::cout << "模板解析完成: " << name_ << std::endl;
+    TE_TRACE(TraceParse, TraceInfo, "模板解析完成: " << name_);
 }
 
 // 解析定义
@@ -401,7 +451,7 @@ void Tree::parseDefinition() {
     Item name = expectOneOf(ItemString, ItemRawString, context);
     
     // 去掉字符串的引号
-    std::string nameStr = name.val;
+    std::string nameStr(name.text);
     // 简单的去引号实现
     if (!nameStr.empty() && (nameStr[0] == '"' || nameStr[0] == '`') && 
         nameStr[nameStr.length() - 1] == nameStr[0]) {
@@ -419,13 +469,9 @@ void Tree::parseDefinition() {
     
     if (end->Type() != NodeEnd) {
         std::string errorStr = end->String();
-        delete list;
-        delete end;
         errorf("unexpected %s in %s", errorStr.c_str(), context.c_str());
     }
     
-    delete root_;
-    delete end;
     root_ = list;
     add();
     stopParse();
@@ -450,37 +496,37 @@ std::pair<ListNode*, Node*> Tree::itemList() {
 // 解析文本或动作
 Node* Tree::textOrAction() {
     Item token = nextNonSpace();
-    std::cout << "处理token: 类型=" << itemTypeToString(token.type) 
-             << " 值=\"" << token.val << "\"" << std::endl;
+    TE_TRACE(TraceParse, TraceDebug, "处理token: 类型=" << itemTypeToString(token.type) 
+             << " 值=\"" << token.text << "\"");
     
     Node* result = NULL;
     
     switch (token.type) {
         case ItemText:
-            std::cout << "  创建文本节点" << std::endl;
-            result = newText(token.pos, token.val);
+            TE_TRACE(TraceParse, TraceDebug, "  创建文本节点");
+            result = newText(token.pos, token.text);
             break;
             
         case ItemLeftDelim:
-            std::cout << "  开始解析动作" << std::endl;
+            TE_TRACE(TraceParse, TraceDebug, "  开始解析动作");
             actionLine_ = token.line;
             result = action();
             clearActionLine();
             break;
             
         case ItemComment:
-            std::cout << "  创建注释节点" << std::endl;
-            result = newComment(token.pos, token.val);
+            TE_TRACE(TraceParse, TraceDebug, "  创建注释节点");
+            result = newComment(token.pos, token.text);
             break;
             
         default:
-            std::cout << "  遇到意外token: " << itemTypeToString(token.type) << std::endl;
+            TE_TRACE(TraceParse, TraceDebug, "  遇到意外token: " << itemTypeToString(token.type));
             unexpected(token, "input");
             break; // 不会到达这里
     }
     
     if (result) {
-        std::cout << "  创建节点: 类型=" << result->Type() << std::endl;
+        TE_TRACE(TraceParse, TraceDebug, "  创建节点: 类型=" << result->Type());
     }
     
     return result;
@@ -499,7 +545,45 @@ PipeNode* Tree::pipeline(const std::string& context, ItemType end) {
     Item token = peekNonSpace();
     PipeNode* pipe = newPipeline(token.pos, token.line);
     
-    std::cout << "解析pipeline，期望的结束标记: " << itemTypeToString(end) << std::endl;
+    TE_TRACE(TraceParse, TraceDebug, "解析pipeline，期望的结束标记: " << itemTypeToString(end));
+    
+    // 变量声明：$x := 管道 或 $x = 管道；range 还允许 $k, $v := 管道
+    for (;;) {
+        Item v = peekNonSpace();
+        if (v.type != ItemVariable) {
+            break;
+        }
+        next();
+        Item tokenAfterVariable = peek();
+        Item following = peekNonSpace();
+        if (following.type == ItemAssign || following.type == ItemDeclare) {
+            pipe->SetIsAssign(following.type == ItemAssign);
+            nextNonSpace();
+            pipe->AddDecl(newVariable(v.pos, v.text));
+            vars_.push_back(std::string(v.text));
+            break;
+        }
+        if (following.type == ItemChar && following.text == ",") {
+            nextNonSpace();
+            pipe->AddDecl(newVariable(v.pos, v.text));
+            vars_.push_back(std::string(v.text));
+            if (context == "range" && pipe->Decl().size() < 2) {
+                ItemType t = peekNonSpace().type;
+                if (t == ItemVariable || t == ItemRightDelim || t == ItemRightParen) {
+                    continue;
+                }
+                errorf("range can only initialize variables");
+            }
+            errorf("too many declarations in %s", context.c_str());
+        }
+        // 不是声明，把变量token退回去
+        if (tokenAfterVariable.type == ItemSpace) {
+            backup3(v, tokenAfterVariable);
+        } else {
+            backup2(v);
+        }
+        break;
+    }
     
     // 创建一个命令节点
     CommandNode* cmd = newCommand(token.pos);
@@ -515,20 +599,18 @@ PipeNode* Tree::pipeline(const std::string& context, ItemType end) {
             }
             // 合并为ChainNode或FieldNode
             if (fieldBuffer.size() == 1) {
-                FieldNode* baseField = newField(fieldBuffer[0].pos, fieldBuffer[0].val);
+                FieldNode* baseField = newField(fieldBuffer[0].pos, fieldBuffer[0].text);
                 cmd->Append(baseField);
-                std::cout << "    添加单个字段节点: " << fieldBuffer[0].val << std::endl;
+                TE_TRACE(TraceParse, TraceDebug, "    添加单个字段节点: " << fieldBuffer[0].text);
             } else {
-                FieldNode* baseField = newField(fieldBuffer[0].pos, fieldBuffer[0].val);
+                FieldNode* baseField = newField(fieldBuffer[0].pos, fieldBuffer[0].text);
                 ChainNode* chainNode = newChain(fieldBuffer[0].pos, baseField);
                 for (size_t i = 1; i < fieldBuffer.size(); ++i) {
-                    std::string name = fieldBuffer[i].val;
+                    std::string_view name = fieldBuffer[i].text;
                     if (i > 0 && !name.empty() && name[0] == '.') name = name.substr(1);
-                    if (i > 0) std::cout << ".";
-                    std::cout << name;
                     chainNode->AddField(name);
                 }
-                std::cout << std::endl;
+                TE_TRACE(TraceParse, TraceDebug, "    添加链式字段节点: " << chainNode->String());
                 cmd->Append(chainNode);
             }
             continue;
@@ -540,49 +622,47 @@ PipeNode* Tree::pipeline(const std::string& context, ItemType end) {
         token = nextNonSpace();
         switch (token.type) {
             case ItemDot:
-                std::cout << "    添加点节点" << std::endl;
+                TE_TRACE(TraceParse, TraceDebug, "    添加点节点");
                 cmd->Append(newDot(token.pos));
                 break;
             case ItemIdentifier:
-                std::cout << "    添加标识符节点: " << token.val << std::endl;
-                cmd->Append(newIdentifier(token.pos, token.val));
+                TE_TRACE(TraceParse, TraceDebug, "    添加标识符节点: " << token.text);
+                cmd->Append(newIdentifier(token.pos, token.text));
                 break;
             case ItemString: {
-                std::string s = token.val;
+                std::string_view s = token.text;
                 if (s.length() >= 2 && s[0] == '"' && s[s.length()-1] == '"') {
                     s = s.substr(1, s.length()-2);
                 }
-                std::cout << "    添加字符串节点: " << s << std::endl;
-                cmd->Append(newString(token.pos, token.val, s));
+                TE_TRACE(TraceParse, TraceDebug, "    添加字符串节点: " << s);
+                cmd->Append(newString(token.pos, token.text, s));
                 break;
             }
             case ItemBool:
-                std::cout << "    添加布尔节点: " << token.val << std::endl;
-                cmd->Append(newBool(token.pos, token.val == "true"));
+                TE_TRACE(TraceParse, TraceDebug, "    添加布尔节点: " << token.text);
+                cmd->Append(newBool(token.pos, token.text == "true"));
                 break;
             case ItemNumber:
-                std::cout << "    添加数字节点: " << token.val << std::endl;
-                cmd->Append(newNumber(token.pos, token.val));
+                TE_TRACE(TraceParse, TraceDebug, "    添加数字节点: " << token.text);
+                cmd->Append(newNumber(token.pos, token.text));
                 break;
             case ItemPipe:
-                std::cout << "    结束当前命令，开始新命令" << std::endl;
+                TE_TRACE(TraceParse, TraceDebug, "    结束当前命令，开始新命令");
                 pipe->Append(cmd);
                 cmd = newCommand(token.pos);
                 break;
             case ItemVariable:
-                std::cout << "    添加变量节点: " << token.val << std::endl;
-                cmd->Append(useVar(token.pos, token.val));
+                TE_TRACE(TraceParse, TraceDebug, "    添加变量节点: " << token.text);
+                cmd->Append(useVar(token.pos, token.text));
                 break;
             case ItemLeftParen: {
-                std::cout << "    解析括号表达式参数..." << std::endl;
+                TE_TRACE(TraceParse, TraceDebug, "    解析括号表达式参数...");
                 PipeNode* subPipe = pipeline("parenthesized pipeline", ItemRightParen);
                 cmd->Append(subPipe);
                 break;
             }
             default:
-                std::cout << "    未知token类型: " << itemTypeToString(token.type) << std::endl;
-                delete pipe;
-                delete cmd;
+                TE_TRACE(TraceParse, TraceDebug, "    未知token类型: " << itemTypeToString(token.type));
                 unexpected(token, context);
                 return NULL;
         }
@@ -596,11 +676,10 @@ PipeNode* Tree::pipeline(const std::string& context, ItemType end) {
     // 确保找到结束标记
     Item endToken = nextNonSpace();
     if (endToken.type != end) {
-        std::cout << "  未找到期望的结束标记，得到: " << itemTypeToString(endToken.type) << std::endl;
-        delete pipe;
+        TE_TRACE(TraceParse, TraceDebug, "  未找到期望的结束标记，得到: " << itemTypeToString(endToken.type));
         unexpected(endToken, context);
     } else {
-        std::cout << "  找到结束标记: " << itemTypeToString(endToken.type) << std::endl;
+        TE_TRACE(TraceParse, TraceDebug, "  找到结束标记: " << itemTypeToString(endToken.type));
     }
     
     return pipe;
@@ -613,6 +692,7 @@ Tree::ControlResult Tree::parseControl(bool allowElseIf, const std::string& cont
     int line = token.line;
     ListNode* list = NULL;
     ListNode* elseList = NULL;
+    size_t varsLen = vars_.size(); // 控制结构中声明的变量在end之后失效
     
     PipeNode* pipe = pipeline(context, ItemRightDelim); // 现在 pipeline 从正确的 token 开始解析
     
@@ -632,22 +712,16 @@ Tree::ControlResult Tree::parseControl(bool allowElseIf, const std::string& cont
             elseList = tempElseList;
             
             // 继续解析，等待end
-            delete tempNext;
             result = itemList();
             list = tempList;
             tempNext = result.second;
             
             if (tempNext->Type() != NodeEnd) {
                 std::string errorStr = tempNext->String();
-                delete tempList;
-                delete tempNext;
-                delete pipe;
-                delete elseList;
                 errorf("expected end; found %s", errorStr.c_str());
             }
         } else {
             // 普通else
-            delete tempNext;
             result = itemList();
             elseList = result.first;
             tempNext = result.second;
@@ -655,24 +729,16 @@ Tree::ControlResult Tree::parseControl(bool allowElseIf, const std::string& cont
             
             if (tempNext->Type() != NodeEnd) {
                 std::string errorStr = tempNext->String();
-                delete tempList;
-                delete tempNext;
-                delete pipe;
-                delete elseList;
                 errorf("expected end; found %s", errorStr.c_str());
             }
         }
     } else if (tempNext->Type() != NodeEnd) {
         std::string errorStr = tempNext->String();
-        delete tempList;
-        delete tempNext;
-        delete pipe;
         errorf("expected end; found %s", errorStr.c_str());
     } else {
         list = tempList;
     }
     
-    delete tempNext; // 删除end节点
     
     // 构造返回结果
     Tree::ControlResult cr;
@@ -682,6 +748,7 @@ Tree::ControlResult Tree::parseControl(bool allowElseIf, const std::string& cont
     cr.list = list;
     cr.elseList = elseList;
     
+    popVars(varsLen);
     return cr;
 }
 
@@ -694,48 +761,48 @@ Tree::ControlResult::~ControlResult() {
 // 解析动作
 Node* Tree::action() {
     Item token = nextNonSpace();
-    std::cout << "动作token: 类型=" << itemTypeToString(token.type) 
-             << " 值=\"" << token.val << "\"" << std::endl;
+    TE_TRACE(TraceParse, TraceDebug, "动作token: 类型=" << itemTypeToString(token.type) 
+             << " 值=\"" << token.text << "\"");
     
     switch (token.type) {
         case ItemBlock:
-            std::cout << "  解析block控制" << std::endl;
+            TE_TRACE(TraceParse, TraceDebug, "  解析block控制");
             return blockControl();
             
         case ItemBreak:
-            std::cout << "  解析break控制" << std::endl;
+            TE_TRACE(TraceParse, TraceDebug, "  解析break控制");
             return breakControl(token.pos, token.line);
             
         case ItemContinue:
-            std::cout << "  解析continue控制" << std::endl;
+            TE_TRACE(TraceParse, TraceDebug, "  解析continue控制");
             return continueControl(token.pos, token.line);
             
         case ItemElse:
-            std::cout << "  解析else控制" << std::endl;
+            TE_TRACE(TraceParse, TraceDebug, "  解析else控制");
             return elseControl();
             
         case ItemEnd:
-            std::cout << "  解析end控制" << std::endl;
+            TE_TRACE(TraceParse, TraceDebug, "  解析end控制");
             return endControl();
             
         case ItemIf:
-            std::cout << "  解析if控制" << std::endl;
+            TE_TRACE(TraceParse, TraceDebug, "  解析if控制");
             return ifControl();
             
         case ItemRange:
-            std::cout << "  解析range控制" << std::endl;
+            TE_TRACE(TraceParse, TraceDebug, "  解析range控制");
             return rangeControl();
             
         case ItemTemplate:
-            std::cout << "  解析template控制" << std::endl;
+            TE_TRACE(TraceParse, TraceDebug, "  解析template控制");
             return templateControl();
             
         case ItemWith:
-            std::cout << "  解析with控制" << std::endl;
+            TE_TRACE(TraceParse, TraceDebug, "  解析with控制");
             return withControl();
             
         default:
-            std::cout << "  解析普通action" << std::endl;
+            TE_TRACE(TraceParse, TraceDebug, "  解析普通action");
             backup();
             return newAction(peek().pos, peek().line, pipeline("command", ItemRightDelim));
     }
@@ -781,18 +848,8 @@ Node* Tree::elseControl() {
 // 解析if控制
 Node* Tree::ifControl() {
     // std::cout << "  解析if控制" << std::endl;
-    std::cout << "  解析if控制 (通用)" << std::endl; // 区分日志
-    
-    // --- 移除 eq 函数的特殊硬编码处理 --- 
-    /*
-    Item peekItem = peekNonSpace();
-    if (peekItem.type == ItemIdentifier && peekItem.val == "eq") {
-        // ... (大量被删除的 eq 特殊处理代码) ...
-        return newIf(peekItem.pos, peekItem.line, pipe, body, elseBody);
-    }
-    */
+    TE_TRACE(TraceParse, TraceDebug, "  解析if控制 (通用)"); // 区分日志
     
-// normal_if: // 标签不再需要
     // 常规if解析，交给 parseControl 处理
     ControlResult cr = parseControl(true, "if");
     return newIf(cr.pos, cr.line, cr.pipe, cr.list, cr.elseList);
@@ -819,11 +876,23 @@ Node* Tree::endControl() {
 
 // 解析模板控制
 Node* Tree::templateControl() {
-    Item token = expect(ItemRightDelim, "template");
-    // TODO: 当前实现是空的，如果需要实际处理 {{template}}，需要补充逻辑
-    Node* n = NULL;
-    std::cout << "  (STUB) 解析template控制" << std::endl; // 添加日志
-    return n; // 返回 NULL，暂不创建 TemplateNode
+    const std::string context = "template clause";
+    Item token = nextNonSpace();
+    if (token.type != ItemString && token.type != ItemRawString) {
+        unexpected(token, context);
+    }
+    // 去掉模板名称的引号
+    std::string_view name = token.text;
+    if (name.size() >= 2) {
+        name = name.substr(1, name.size() - 2);
+    }
+    // 模板名称之后可以跟一个管道作为模板的dot
+    PipeNode* pipe = NULL;
+    if (nextNonSpace().type != ItemRightDelim) {
+        backup();
+        pipe = pipeline(context, ItemRightDelim);
+    }
+    return newTemplate(token.pos, token.line, name, pipe);
 }
 
 // 解析操作数
@@ -3,6 +3,7 @@
 
 #include "node.h"
 #include <string>
+#include <memory>
 
 #include <vector>
 #include <map>
@@ -56,20 +57,20 @@ public:
     
     // 创建新节点的工厂方法 - 全部使用裸指针
     ListNode* newList(Pos pos);
-    TextNode* newText(Pos pos, const std::string& text);
-    CommentNode* newComment(Pos pos, const std::string& text);
+    TextNode* newText(Pos pos, std::string_view text);
+    CommentNode* newComment(Pos pos, std::string_view text);
     
     ActionNode* newAction(Pos pos, int line, PipeNode* pipe);
     CommandNode* newCommand(Pos pos);
-    VariableNode* newVariable(Pos pos, const std::string& ident);
-    IdentifierNode* newIdentifier(Pos pos, const std::string& ident);
+    VariableNode* newVariable(Pos pos, std::string_view ident);
+    IdentifierNode* newIdentifier(Pos pos, std::string_view ident);
     DotNode* newDot(Pos pos);
     NilNode* newNil(Pos pos);
-    FieldNode* newField(Pos pos, const std::string& ident);
+    FieldNode* newField(Pos pos, std::string_view ident);
     ChainNode* newChain(Pos pos, Node* node);
     BoolNode* newBool(Pos pos, bool b);
-    NumberNode* newNumber(Pos pos, const std::string& text);
-    StringNode* newString(Pos pos, const std::string& orig, const std::string& text);
+    NumberNode* newNumber(Pos pos, std::string_view text);
+    StringNode* newString(Pos pos, std::string_view orig, std::string_view text);
     EndNode* newEnd(Pos pos);
     ElseNode* newElse(Pos pos, int line);
     IfNode* newIf(Pos pos, int line, PipeNode* pipe, 
@@ -78,7 +79,7 @@ public:
                                 ListNode* list, ListNode* elseList);
     WithNode* newWith(Pos pos, int line, PipeNode* pipe, 
                                ListNode* list, ListNode* elseList);
-    TemplateNode* newTemplate(Pos pos, int line, const std::string& name, PipeNode* pipe);
+    TemplateNode* newTemplate(Pos pos, int line, std::string_view name, PipeNode* pipe);
     BreakNode* newBreak(Pos pos, int line);
     ContinueNode* newContinue(Pos pos, int line);
     PipeNode* newPipeline(Pos pos, int line, const std::vector<VariableNode*>& vars = std::vector<VariableNode*>());
@@ -96,6 +97,13 @@ public:
         const std::string& leftDelim, 
         const std::string& rightDelim,
         const std::vector<std::map<std::string, std::string> >& funcs = std::vector<std::map<std::string, std::string> >());
+    // 同上，但所有树直接共享调用者读入的缓冲区text，不再复制源文本
+    static std::map<std::string, Tree*> Parse(
+        const std::string& name, 
+        const std::shared_ptr<const std::string>& text, 
+        const std::string& leftDelim, 
+        const std::string& rightDelim,
+        const std::vector<std::map<std::string, std::string> >& funcs = std::vector<std::map<std::string, std::string> >());
 
     std::string GetName() const { return name_; }
     void SetName(const std::string& name) { name_ = name; }
@@ -104,29 +112,38 @@ public:
     Mode GetMode() const { return mode_; }
     void SetMode(Mode mode) { mode_ = mode; }
     const ListNode* GetRoot() const { return root_; }
-    
+    ListNode* GetRoot() { return root_; }
+    Arena* GetArena() const { return arena_.get(); }
+    const std::shared_ptr<const std::string>& GetText() const { return text_; }
+    // 树中所有函数名节点，用于执行前绑定函数（见FunctionLib::Bind）
+    const std::vector<IdentifierNode*>& Identifiers() const { return identifiers_; }
+
 private:
     std::string name_;        // 树表示的模板的名称
     std::string parseName_;   // 解析期间顶级模板的名称，用于错误消息
     ListNode* root_; // 树的顶级根节点
     Mode mode_; // 解析模式
-    std::string text_;        // 用于创建模板的文本（或其父模板）
+    std::shared_ptr<const std::string> text_; // 用于创建模板的文本（或其父模板），与词法分析器共享
+    std::shared_ptr<Arena> arena_; // 节点所在的Arena，由同一次解析得到的所有树共享
+    std::vector<IdentifierNode*> identifiers_; // 解析时创建的函数名节点
 
     // 仅用于解析；解析后清除
     std::vector<std::map<std::string, std::string> > funcs_;
-    Lexer* lex_;
+    const TokenBuffer* tokens_; // 批量词法分析得到的token缓冲区，解析器按下标遍历
+    size_t tokenIndex_;         // 下一个要读取的token下标
 
     Item token_[3]; // 用于解析器的三令牌前瞻
     
     int peekCount_;
     std::vector<std::string> vars_; // 当前定义的变量
-    std::map<std::string, Tree*> treeSet_;
+    std::map<std::string, Tree*>* treeSet_; // 解析得到的树集合，由调用者持有
     int actionLine_; // 开始动作的左定界符行
     int rangeDepth_;
 
     // 内部解析方法
     void startParse(const std::vector<std::map<std::string, std::string> >& funcs, 
-                   Lexer* lex,
+                   const TokenBuffer* tokens,
+                   size_t tokenIndex,
                    std::map<std::string, Tree*>& treeSet);
     void stopParse();
     void add();
@@ -134,6 +151,7 @@ private:
     void parseDefinition();
     
     // 处理tokens的方法
+    Item nextToken();
     Item next();
     void backup();
     void backup2(const Item& t1);
@@ -174,7 +192,7 @@ private:
     PipeNode* pipeline(const std::string& context, ItemType end);
     Node* operand();
     Node* term();
-    VariableNode* useVar(Pos pos, const std::string& name);
+    VariableNode* useVar(Pos pos, std::string_view name);
     void popVars(size_t n);
     
     // 错误处理
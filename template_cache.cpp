@@ -0,0 +1,286 @@
+// template_cache.cpp
+#include "template_cache.h"
+#include "exec.h"   // 需要 ExecError
+#include "tree_optimizer.h"
+#include "trace.h"
+
+#include <functional>
+
+namespace template_engine {
+
+// ================== CompiledTemplate ==================
+
+CompiledTemplate::~CompiledTemplate() {
+    // 指令引用树中的节点，先释放指令
+    for (NamedTemplateMap::iterator it = templates_.begin(); it != templates_.end(); ++it) {
+        delete it->second.program;
+    }
+    templates_.clear();
+    program_ = NULL;
+    for (std::map<std::string, Tree*>::iterator it = trees_.begin(); it != trees_.end(); ++it) {
+        delete it->second;
+    }
+    trees_.clear();
+}
+
+CompiledTemplate* CompiledTemplate::Compile(
+    const std::string& name,
+    const std::string& content,
+    const std::string& leftDelim,
+    const std::string& rightDelim) {
+    return compile(name, std::make_shared<const std::string>(content), leftDelim, rightDelim, NULL, NULL);
+}
+
+CompiledTemplate* CompiledTemplate::Compile(
+    const std::string& name,
+    const std::shared_ptr<const std::string>& content,
+    const std::string& leftDelim,
+    const std::string& rightDelim) {
+    return compile(name, content, leftDelim, rightDelim, NULL, NULL);
+}
+
+CompiledTemplate* CompiledTemplate::Specialize(
+    const CompiledTemplate& source,
+    const Values* data,
+    const std::vector<std::string>& roots) {
+    // 与source共享同一个源文本缓冲区
+    return compile(source.Name(), source.Main()->GetText(), source.LeftDelim(), source.RightDelim(), data, &roots);
+}
+
+CompiledTemplate* CompiledTemplate::compile(
+    const std::string& name,
+    const std::shared_ptr<const std::string>& content,
+    const std::string& leftDelim,
+    const std::string& rightDelim,
+    const Values* data,
+    const std::vector<std::string>* roots) {
+
+    CompiledTemplate* compiled = new CompiledTemplate();
+    compiled->name_ = name;
+    compiled->leftDelim_ = leftDelim;
+    compiled->rightDelim_ = rightDelim;
+    try {
+        compiled->trees_ = Tree::Parse(name, content, leftDelim, rightDelim);
+        if (compiled->trees_.empty()) {
+            throw ExecError(RuntimeError, name, "failed to parse template");
+        }
+        std::map<std::string, Tree*>::const_iterator it = compiled->trees_.find(name);
+        if (it == compiled->trees_.end() || !it->second) {
+            throw ExecError(RuntimeError, name, "template not found after parsing");
+        }
+        compiled->main_ = it->second;
+        // 每棵树（包括define块）先做常量折叠等优化，再各自编译，{{template}}调用时直接执行，
+        // 不再重新解析或编译；共享之前把函数名绑定到内置函数库，执行时不再按名称查找
+        for (it = compiled->trees_.begin(); it != compiled->trees_.end(); ++it) {
+            if (!it->second) {
+                continue;
+            }
+            if (roots && it->second == compiled->main_) {
+                compiled->optimizeStats_ += SpecializeTree(it->second, data, *roots);
+            } else {
+                compiled->optimizeStats_ += OptimizeTree(it->second);
+            }
+            NamedTemplate named;
+            named.tree = it->second;
+            named.program = NULL;
+            NamedTemplate& slot = compiled->templates_.insert(std::make_pair(it->first, named)).first->second;
+            slot.program = Program::Compile(it->second);
+            FunctionLib::Builtins().Bind(it->second);
+        }
+        compiled->program_ = compiled->templates_.find(name)->second.program;
+    } catch (...) {
+        delete compiled;
+        throw;
+    }
+
+    // 同一次解析得到的树共享同一个Arena和源文本
+    size_t bytes = sizeof(CompiledTemplate) + compiled->Content().size();
+    for (NamedTemplateMap::const_iterator it = compiled->templates_.begin();
+         it != compiled->templates_.end(); ++it) {
+        bytes += it->first.size() + it->second.program->Code().size() * sizeof(Instruction);
+    }
+    if (compiled->main_->GetArena()) {
+        bytes += compiled->main_->GetArena()->BytesUsed();
+    }
+    compiled->bytes_ = bytes;
+    return compiled;
+}
+
+const NamedTemplate* CompiledTemplate::FindTemplate(std::string_view name) const {
+    NamedTemplateMap::const_iterator it = templates_.find(name);
+    return it == templates_.end() ? NULL : &it->second;
+}
+
+// ================== TemplateNamespace ==================
+
+void TemplateNamespace::Add(const CompiledTemplatePtr& compiled) {
+    sources_.push_back(compiled);
+    const NamedTemplateMap& named = compiled->Templates();
+    for (NamedTemplateMap::const_iterator it = named.begin(); it != named.end(); ++it) {
+        templates_[it->first] = it->second;
+    }
+}
+
+const NamedTemplate* TemplateNamespace::Find(std::string_view name) const {
+    NamedTemplateMap::const_iterator it = templates_.find(name);
+    return it == templates_.end() ? NULL : &it->second;
+}
+
+// ================== TemplateCache ==================
+
+const size_t TemplateCache::kDefaultByteBudget;
+
+TemplateCache::TemplateCache(size_t byteBudget)
+    : byteBudget_(byteBudget), bytes_(0), hits_(0), misses_(0), evictions_(0) {
+}
+
+TemplateCache& TemplateCache::Instance() {
+    static TemplateCache instance;
+    return instance;
+}
+
+// 名称也参与哈希：错误消息和主模板的查找都依赖名称，同样的文本换个名称得到的是不同的树
+size_t TemplateCache::hashKey(
+    const std::string& name,
+    const std::string& content,
+    const std::string& leftDelim,
+    const std::string& rightDelim) {
+    std::hash<std::string> hasher;
+    size_t h = hasher(content);
+    const std::string* parts[3] = { &name, &leftDelim, &rightDelim };
+    for (int i = 0; i < 3; ++i) {
+        h ^= hasher(*parts[i]) + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+    }
+    return h;
+}
+
+// 哈希相同时再比较内容，避免冲突时执行错误的模板
+bool TemplateCache::matches(
+    const CompiledTemplate& tmpl,
+    const std::string& name,
+    const std::string& content,
+    const std::string& leftDelim,
+    const std::string& rightDelim) {
+    return tmpl.Name() == name &&
+           tmpl.LeftDelim() == leftDelim &&
+           tmpl.RightDelim() == rightDelim &&
+           tmpl.Content() == content;
+}
+
+CompiledTemplatePtr TemplateCache::Get(
+    const std::string& name,
+    const std::string& content,
+    const std::string& leftDelim,
+    const std::string& rightDelim) {
+    return get(name, content, std::shared_ptr<const std::string>(), leftDelim, rightDelim);
+}
+
+CompiledTemplatePtr TemplateCache::Get(
+    const std::string& name,
+    const std::shared_ptr<const std::string>& content,
+    const std::string& leftDelim,
+    const std::string& rightDelim) {
+    if (!content) {
+        return get(name, std::string(), std::shared_ptr<const std::string>(), leftDelim, rightDelim);
+    }
+    return get(name, *content, content, leftDelim, rightDelim);
+}
+
+CompiledTemplatePtr TemplateCache::get(
+    const std::string& name,
+    const std::string& content,
+    const std::shared_ptr<const std::string>& buffer,
+    const std::string& leftDelim,
+    const std::string& rightDelim) {
+
+    size_t key = hashKey(name, content, leftDelim, rightDelim);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::unordered_map<size_t, EntryList::iterator>::iterator it = index_.find(key);
+        if (it != index_.end() && matches(*it->second->tmpl, name, content, leftDelim, rightDelim)) {
+            ++hits_;
+            entries_.splice(entries_.begin(), entries_, it->second);
+            return it->second->tmpl;
+        }
+        ++misses_;
+    }
+
+    // 解析和编译在锁外进行；多个线程同时未命中同一模板时各自编译，最后放入的为准
+    CompiledTemplatePtr compiled(buffer ? CompiledTemplate::Compile(name, buffer, leftDelim, rightDelim)
+                                        : CompiledTemplate::Compile(name, content, leftDelim, rightDelim));
+    TE_TRACE(TraceParse, TraceInfo, "模板缓存未命中: " << name << " (" << compiled->Bytes() << " bytes)");
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (compiled->Bytes() > byteBudget_) {
+        // 超过预算的模板直接返回，不缓存
+        return compiled;
+    }
+    std::unordered_map<size_t, EntryList::iterator>::iterator it = index_.find(key);
+    if (it != index_.end()) {
+        eraseLocked(it->second);
+    }
+    Entry entry;
+    entry.key = key;
+    entry.tmpl = compiled;
+    entries_.push_front(entry);
+    index_[key] = entries_.begin();
+    bytes_ += compiled->Bytes();
+    evictLocked();
+    return compiled;
+}
+
+void TemplateCache::eraseLocked(EntryList::iterator it) {
+    bytes_ -= it->tmpl->Bytes();
+    index_.erase(it->key);
+    entries_.erase(it);
+}
+
+// 从最久未使用的一端淘汰，直到不超过预算
+void TemplateCache::evictLocked() {
+    while (bytes_ > byteBudget_ && !entries_.empty()) {
+        EntryList::iterator last = entries_.end();
+        --last;
+        TE_TRACE(TraceParse, TraceDebug, "模板缓存淘汰: " << last->tmpl->Name());
+        eraseLocked(last);
+        ++evictions_;
+    }
+}
+
+void TemplateCache::SetByteBudget(size_t byteBudget) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    byteBudget_ = byteBudget;
+    evictLocked();
+}
+
+size_t TemplateCache::ByteBudget() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return byteBudget_;
+}
+
+TemplateCache::Stats TemplateCache::GetStats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Stats stats;
+    stats.hits = hits_;
+    stats.misses = misses_;
+    stats.evictions = evictions_;
+    stats.entries = entries_.size();
+    stats.bytes = bytes_;
+    return stats;
+}
+
+void TemplateCache::ResetStats() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    hits_ = 0;
+    misses_ = 0;
+    evictions_ = 0;
+}
+
+// 正在执行的模板由调用者的CompiledTemplatePtr保持，清空缓存不影响它们
+void TemplateCache::Clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    entries_.clear();
+    index_.clear();
+    bytes_ = 0;
+}
+
+} // namespace template_engine
@@ -0,0 +1,218 @@
+// template_cache.h
+#ifndef TEMPLATE_CACHE_H
+#define TEMPLATE_CACHE_H
+
+#include "parse.h"
+#include "bytecode.h"
+#include "tree_optimizer.h"
+
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace template_engine {
+
+// 具名模板：一棵树（主模板或define块）和它的指令序列，由所属的CompiledTemplate持有
+struct NamedTemplate {
+    const Tree* tree;
+    const Program* program;
+};
+
+typedef std::map<std::string, NamedTemplate, std::less<> > NamedTemplateMap;
+
+// 编译好的模板：一次解析得到的所有树，以及每棵树的指令序列
+// 构造完成后只读，可以被多个线程同时执行
+class CompiledTemplate {
+public:
+    ~CompiledTemplate();
+
+    // 解析并编译模板；解析失败时抛出ParseError，找不到主模板时抛出ExecError
+    static CompiledTemplate* Compile(
+        const std::string& name,
+        const std::string& content,
+        const std::string& leftDelim,
+        const std::string& rightDelim);
+    // 同上，树直接持有调用者读入的缓冲区content，不复制源文本
+    static CompiledTemplate* Compile(
+        const std::string& name,
+        const std::shared_ptr<const std::string>& content,
+        const std::string& leftDelim,
+        const std::string& rightDelim);
+
+    // 按已知输入特化source：重新解析source的模板文本，主模板中只依赖data中roots顶层字段
+    // （如ToRenderValues得到的Chart、Release）的部分预先渲染为文本，已知条件的分支预先选定。
+    // 得到的残余模板只能以这些字段取值与data相同的数据执行，例如同一次安装的各个环境；
+    // define块仍以调用者传入的数据执行，不做特化。结果不放入TemplateCache
+    static CompiledTemplate* Specialize(
+        const CompiledTemplate& source,
+        const Values* data,
+        const std::vector<std::string>& roots);
+
+    const std::string& Name() const { return name_; }
+    const std::string& LeftDelim() const { return leftDelim_; }
+    const std::string& RightDelim() const { return rightDelim_; }
+    const Tree* Main() const { return main_; }
+    const Program* MainProgram() const { return program_; }
+    const std::map<std::string, Tree*>& Trees() const { return trees_; }
+
+    // 本次解析得到的所有具名模板（包括主模板）
+    const NamedTemplateMap& Templates() const { return templates_; }
+
+    // 按名称查找具名模板；不存在时返回NULL
+    const NamedTemplate* FindTemplate(std::string_view name) const;
+
+    // 模板源文本（由所有树共享）
+    const std::string& Content() const { return *main_->GetText(); }
+
+    // 占用内存的估算值：源文本、节点Arena和指令序列
+    size_t Bytes() const { return bytes_; }
+
+    // 编译前优化遍历的统计（所有树的合计）
+    const OptimizeStats& Optimization() const { return optimizeStats_; }
+
+private:
+    CompiledTemplate() : main_(NULL), program_(NULL), bytes_(0) {}
+    CompiledTemplate(const CompiledTemplate&);
+    CompiledTemplate& operator=(const CompiledTemplate&);
+
+    // roots不为NULL时按data特化主模板
+    static CompiledTemplate* compile(
+        const std::string& name,
+        const std::shared_ptr<const std::string>& content,
+        const std::string& leftDelim,
+        const std::string& rightDelim,
+        const Values* data,
+        const std::vector<std::string>* roots);
+
+    std::string name_;
+    std::string leftDelim_;
+    std::string rightDelim_;
+    std::map<std::string, Tree*> trees_; // 持有
+    NamedTemplateMap templates_;         // 每棵树的指令序列由templates_持有
+    const Tree* main_;                   // trees_中的主模板
+    const Program* program_;             // templates_中主模板的指令序列
+    OptimizeStats optimizeStats_;
+    size_t bytes_;
+};
+
+typedef std::shared_ptr<const CompiledTemplate> CompiledTemplatePtr;
+
+// 一组模板共享的具名模板命名空间（如一个chart的所有模板文件和_*.tpl辅助模板）
+// 合并各模板的主模板和define块，同名时后加入的覆盖先加入的；
+// 构建完成后只读，{{template}}通过ExecOptions::templates在其中查找，可以被多个线程同时使用
+class TemplateNamespace {
+public:
+    TemplateNamespace() {}
+
+    // 加入compiled中的所有具名模板；命名空间持有compiled，树和指令的生命周期随命名空间
+    void Add(const CompiledTemplatePtr& compiled);
+
+    // 按名称查找；不存在时返回NULL
+    const NamedTemplate* Find(std::string_view name) const;
+
+    size_t Size() const { return templates_.size(); }
+
+private:
+    std::vector<CompiledTemplatePtr> sources_;
+    NamedTemplateMap templates_;
+
+    TemplateNamespace(const TemplateNamespace&);
+    TemplateNamespace& operator=(const TemplateNamespace&);
+};
+
+typedef std::shared_ptr<const TemplateNamespace> TemplateNamespacePtr;
+
+// 进程内的已编译模板缓存，线程安全
+// 以模板名、定界符和模板文本的哈希为键，按最近使用淘汰，占用总量不超过字节预算
+class TemplateCache {
+public:
+    // 缓存统计
+    struct Stats {
+        size_t hits;
+        size_t misses;
+        size_t evictions;
+        size_t entries;
+        size_t bytes;
+
+        Stats() : hits(0), misses(0), evictions(0), entries(0), bytes(0) {}
+    };
+
+    explicit TemplateCache(size_t byteBudget = kDefaultByteBudget);
+
+    // 进程共享的实例，ExecuteTemplate使用它
+    static TemplateCache& Instance();
+
+    // 取得编译好的模板；未命中时解析并编译（在锁外进行），然后放入缓存
+    // 解析错误直接抛出，不缓存
+    CompiledTemplatePtr Get(
+        const std::string& name,
+        const std::string& content,
+        const std::string& leftDelim,
+        const std::string& rightDelim);
+    // 同上；未命中时编译出的模板直接持有content缓冲区（如读入的模板文件），不再复制
+    CompiledTemplatePtr Get(
+        const std::string& name,
+        const std::shared_ptr<const std::string>& content,
+        const std::string& leftDelim,
+        const std::string& rightDelim);
+
+    // 字节预算；为0时不缓存任何模板。调小时立即淘汰
+    void SetByteBudget(size_t byteBudget);
+    size_t ByteBudget() const;
+
+    Stats GetStats() const;
+    void ResetStats();
+    void Clear();
+
+    static const size_t kDefaultByteBudget = 64 * 1024 * 1024;
+
+private:
+    struct Entry {
+        size_t key;
+        CompiledTemplatePtr tmpl;
+    };
+    typedef std::list<Entry> EntryList; // 前端为最近使用
+
+    // buffer为NULL时，未命中才把content复制为模板持有的缓冲区
+    CompiledTemplatePtr get(
+        const std::string& name,
+        const std::string& content,
+        const std::shared_ptr<const std::string>& buffer,
+        const std::string& leftDelim,
+        const std::string& rightDelim);
+
+    static size_t hashKey(
+        const std::string& name,
+        const std::string& content,
+        const std::string& leftDelim,
+        const std::string& rightDelim);
+    static bool matches(
+        const CompiledTemplate& tmpl,
+        const std::string& name,
+        const std::string& content,
+        const std::string& leftDelim,
+        const std::string& rightDelim);
+    void evictLocked();
+    void eraseLocked(EntryList::iterator it);
+
+    mutable std::mutex mutex_;
+    EntryList entries_;
+    std::unordered_map<size_t, EntryList::iterator> index_;
+    size_t byteBudget_;
+    size_t bytes_;
+    size_t hits_;
+    size_t misses_;
+    size_t evictions_;
+
+    TemplateCache(const TemplateCache&);
+    TemplateCache& operator=(const TemplateCache&);
+};
+
+} // namespace template_engine
+
+#endif // TEMPLATE_CACHE_H
@@ -1,7 +1,7 @@
 #include "template_linter.h"
 #include "values.h" 
 #include "template_syntax_checker.h" 
-#include <fstream>
+#include "file_loader.h"
 #include <sstream>
 #include <sys/stat.h>
 #include <dirent.h>
@@ -113,8 +113,8 @@ bool LintChartTemplates(
 
             if (isYaml) { // 只检查 YAML 文件
                 // 读取模板内容
-                std::ifstream tplFile(fullEntryPath.c_str());
-                if (!tplFile.is_open()) {
+                std::string templateContent;
+                if (!template_engine::ReadFile(fullEntryPath, templateContent)) {
                     std::vector<template_engine::TemplateSyntaxError> fileErrors;
                     template_engine::TemplateSyntaxError err;
                     err.type = template_engine::ErrorType_Syntax;
@@ -125,11 +125,6 @@ bool LintChartTemplates(
                     chartHasErrors = true;
                     continue;
                 }
-                std::stringstream buffer;
-                buffer << tplFile.rdbuf();
-                std::string templateContent = buffer.str();
-                tplFile.close();
-
                 // 检查模板内容
                 std::vector<template_engine::TemplateSyntaxError> currentTemplateErrors;
                 bool syntaxOk = template_engine::CheckTemplateSyntax(
@@ -81,7 +81,7 @@ static void CheckVarNodes(const Node* node, std::vector<TemplateSyntaxError>& er
     }
     if (node->Type() == NodeVariable) {
         const VariableNode* v = static_cast<const VariableNode*>(node);
-        std::string path = v->Ident();
+        std::string path(v->Ident());
         if (!IsValidVarPath(path)) {
             TemplateSyntaxError err;
             err.type = ErrorType_VariablePath;
@@ -97,7 +97,7 @@ static void CheckVarNodes(const Node* node, std::vector<TemplateSyntaxError>& er
     switch (node->Type()) {
         case NodeList: {
             const ListNode* list = static_cast<const ListNode*>(node);
-            const std::vector<Node*>& nodes = list->Nodes();
+            const NodeVector& nodes = list->Nodes();
             for (size_t i = 0; i < nodes.size(); ++i) {
                 CheckVarNodes(nodes[i], errors, tpl, line);
             }
@@ -119,7 +119,7 @@ static void CheckVarNodes(const Node* node, std::vector<TemplateSyntaxError>& er
         }
         case NodeCommand: {
             const CommandNode* cmd = static_cast<const CommandNode*>(node);
-            const std::vector<Node*>& args = cmd->Args();
+            const NodeVector& args = cmd->Args();
             for (size_t i = 0; i < args.size(); ++i) {
                 CheckVarNodes(args[i], errors, tpl, line);
             }
@@ -127,7 +127,7 @@ static void CheckVarNodes(const Node* node, std::vector<TemplateSyntaxError>& er
         }
         case NodePipe: {
             const PipeNode* pipe = static_cast<const PipeNode*>(node);
-            const std::vector<CommandNode*>& cmds = pipe->Cmds();
+            const CommandVector& cmds = pipe->Cmds();
             for (size_t i = 0; i < cmds.size(); ++i) {
                 CheckVarNodes(cmds[i], errors, tpl, line);
             }
@@ -166,7 +166,7 @@ static void CheckControlNodes(const Node* node, std::vector<TemplateSyntaxError>
     switch (node->Type()) {
         case NodeList: {
             const ListNode* list = static_cast<const ListNode*>(node);
-            const std::vector<Node*>& nodes = list->Nodes();
+            const NodeVector& nodes = list->Nodes();
             for (size_t i = 0; i < nodes.size(); ++i) {
                 CheckControlNodes(nodes[i], errors, tpl, line);
             }
@@ -179,7 +179,7 @@ static void CheckControlNodes(const Node* node, std::vector<TemplateSyntaxError>
         }
         case NodeCommand: {
             const CommandNode* cmd = static_cast<const CommandNode*>(node);
-            const std::vector<Node*>& args = cmd->Args();
+            const NodeVector& args = cmd->Args();
             for (size_t i = 0; i < args.size(); ++i) {
                 CheckControlNodes(args[i], errors, tpl, line);
             }
@@ -187,7 +187,7 @@ static void CheckControlNodes(const Node* node, std::vector<TemplateSyntaxError>
         }
         case NodePipe: {
             const PipeNode* pipe = static_cast<const PipeNode*>(node);
-            const std::vector<CommandNode*>& cmds = pipe->Cmds();
+            const CommandVector& cmds = pipe->Cmds();
             for (size_t i = 0; i < cmds.size(); ++i) {
                 CheckControlNodes(cmds[i], errors, tpl, line);
             }
@@ -204,7 +204,7 @@ static void CheckVarInData(const Node* node, Values* data, std::vector<TemplateS
     int line = parentLine;
     if (node->Type() == NodeVariable) {
         const VariableNode* v = static_cast<const VariableNode*>(node);
-        std::string path = v->Ident();
+        std::string path(v->Ident());
         if (data) {
             Values* cur = data;
             std::string seg;
@@ -234,7 +234,7 @@ static void CheckVarInData(const Node* node, Values* data, std::vector<TemplateS
     switch (node->Type()) {
         case NodeList: {
             const ListNode* list = static_cast<const ListNode*>(node);
-            const std::vector<Node*>& nodes = list->Nodes();
+            const NodeVector& nodes = list->Nodes();
             for (size_t i = 0; i < nodes.size(); ++i) {
                 CheckVarInData(nodes[i], data, errors, tpl, line);
             }
@@ -256,7 +256,7 @@ static void CheckVarInData(const Node* node, Values* data, std::vector<TemplateS
         }
         case NodeCommand: {
             const CommandNode* cmd = static_cast<const CommandNode*>(node);
-            const std::vector<Node*>& args = cmd->Args();
+            const NodeVector& args = cmd->Args();
             for (size_t i = 0; i < args.size(); ++i) {
                 CheckVarInData(args[i], data, errors, tpl, line);
             }
@@ -264,7 +264,7 @@ static void CheckVarInData(const Node* node, Values* data, std::vector<TemplateS
         }
         case NodePipe: {
             const PipeNode* pipe = static_cast<const PipeNode*>(node);
-            const std::vector<CommandNode*>& cmds = pipe->Cmds();
+            const CommandVector& cmds = pipe->Cmds();
             for (size_t i = 0; i < cmds.size(); ++i) {
                 CheckVarInData(cmds[i], data, errors, tpl, line);
             }
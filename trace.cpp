@@ -0,0 +1,98 @@
+// trace.cpp
+#include "trace.h"
+
+#include <cstdlib>
+
+namespace template_engine {
+
+std::atomic<TraceLevel> g_traceLevels[TraceCategoryCount] = {
+    TraceError, TraceError, TraceError, TraceError
+};
+
+static const char* const kCategoryNames[TraceCategoryCount] = {
+    "lexer", "parse", "exec", "values"
+};
+
+void SetTraceLevel(TraceCategory category, TraceLevel level) {
+    g_traceLevels[category].store(level, std::memory_order_relaxed);
+}
+
+void SetTraceLevel(TraceLevel level) {
+    for (int i = 0; i < TraceCategoryCount; ++i) {
+        g_traceLevels[i].store(level, std::memory_order_relaxed);
+    }
+}
+
+static bool parseLevel(const std::string& name, TraceLevel& level) {
+    if (name == "off") {
+        level = TraceOff;
+    } else if (name == "error") {
+        level = TraceError;
+    } else if (name == "info") {
+        level = TraceInfo;
+    } else if (name == "debug") {
+        level = TraceDebug;
+    } else if (name == "verbose") {
+        level = TraceVerbose;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool ConfigureTrace(const std::string& spec) {
+    bool ok = true;
+    size_t start = 0;
+    while (start <= spec.size()) {
+        size_t end = spec.find(',', start);
+        if (end == std::string::npos) {
+            end = spec.size();
+        }
+        std::string entry = spec.substr(start, end - start);
+        start = end + 1;
+        if (entry.empty()) {
+            continue;
+        }
+
+        // 没有"="时表示所有类别
+        size_t eq = entry.find('=');
+        TraceLevel level;
+        if (eq == std::string::npos) {
+            if (parseLevel(entry, level)) {
+                SetTraceLevel(level);
+            } else {
+                ok = false;
+            }
+            continue;
+        }
+
+        std::string category = entry.substr(0, eq);
+        if (!parseLevel(entry.substr(eq + 1), level)) {
+            ok = false;
+            continue;
+        }
+        bool found = false;
+        for (int i = 0; i < TraceCategoryCount; ++i) {
+            if (category == kCategoryNames[i]) {
+                SetTraceLevel(static_cast<TraceCategory>(i), level);
+                found = true;
+            }
+        }
+        ok = ok && found;
+    }
+    return ok;
+}
+
+std::ostream& TraceStream(TraceCategory category) {
+    return std::cerr << "[" << kCategoryNames[category] << "] ";
+}
+
+// 启动时读取环境变量
+static bool configureFromEnvironment() {
+    const char* spec = std::getenv("TEMPLATE_TRACE");
+    return spec ? ConfigureTrace(spec) : true;
+}
+
+static const bool g_traceConfigured = configureFromEnvironment();
+
+} // namespace template_engine
@@ -0,0 +1,67 @@
+// trace.h
+#ifndef TEMPLATE_TRACE_H
+#define TEMPLATE_TRACE_H
+
+#include <atomic>
+#include <iostream>
+#include <string>
+
+namespace template_engine {
+
+// 跟踪类别
+enum TraceCategory {
+    TraceLexer,
+    TraceParse,
+    TraceExec,
+    TraceValues,
+    TraceCategoryCount
+};
+
+// 跟踪级别，数值越大输出越详细
+enum TraceLevel {
+    TraceOff,
+    TraceError,   // 错误
+    TraceInfo,    // 模板级别的开始/结束
+    TraceDebug,   // 节点、管道、命令级别
+    TraceVerbose  // 每个token、每次取值、整棵语法树
+};
+
+// 各类别当前的级别，默认只输出错误。
+// 渲染线程读取时级别可能正被SetTraceLevel/ConfigureTrace修改，因此为原子变量；
+// 只需要最终看到新级别，不要求与其他内存操作有序，读写都用relaxed
+extern std::atomic<TraceLevel> g_traceLevels[TraceCategoryCount];
+
+inline bool TraceEnabled(TraceCategory category, TraceLevel level) {
+    return level <= g_traceLevels[category].load(std::memory_order_relaxed);
+}
+
+// 设置单个类别或所有类别的级别
+void SetTraceLevel(TraceCategory category, TraceLevel level);
+void SetTraceLevel(TraceLevel level);
+
+// 按配置串设置级别，形如 "debug" 或 "exec=debug,parse=info"
+// 程序启动时自动读取环境变量 TEMPLATE_TRACE；配置串无法解析时返回false
+bool ConfigureTrace(const std::string& spec);
+
+// 跟踪输出流（std::cerr），已写入"[类别] "前缀
+std::ostream& TraceStream(TraceCategory category);
+
+} // namespace template_engine
+
+// 发布构建（定义了NDEBUG）中跟踪语句编译为空，定义TEMPLATE_TRACE可以保留
+// 用法: TE_TRACE(TraceExec, TraceDebug, "字段: " << name);
+#if defined(NDEBUG) && !defined(TEMPLATE_TRACE)
+#define TE_TRACE_ENABLED(category, level) false
+#define TE_TRACE(category, level, message) do { } while (0)
+#else
+#define TE_TRACE_ENABLED(category, level) \
+    ::template_engine::TraceEnabled(::template_engine::category, ::template_engine::level)
+#define TE_TRACE(category, level, message) \
+    do { \
+        if (TE_TRACE_ENABLED(category, level)) { \
+            ::template_engine::TraceStream(::template_engine::category) << message << std::endl; \
+        } \
+    } while (0)
+#endif
+
+#endif // TEMPLATE_TRACE_H
@@ -1,51 +1,52 @@
 // tree_nodes.cpp
 #include "parse.h"
 #include "node.h"
+#include "trace.h"
 #include <sstream>
 #include <iostream>
 
 // 创建变量节点
-VariableNode* Tree::newVariable(Pos pos, const std::string& name) {
-    return new VariableNode(this, pos, name);
+VariableNode* Tree::newVariable(Pos pos, std::string_view name) {
+    return arena_->New<VariableNode>(this, pos, name);
 }
 
 NilNode* Tree::newNil(Pos pos) {
-    return new NilNode(this, pos);
+    return arena_->New<NilNode>(this, pos);
 }
 
 // 在tree_nodes.cpp中添加这个函数
 DotNode* Tree::newDot(Pos pos) {
-    return new DotNode(this, pos);
+    return arena_->New<DotNode>(this, pos);
 }
 
 // 创建列表节点
 ListNode* Tree::newList(Pos pos) {
-    return new ListNode(this, pos);
+    return arena_->New<ListNode>(this, pos);
 }
 
 // 创建文本节点
-TextNode* Tree::newText(Pos pos, const std::string& text) {
-    return new TextNode(this, pos, text);
+TextNode* Tree::newText(Pos pos, std::string_view text) {
+    return arena_->New<TextNode>(this, pos, text);
 }
 
 // 创建注释节点
-CommentNode* Tree::newComment(Pos pos, const std::string& text) {
-    return new CommentNode(this, pos, text);
+CommentNode* Tree::newComment(Pos pos, std::string_view text) {
+    return arena_->New<CommentNode>(this, pos, text);
 }
 
 // 创建动作节点
 ActionNode* Tree::newAction(Pos pos, int line, PipeNode* pipe) {
-    return new ActionNode(this, pos, line, pipe);
+    return arena_->New<ActionNode>(this, pos, line, pipe);
 }
 
 // 创建中断节点
 BreakNode* Tree::newBreak(Pos pos, int line) {
-    return new BreakNode(this, pos, line);
+    return arena_->New<BreakNode>(this, pos, line);
 }
 
 // 创建继续节点
 ContinueNode* Tree::newContinue(Pos pos, int line) {
-    return new ContinueNode(this, pos, line);
+    return arena_->New<ContinueNode>(this, pos, line);
 }
 
 // 创建if节点
@@ -53,7 +54,7 @@ IfNode* Tree::newIf(Pos pos, int line,
                                 PipeNode* pipe, 
                                 ListNode* list, 
                                 ListNode* elseList) {
-    return new IfNode(this, pos, line, pipe, list, elseList);
+    return arena_->New<IfNode>(this, pos, line, pipe, list, elseList);
 }
 
 // 创建range节点
@@ -61,7 +62,7 @@ RangeNode* Tree::newRange(Pos pos, int line,
                                      PipeNode* pipe, 
                                      ListNode* list, 
                                      ListNode* elseList) {
-    return new RangeNode(this, pos, line, pipe, list, elseList);
+    return arena_->New<RangeNode>(this, pos, line, pipe, list, elseList);
 }
 
 // 创建with节点
@@ -69,24 +70,24 @@ WithNode* Tree::newWith(Pos pos, int line,
                                     PipeNode* pipe, 
                                     ListNode* list, 
                                     ListNode* elseList) {
-    return new WithNode(this, pos, line, pipe, list, elseList);
+    return arena_->New<WithNode>(this, pos, line, pipe, list, elseList);
 }
 
 // 创建end节点
 EndNode* Tree::newEnd(Pos pos) {
-    return new EndNode(this, pos);
+    return arena_->New<EndNode>(this, pos);
 }
 
 // 创建else节点
 ElseNode* Tree::newElse(Pos pos, int line) {
-    return new ElseNode(this, pos, line);
+    return arena_->New<ElseNode>(this, pos, line);
 }
 
 // 创建模板节点
 TemplateNode* Tree::newTemplate(Pos pos, int line, 
-                                           const std::string& name, 
+                                           std::string_view name, 
                                            PipeNode* pipe) {
-    return new TemplateNode(this, pos, line, name, pipe);
+    return arena_->New<TemplateNode>(this, pos, line, name, pipe);
 }
 
 // 创建管道节点
@@ -94,76 +95,77 @@ PipeNode* Tree::newPipeline(
     Pos pos, 
     int line, 
     const std::vector<VariableNode*>& vars) {
-    PipeNode* pipe = new PipeNode(this, pos, line);
+    PipeNode* pipe = arena_->New<PipeNode>(this, pos, line);
     for (size_t i = 0; i < vars.size(); ++i) {
-        VariableNode* varCopy = static_cast<VariableNode*>(vars[i]->Copy());
-        pipe->AddDecl(varCopy);
+        pipe->AddDecl(vars[i]); // 节点都在同一个Arena中，直接共享，不复制
     }
     return pipe;
 }
 
 // 创建命令节点
 CommandNode* Tree::newCommand(Pos pos) {
-    return new CommandNode(this, pos);
+    return arena_->New<CommandNode>(this, pos);
 }
 
 // 创建链节点
 ChainNode* Tree::newChain(Pos pos, Node* node) {
-    return new ChainNode(this, pos, node);
+    return arena_->New<ChainNode>(this, pos, node);
 }
 
 // 创建字段节点
-FieldNode* Tree::newField(Pos pos, const std::string& field) {
-    return new FieldNode(this, pos, field);
+FieldNode* Tree::newField(Pos pos, std::string_view field) {
+    return arena_->New<FieldNode>(this, pos, field);
 }
 
 // 创建布尔节点
 BoolNode* Tree::newBool(Pos pos, bool b) {
-    return new BoolNode(this, pos, b);
+    return arena_->New<BoolNode>(this, pos, b);
 }
 
 // 创建数字节点
-NumberNode* Tree::newNumber(Pos pos, const std::string& text) {
-    return new NumberNode(this, pos, text);
+NumberNode* Tree::newNumber(Pos pos, std::string_view text) {
+    return arena_->New<NumberNode>(this, pos, text);
 }
 
 // 创建标识符节点
-IdentifierNode* Tree::newIdentifier(Pos pos, const std::string& ident) {
-    return new IdentifierNode(this, pos, ident);
+IdentifierNode* Tree::newIdentifier(Pos pos, std::string_view ident) {
+    IdentifierNode* node = arena_->New<IdentifierNode>(this, pos, ident);
+    identifiers_.push_back(node);
+    return node;
 }
 
 // 创建字符串节点
-StringNode* Tree::newString(Pos pos, const std::string& quoted, const std::string& text) {
-    return new StringNode(this, pos, quoted, text);
+StringNode* Tree::newString(Pos pos, std::string_view quoted, std::string_view text) {
+    return arena_->New<StringNode>(this, pos, quoted, text);
 }
 
 // term方法实现
 Node* Tree::term() {
     Item token = nextNonSpace();
-    std::cout << "  解析term，Token: " << itemTypeToString(token.type) << " 值: " << token.val << std::endl;
+    TE_TRACE(TraceParse, TraceVerbose, "  解析term，Token: " << itemTypeToString(token.type) << " 值: " << token.text);
     
     try {
         switch (token.type) {
             case ItemIdentifier:
-                return new IdentifierNode(this, token.pos, token.val);
+                return arena_->New<IdentifierNode>(this, token.pos, token.text);
             case ItemDot:
-                std::cout << "  发现点节点" << std::endl;
-                return new DotNode(this, token.pos);
+                TE_TRACE(TraceParse, TraceDebug, "  发现点节点");
+                return arena_->New<DotNode>(this, token.pos);
             case ItemNil:
-                return new NilNode(this, token.pos);
+                return arena_->New<NilNode>(this, token.pos);
             case ItemVariable:
-                std::cout << "  发现变量: " << token.val << std::endl;
-                return newVariable(token.pos, token.val);
+                TE_TRACE(TraceParse, TraceDebug, "  发现变量: " << token.text);
+                return newVariable(token.pos, token.text);
             case ItemField: {
-                std::cout << "  发现字段: " << token.val << std::endl;
+                TE_TRACE(TraceParse, TraceDebug, "  发现字段: " << token.text);
                 
                 // 只处理当前的字段节点，不尝试处理整个路径
-                FieldNode* fieldNode = newField(token.pos, token.val);
+                FieldNode* fieldNode = newField(token.pos, token.text);
                 
                 // 检查是否存在下一个字段（链式访问）
                 if (peek().type == ItemField) {
                     // 在解析阶段不处理链式访问，交给执行阶段处理
-                    std::cout << "  检测到可能的链式字段访问" << std::endl;
+                    TE_TRACE(TraceParse, TraceDebug, "  检测到可能的链式字段访问");
                 }
                 
                 return fieldNode;
@@ -172,32 +174,32 @@ Node* Tree::term() {
             
 
             case ItemBool:
-                return new BoolNode(this, token.pos, token.val == "true");
+                return arena_->New<BoolNode>(this, token.pos, token.text == "true");
             case ItemNumber:
-                return new NumberNode(this, token.pos, token.val);
+                return arena_->New<NumberNode>(this, token.pos, token.text);
             
             case ItemString: {
-                std::cout << "  解析字符串常量: " << token.val << std::endl;
+                TE_TRACE(TraceParse, TraceDebug, "  解析字符串常量: " << token.text);
                 
                 // 处理引号
-                std::string text = token.val;
+                std::string_view text = token.text;
                 if (text.size() >= 2 && (text[0] == '"' || text[0] == '`') && 
                     text[0] == text[text.size()-1]) {
                     text = text.substr(1, text.size() - 2);
                 }
                 
-                return newString(token.pos, token.val, text);
+                return newString(token.pos, token.text, text);
             }
 
             case ItemRawString: {
-                std::cout << "  发现字符串: " << token.val << std::endl;
+                TE_TRACE(TraceParse, TraceDebug, "  发现字符串: " << token.text);
                 // 处理引号
-                std::string text = token.val;
+                std::string_view text = token.text;
                 if (text.size() >= 2 && (text[0] == '"' || text[0] == '`') && 
                     text[0] == text[text.size()-1]) {
                     text = text.substr(1, text.size() - 2);
                 }
-                return newString(token.pos, token.val, text);
+                return newString(token.pos, token.text, text);
             }
 
             case ItemLeftParen: {
@@ -206,13 +208,13 @@ Node* Tree::term() {
             }
 
             default:
-                std::cout << "  在term中回退Token: " << itemTypeToString(token.type) << std::endl;
+                TE_TRACE(TraceParse, TraceVerbose, "  在term中回退Token: " << itemTypeToString(token.type));
                 backup();
                 return NULL;
         }
 
     } catch (const std::exception& e) {
-        std::cout << "  Term解析异常: " << e.what() << std::endl;
+        TE_TRACE(TraceParse, TraceDebug, "  Term解析异常: " << e.what());
         throw;
     }
 }
@@ -0,0 +1,426 @@
+// tree_optimizer.cpp
+#include "tree_optimizer.h"
+#include "exec.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <sstream>
+
+namespace template_engine {
+
+OptimizeStats& OptimizeStats::operator+=(const OptimizeStats& other) {
+    nodesBefore += other.nodesBefore;
+    nodesAfter += other.nodesAfter;
+    foldedPipelines += other.foldedPipelines;
+    prunedBranches += other.prunedBranches;
+    mergedTexts += other.mergedTexts;
+    foldedArgs += other.foldedArgs;
+    return *this;
+}
+
+size_t CountNodes(const Node* node) {
+    if (!node) {
+        return 0;
+    }
+    size_t count = 1;
+    switch (node->Type()) {
+        case NodeList: {
+            const NodeVector& nodes = static_cast<const ListNode*>(node)->Nodes();
+            for (size_t i = 0; i < nodes.size(); ++i) {
+                count += CountNodes(nodes[i]);
+            }
+            break;
+        }
+        case NodeAction:
+            count += CountNodes(static_cast<const ActionNode*>(node)->Pipe());
+            break;
+        case NodePipe: {
+            const PipeNode* pipe = static_cast<const PipeNode*>(node);
+            count += pipe->Decl().size();
+            for (size_t i = 0; i < pipe->Cmds().size(); ++i) {
+                count += CountNodes(pipe->Cmds()[i]);
+            }
+            break;
+        }
+        case NodeCommand: {
+            const NodeVector& args = static_cast<const CommandNode*>(node)->Args();
+            for (size_t i = 0; i < args.size(); ++i) {
+                count += CountNodes(args[i]);
+            }
+            break;
+        }
+        case NodeIf:
+        case NodeRange:
+        case NodeWith: {
+            const BranchNode* branch = static_cast<const BranchNode*>(node);
+            count += CountNodes(branch->GetPipe());
+            count += CountNodes(branch->List());
+            count += CountNodes(branch->ElseList());
+            break;
+        }
+        case NodeTemplate:
+            count += CountNodes(static_cast<const TemplateNode*>(node)->Pipe());
+            break;
+        case NodeChain:
+            count += CountNodes(static_cast<const ChainNode*>(node)->GetNode());
+            break;
+        default:
+            break;
+    }
+    return count;
+}
+
+namespace {
+
+// 对一棵树做一次优化遍历
+// 常量管道交给ExecContext求值，保证与执行时的结果（包括输出格式）完全一致；
+// 特化时以已知数据作为"$"和"."，否则没有输入数据
+class TreeOptimizer {
+public:
+    TreeOptimizer(Tree* tree, OptimizeStats& stats, const Values* data, const std::vector<std::string>* roots)
+        : tree_(tree), stats_(stats), data_(const_cast<Values*>(data)), roots_(roots), dotIsData_(roots != NULL),
+          ctx_(tree, NULL, output_, data, FunctionLib::Builtins()) {}
+
+    void Run() {
+        optimizeList(tree_->GetRoot());
+    }
+
+private:
+    Tree* tree_;
+    OptimizeStats& stats_;
+    Values* data_;                            // 特化时的已知数据，执行中只读
+    const std::vector<std::string>* roots_;   // 视为常量的顶层字段；不特化时为NULL
+    bool dotIsData_;                          // 当前位置的"."是否仍是渲染数据
+    std::ostringstream output_; // 折叠输出动作时ctx_的输出
+    ExecContext ctx_;
+
+    bool isKnownRoot(const Node* node) const;
+    bool isConstantArg(const Node* node) const;
+    bool isConstant(const PipeNode* pipe) const;
+    Values* evaluate(const PipeNode* pipe);
+    void foldArgs(const PipeNode* pipe);
+    Node* literal(const Node* arg);
+    void optimizeList(ListNode* list);
+    void emit(NodeVector& out, Node* node);
+    void emitText(NodeVector& out, TextNode* text);
+    void emitBranch(NodeVector& out, BranchNode* branch);
+    void optimizeBody(ListNode* list);
+};
+
+// 以"."开始、首段是已知顶层字段的字段
+bool TreeOptimizer::isKnownRoot(const Node* node) const {
+    if (!dotIsData_ || node->Type() != NodeField) {
+        return false;
+    }
+    std::string_view name = static_cast<const FieldNode*>(node)->Segment().name;
+    return std::find(roots_->begin(), roots_->end(), name) != roots_->end();
+}
+
+bool TreeOptimizer::isConstantArg(const Node* node) const {
+    switch (node->Type()) {
+        case NodeBool:
+        case NodeNumber:
+        case NodeString:
+        case NodeNil:
+            return true;
+        case NodePipe:
+            return isConstant(static_cast<const PipeNode*>(node));
+        case NodeField:
+            return isKnownRoot(node);
+        case NodeChain: {
+            const Node* base = static_cast<const ChainNode*>(node)->GetNode();
+            return isKnownRoot(base) || (base->Type() == NodePipe && isConstant(static_cast<const PipeNode*>(base)));
+        }
+        default:
+            return false;
+    }
+}
+
+// 没有变量声明，每个命令都是常量本身，或者以常量为参数调用纯内置函数
+bool TreeOptimizer::isConstant(const PipeNode* pipe) const {
+    if (!pipe || !pipe->Decl().empty() || pipe->Cmds().empty()) {
+        return false;
+    }
+    for (size_t i = 0; i < pipe->Cmds().size(); ++i) {
+        const NodeVector& args = pipe->Cmds()[i]->Args();
+        if (args.empty()) {
+            return false;
+        }
+        if (args[0]->Type() == NodeIdentifier) {
+            TemplateFn* fn = FunctionLib::Builtins().FindFunction(static_cast<const IdentifierNode*>(args[0])->Ident());
+            if (!fn || !fn->Pure()) {
+                return false;
+            }
+            for (size_t j = 1; j < args.size(); ++j) {
+                if (!isConstantArg(args[j])) {
+                    return false;
+                }
+            }
+        } else if (args.size() != 1 || !isConstantArg(args[0])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// 求值出错时返回NULL，保留原样，让错误在执行时按原来的方式报告
+Values* TreeOptimizer::evaluate(const PipeNode* pipe) {
+    if (!isConstant(pipe)) {
+        return NULL;
+    }
+    try {
+        Values* value = ctx_.EvalPipeline(pipe, data_);
+        if (value) {
+            stats_.foldedPipelines++;
+        }
+        return value;
+    } catch (const std::exception& e) {
+        TE_TRACE(TraceParse, TraceDebug, "常量管道求值失败，保留原样: " << e.what());
+        return NULL;
+    }
+}
+
+// 特化时，把管道中函数调用的已知参数替换为字面量，执行时只求值其余参数
+void TreeOptimizer::foldArgs(const PipeNode* pipe) {
+    if (!roots_ || !pipe) {
+        return;
+    }
+    for (size_t i = 0; i < pipe->Cmds().size(); ++i) {
+        NodeVector& args = pipe->Cmds()[i]->Args();
+        if (args.empty() || args[0]->Type() != NodeIdentifier) {
+            continue;
+        }
+        for (size_t j = 1; j < args.size(); ++j) {
+            Node* arg = args[j];
+            if (arg->Type() != NodeField && arg->Type() != NodeChain && arg->Type() != NodePipe) {
+                continue;
+            }
+            if (!isConstantArg(arg)) {
+                if (arg->Type() == NodePipe) {
+                    foldArgs(static_cast<const PipeNode*>(arg));
+                }
+                continue;
+            }
+            Node* folded = literal(arg);
+            if (folded) {
+                args[j] = folded;
+                stats_.foldedArgs++;
+            }
+        }
+    }
+}
+
+// 求值常量参数并构造等价的字面量节点；空值、映射、列表以及求值出错时返回NULL，保留原参数
+Node* TreeOptimizer::literal(const Node* arg) {
+    Values* value = NULL;
+    try {
+        value = ctx_.EvalArg(arg, data_);
+    } catch (const std::exception& e) {
+        TE_TRACE(TraceParse, TraceDebug, "常量参数求值失败，保留原样: " << e.what());
+        return NULL;
+    }
+    if (!value) {
+        return NULL;
+    }
+    Node* result = NULL;
+    if (value->IsBool()) {
+        result = tree_->newBool(arg->Position(), value->AsBool());
+    } else if (value->IsNumber()) {
+        // %.17g保证执行时atof得到同一个double
+        char text[32];
+        snprintf(text, sizeof(text), "%.17g", value->AsNumber());
+        result = tree_->newNumber(arg->Position(), text);
+    } else if (value->IsString() && value->AsString().find('`') == std::string::npos) {
+        // 以原始字符串的形式保留可读的文本，字符串内容不需要转义
+        std::string_view text = tree_->GetArena()->Intern(value->AsString());
+        std::string_view quoted = tree_->GetArena()->Intern("`" + std::string(text) + "`");
+        result = tree_->newString(arg->Position(), quoted, text);
+    }
+    delete value;
+    return result;
+}
+
+void TreeOptimizer::optimizeList(ListNode* list) {
+    if (!list) {
+        return;
+    }
+    NodeVector& nodes = list->Nodes();
+    NodeVector out(nodes.get_allocator());
+    out.reserve(nodes.size());
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        if (nodes[i]) {
+            emit(out, nodes[i]);
+        }
+    }
+    nodes.swap(out);
+}
+
+void TreeOptimizer::emit(NodeVector& out, Node* node) {
+    switch (node->Type()) {
+        case NodeText:
+            emitText(out, static_cast<TextNode*>(node));
+            return;
+
+        case NodeAction: {
+            // 常量输出动作变为文本
+            ActionNode* action = static_cast<ActionNode*>(node);
+            Values* value = evaluate(action->Pipe());
+            if (!value) {
+                foldArgs(action->Pipe());
+                break;
+            }
+            output_.str(std::string());
+            try {
+                ctx_.PrintValue(action, value);
+            } catch (...) {
+                delete value;
+                throw;
+            }
+            delete value;
+            std::string text = output_.str();
+            emitText(out, tree_->newText(action->Position(), tree_->GetArena()->Intern(text)));
+            return;
+        }
+
+        case NodeIf:
+        case NodeWith:
+            emitBranch(out, static_cast<BranchNode*>(node));
+            return;
+
+        case NodeRange: {
+            BranchNode* branch = static_cast<BranchNode*>(node);
+            foldArgs(branch->GetPipe());
+            optimizeBody(branch->List());
+            optimizeList(branch->ElseList());
+            break;
+        }
+
+        case NodeList:
+            optimizeList(static_cast<ListNode*>(node));
+            break;
+
+        default:
+            break;
+    }
+    out.push_back(node);
+}
+
+// 空文本直接丢弃；紧跟在文本之后的文本与之合并
+void TreeOptimizer::emitText(NodeVector& out, TextNode* text) {
+    std::string_view tail = text->Text();
+    if (tail.empty()) {
+        return;
+    }
+    if (out.empty() || out.back()->Type() != NodeText) {
+        out.push_back(text);
+        return;
+    }
+    TextNode* prev = static_cast<TextNode*>(out.back());
+    std::string_view head = prev->Text();
+    std::string_view merged;
+    if (head.data() + head.size() == tail.data()) {
+        // 在源文本中本来就相邻，直接扩展视图
+        merged = std::string_view(head.data(), head.size() + tail.size());
+    } else {
+        std::string joined;
+        joined.reserve(head.size() + tail.size());
+        joined.append(head.data(), head.size());
+        joined.append(tail.data(), tail.size());
+        merged = tree_->GetArena()->Intern(joined);
+    }
+    out.back() = tree_->newText(prev->Position(), merged);
+    stats_.mergedTexts++;
+}
+
+// 列表顶层有声明新变量的动作
+static bool declaresVariables(const ListNode* list) {
+    const NodeVector& nodes = list->Nodes();
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        if (nodes[i] && nodes[i]->Type() == NodeAction) {
+            const PipeNode* pipe = static_cast<const ActionNode*>(nodes[i])->Pipe();
+            if (pipe && !pipe->Decl().empty() && !pipe->IsAssign()) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+// 条件已知的if展开为要执行的分支；条件为假的with展开为else分支。
+// 要执行的分支在顶层声明了变量时不能展开到外层（变量会在{{end}}之后仍然可见），
+// 改为以字面量true为条件、只有这一个分支的if，仍然去掉条件求值和另一个分支
+void TreeOptimizer::emitBranch(NodeVector& out, BranchNode* branch) {
+    Values* cond = evaluate(branch->GetPipe());
+    if (cond) {
+        bool truth = ctx_.isTrue(cond);
+        delete cond;
+        if (branch->Type() == NodeIf || !truth) {
+            ListNode* taken = truth ? branch->List() : branch->ElseList();
+            stats_.prunedBranches++;
+            if (taken && declaresVariables(taken)) {
+                Pos pos = branch->Position();
+                PipeNode* pipe = tree_->newPipeline(pos, branch->Line());
+                CommandNode* cmd = tree_->newCommand(pos);
+                cmd->Append(tree_->newBool(pos, true));
+                pipe->Append(cmd);
+                optimizeList(taken);
+                out.push_back(tree_->newIf(pos, branch->Line(), pipe, taken, NULL));
+            } else if (taken) {
+                const NodeVector& nodes = taken->Nodes();
+                for (size_t i = 0; i < nodes.size(); ++i) {
+                    if (nodes[i]) {
+                        emit(out, nodes[i]);
+                    }
+                }
+            }
+            return;
+        }
+    }
+    foldArgs(branch->GetPipe());
+    if (branch->Type() == NodeWith) {
+        optimizeBody(branch->List());
+    } else {
+        optimizeList(branch->List());
+    }
+    optimizeList(branch->ElseList());
+    out.push_back(branch);
+}
+
+// with、range的主体："."被重新绑定，其中的字段不再指向渲染数据
+void TreeOptimizer::optimizeBody(ListNode* list) {
+    bool saved = dotIsData_;
+    dotIsData_ = false;
+    optimizeList(list);
+    dotIsData_ = saved;
+}
+
+OptimizeStats runOptimizer(Tree* tree, const Values* data, const std::vector<std::string>* roots) {
+    OptimizeStats stats;
+    if (!tree || !tree->GetRoot()) {
+        return stats;
+    }
+    stats.nodesBefore = CountNodes(tree->GetRoot());
+    {
+        TreeOptimizer optimizer(tree, stats, data, roots);
+        optimizer.Run();
+    }
+    stats.nodesAfter = CountNodes(tree->GetRoot());
+    TE_TRACE(TraceParse, TraceDebug, (roots ? "特化 " : "优化 ") << tree->GetName() << ": 节点 " << stats.nodesBefore
+             << " -> " << stats.nodesAfter << ", 折叠管道 " << stats.foldedPipelines
+             << ", 消除分支 " << stats.prunedBranches << ", 合并文本 " << stats.mergedTexts
+             << ", 替换参数 " << stats.foldedArgs);
+    return stats;
+}
+
+} // namespace
+
+OptimizeStats OptimizeTree(Tree* tree) {
+    return runOptimizer(tree, NULL, NULL);
+}
+
+OptimizeStats SpecializeTree(Tree* tree, const Values* data, const std::vector<std::string>& roots) {
+    return runOptimizer(tree, data, &roots);
+}
+
+} // namespace template_engine
@@ -0,0 +1,50 @@
+// tree_optimizer.h
+#ifndef TEMPLATE_TREE_OPTIMIZER_H
+#define TEMPLATE_TREE_OPTIMIZER_H
+
+#include "parse.h"
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace template_engine {
+
+class Values;
+
+// 优化遍历的统计
+struct OptimizeStats {
+    size_t nodesBefore;     // 优化前树中的节点数
+    size_t nodesAfter;      // 优化后树中的节点数
+    size_t foldedPipelines; // 在优化时求值的常量管道数
+    size_t prunedBranches;  // 条件已知而被消除的if/with
+    size_t mergedTexts;     // 合并进前一个文本节点的文本节点数
+    size_t foldedArgs;      // 特化时替换为字面量的函数参数数
+
+    OptimizeStats() : nodesBefore(0), nodesAfter(0), foldedPipelines(0), prunedBranches(0), mergedTexts(0), foldedArgs(0) {}
+
+    OptimizeStats& operator+=(const OptimizeStats& other);
+};
+
+// 解析之后、编译为指令之前对树做的优化，优化后的树输出与原来相同：
+// - 只由字面量和纯内置函数（eq、ne、lt、and、or、not、default等）组成的管道在这里求值，
+//   输出动作变为文本，if/with的条件变为已知
+// - 条件已知的if只保留会执行的分支；条件为假的with替换为它的else分支
+// - 相邻的文本节点合并为一个，合并后的文本驻留在树的Arena中
+// 常量按内置函数库求值，与CompiledTemplate把函数名绑定到内置库是同一个假设。
+// 必须在树被共享执行之前调用
+OptimizeStats OptimizeTree(Tree* tree);
+
+// 按已知输入特化：除OptimizeTree所做的以外，data中名为roots的顶层字段（如Chart、Release，
+// 一次安装中不变）也视为常量，只依赖它们的管道在这里求值为文本或已知条件。
+// 不能整体求值的函数调用中，值为布尔、数值或字符串的已知参数替换为字面量。
+// 只在"."仍是渲染数据的位置（with、range的主体之外）特化以"."开始的字段和字段链；
+// 得到的树只能以同样roots取值相同的数据作为"."执行
+OptimizeStats SpecializeTree(Tree* tree, const Values* data, const std::vector<std::string>& roots);
+
+// 节点及其所有子节点的个数
+size_t CountNodes(const Node* node);
+
+} // namespace template_engine
+
+#endif // TEMPLATE_TREE_OPTIMIZER_H
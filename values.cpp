@@ -1,36 +1,151 @@
 // values.cpp
 #include "values.h"
 #include "exec.h"  // 添加包含TemplateFn的头文件
+#include "trace.h"
+#include "file_loader.h"
 #include <sstream>
 #include <iomanip>
 #include <stdexcept>
 #include <algorithm>
 #include <cctype>
-#include <fstream>
+#include <cstring>
+#include <new>
 
 namespace template_engine {
 
+// ================== ValuesMap ==================
+
+const size_t ValuesMap::kLinearScanLimit;
+const size_t Values::kInlineStringCapacity;
+
+size_t ValuesMap::lowerBound(std::string_view key) const {
+    size_t lo = 0;
+    size_t hi = entries_.size();
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (std::string_view(entries_[mid].first) < key) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+size_t ValuesMap::lookup(std::string_view key, uint32_t hash) const {
+    size_t n = entries_.size();
+    if (n <= kLinearScanLimit) {
+        for (size_t i = 0; i < n; ++i) {
+            if (entries_[i].hash == hash && entries_[i].first == key) {
+                return i;
+            }
+        }
+        return n;
+    }
+    size_t pos = lowerBound(key);
+    return (pos < n && entries_[pos].first == key) ? pos : n;
+}
+
+ValuesMap::iterator ValuesMap::find(std::string_view key) {
+    return entries_.begin() + lookup(key, Hash(key));
+}
+
+ValuesMap::const_iterator ValuesMap::find(std::string_view key) const {
+    return entries_.begin() + lookup(key, Hash(key));
+}
+
+ValuesMap::iterator ValuesMap::find(std::string_view key, uint32_t hash) {
+    return entries_.begin() + lookup(key, hash);
+}
+
+ValuesMap::const_iterator ValuesMap::find(std::string_view key, uint32_t hash) const {
+    return entries_.begin() + lookup(key, hash);
+}
+
+ValuesMap::const_iterator ValuesMap::find(std::string_view key, uint32_t hash, uint32_t& hint) const {
+    size_t n = entries_.size();
+    if (hint < n && entries_[hint].hash == hash && entries_[hint].first == key) {
+        return entries_.begin() + hint;
+    }
+    size_t pos = lookup(key, hash);
+    if (pos < n) {
+        hint = static_cast<uint32_t>(pos);
+    }
+    return entries_.begin() + pos;
+}
+
+std::pair<ValuesMap::iterator, bool> ValuesMap::insert(std::string_view key, Values* value) {
+    // 按顺序插入（如解析已排序的键、复制另一个映射）时直接追加
+    size_t pos = (entries_.empty() || std::string_view(entries_.back().first) < key)
+                     ? entries_.size() : lowerBound(key);
+    if (pos < entries_.size() && entries_[pos].first == key) {
+        return std::make_pair(entries_.begin() + pos, false);
+    }
+    Entry entry;
+    entry.first.assign(key.data(), key.size());
+    entry.second = value;
+    entry.hash = Hash(key);
+    return std::make_pair(entries_.insert(entries_.begin() + pos, std::move(entry)), true);
+}
+
+Values*& ValuesMap::operator[](std::string_view key) {
+    return insert(key, NULL).first->second;
+}
+
+void ValuesMap::append(std::string_view key, Values* value) {
+    Entry entry;
+    entry.first.assign(key.data(), key.size());
+    entry.second = value;
+    entry.hash = Hash(key);
+    entries_.push_back(std::move(entry));
+}
+
+void ValuesMap::sort() {
+    std::stable_sort(entries_.begin(), entries_.end(), [](const Entry& a, const Entry& b) {
+        return a.first < b.first;
+    });
+    // 稳定排序后重复的键相邻，且按追加的先后排列
+    size_t out = 0;
+    for (size_t i = 0; i < entries_.size(); ++i) {
+        if (out > 0 && entries_[out - 1].first == entries_[i].first) {
+            delete entries_[out - 1].second;
+            entries_[out - 1].second = entries_[i].second;
+            continue;
+        }
+        if (out != i) {
+            entries_[out] = std::move(entries_[i]);
+        }
+        ++out;
+    }
+    entries_.resize(out);
+}
+
 // 构造函数实现
-Values::Values() : type_(Null), functionValue_(NULL) {}
+Values::Values() : type_(Null), inlineSize_(0) {}
 
-Values::Values(bool b) : type_(Bool), boolValue_(b), functionValue_(NULL) {}
+Values::Values(bool b) : boolValue_(b), type_(Bool), inlineSize_(0) {}
 
-Values::Values(double n) : type_(Number), numberValue_(n), functionValue_(NULL) {}
+Values::Values(double n) : numberValue_(n), type_(Number), inlineSize_(0) {}
 
-Values::Values(const std::string& s) : type_(String), stringValue_(s), functionValue_(NULL) {}
+Values::Values(std::string_view s) : type_(Null), inlineSize_(0) {
+    assignString(s);
+}
 
-Values::Values(const std::vector<Values*>& l) : type_(List), functionValue_(NULL) {
+Values::Values(const std::vector<Values*>& l) : type_(List), inlineSize_(0) {
+    new (&listValue_) ValuesList();
     listValue_.reserve(l.size());
     for (std::vector<Values*>::const_iterator it = l.begin(); it != l.end(); ++it) {
         if (*it) {
-            listValue_.push_back(new Values(*(*it))); // 手动调用拷贝构造
+            listValue_.push_back(*(*it)); // 手动调用拷贝构造
         } else {
-            listValue_.push_back(NULL);
+            listValue_.push_back(Values());
         }
     }
 }
 
-Values::Values(const std::map<std::string, Values*>& m) : type_(Map), functionValue_(NULL) {
+Values::Values(const std::map<std::string, Values*>& m) : type_(Map), inlineSize_(0) {
+    new (&mapValue_) ValuesMap();
+    mapValue_.reserve(m.size());
     for (std::map<std::string, Values*>::const_iterator it = m.begin(); it != m.end(); ++it) {
         if (it->second) {
             mapValue_[it->first] = new Values(*(it->second)); // 手动调用拷贝构造
@@ -41,7 +156,7 @@ Values::Values(const std::map<std::string, Values*>& m) : type_(Map), functionVa
 }
 
 // 添加函数构造函数
-Values::Values(TemplateFn* fn) : type_(Function), functionValue_(fn) {}
+Values::Values(TemplateFn* fn) : functionValue_(fn), type_(Function), inlineSize_(0) {}
 
 // 析构函数
 Values::~Values() {
@@ -49,68 +164,141 @@ Values::~Values() {
 }
 
 // 恢复：拷贝构造函数执行手动深拷贝
-Values::Values(const Values& other) : type_(other.type_), 
-    boolValue_(other.boolValue_), 
-    numberValue_(other.numberValue_), 
-    stringValue_(other.stringValue_),
-    functionValue_(other.functionValue_) {
-    // 手动深拷贝列表
-    if (other.type_ == List) {
-        listValue_.reserve(other.listValue_.size());
-        for (std::vector<Values*>::const_iterator it = other.listValue_.begin(); it != other.listValue_.end(); ++it) {
-            if (*it) {
-                listValue_.push_back(new Values(*(*it)));
-            } else {
-                listValue_.push_back(NULL);
-            }
-        }
-    }
-    // 手动深拷贝映射
-    else if (other.type_ == Map) {
-        for (std::map<std::string, Values*>::const_iterator it = other.mapValue_.begin(); it != other.mapValue_.end(); ++it) {
-            if (it->second) {
-                mapValue_[it->first] = new Values(*(it->second));
-            } else {
-                mapValue_[it->first] = NULL;
-            }
+Values::Values(const Values& other) : type_(Null), inlineSize_(0) {
+    switch (other.type_) {
+    case Null:
+        break;
+    case Bool:
+        boolValue_ = other.boolValue_;
+        type_ = Bool;
+        break;
+    case Number:
+        numberValue_ = other.numberValue_;
+        type_ = Number;
+        break;
+    case String:
+        assignString(other.AsString());
+        break;
+    case List:
+        // 元素按值存放，复制列表即深拷贝
+        new (&listValue_) ValuesList(other.listValue_);
+        type_ = List;
+        break;
+    case Map:
+        // 手动深拷贝映射
+        new (&mapValue_) ValuesMap();
+        type_ = Map;
+        mapValue_.reserve(other.mapValue_.size());
+        for (ValuesMap::const_iterator it = other.mapValue_.begin(); it != other.mapValue_.end(); ++it) {
+            mapValue_.insert(it->first, it->second ? new Values(*(it->second)) : NULL);
         }
+        break;
+    case Function:
+        functionValue_ = other.functionValue_;
+        type_ = Function;
+        break;
     }
 }
 
-// 恢复：赋值运算符使用 copy-and-swap (依赖正确的拷贝构造和析构)
+Values::Values(Values&& other) noexcept : type_(Null), inlineSize_(0) {
+    moveFrom(other);
+}
+
+// 恢复：赋值运算符先完成深拷贝再替换，拷贝失败时本对象不变
 Values& Values::operator=(const Values& other) {
     if (this != &other) {
         Values temp(other); // 调用拷贝构造函数进行深拷贝
-        std::swap(type_, temp.type_);
-        std::swap(boolValue_, temp.boolValue_);
-        std::swap(numberValue_, temp.numberValue_);
-        std::swap(stringValue_, temp.stringValue_);
-        std::swap(listValue_, temp.listValue_);
-        std::swap(mapValue_, temp.mapValue_);
-        std::swap(functionValue_, temp.functionValue_);
+        clearResources();
+        moveFrom(temp);
     }
     return *this;
 }
 
+Values& Values::operator=(Values&& other) noexcept {
+    if (this != &other) {
+        clearResources();
+        moveFrom(other);
+    }
+    return *this;
+}
+
+// 接管other的存储，调用前本对象必须为Null
+void Values::moveFrom(Values& other) {
+    switch (other.type_) {
+    case Null:
+        break;
+    case Bool:
+        boolValue_ = other.boolValue_;
+        break;
+    case Number:
+        numberValue_ = other.numberValue_;
+        break;
+    case String:
+        // 对象内字符串复制内容，堆上的字符串转移指针
+        if (other.inlineSize_ == kHeapString) {
+            heapString_ = other.heapString_;
+        } else {
+            memcpy(inlineString_, other.inlineString_, other.inlineSize_);
+        }
+        inlineSize_ = other.inlineSize_;
+        break;
+    case List:
+        new (&listValue_) ValuesList(std::move(other.listValue_));
+        other.listValue_.~ValuesList();
+        break;
+    case Map:
+        new (&mapValue_) ValuesMap();
+        mapValue_.swap(other.mapValue_);
+        other.mapValue_.~ValuesMap();
+        break;
+    case Function:
+        functionValue_ = other.functionValue_;
+        break;
+    }
+    type_ = other.type_;
+    other.type_ = Null;
+    other.inlineSize_ = 0;
+}
+
+// 设为字符串s，调用前本对象必须为Null
+void Values::assignString(std::string_view s) {
+    if (s.size() <= kInlineStringCapacity) {
+        memcpy(inlineString_, s.data(), s.size());
+        inlineSize_ = static_cast<uint8_t>(s.size());
+    } else {
+        heapString_.data = new char[s.size()];
+        memcpy(heapString_.data, s.data(), s.size());
+        heapString_.size = s.size();
+        inlineSize_ = kHeapString;
+    }
+    type_ = String;
+}
+
 // 清理资源
 void Values::clearResources() {
-    // 释放列表中的所有元素
-    if (type_ == List) {
-        for (std::vector<Values*>::iterator it = listValue_.begin(); it != listValue_.end(); ++it) {
-            delete *it;
+    switch (type_) {
+    case String:
+        if (inlineSize_ == kHeapString) {
+            delete[] heapString_.data;
         }
-        listValue_.clear();
-    }
-    
-    // 释放映射中的所有元素
-    if (type_ == Map) {
-        for (std::map<std::string, Values*>::iterator it = mapValue_.begin(); it != mapValue_.end(); ++it) {
+        break;
+    case List:
+        // 元素按值存放，随列表一起析构
+        listValue_.~ValuesList();
+        break;
+    case Map:
+        // 释放映射中的所有元素
+        for (ValuesMap::iterator it = mapValue_.begin(); it != mapValue_.end(); ++it) {
             delete it->second;
         }
-        mapValue_.clear();
+        mapValue_.~ValuesMap();
+        break;
+    default:
+        // 函数值不需要释放，它由外部管理
+        break;
     }
-    
-    // 函数值不需要释放，它由外部管理
+    type_ = Null;
+    inlineSize_ = 0;
 }
 
 // 工厂方法实现
@@ -126,7 +314,7 @@ Values* Values::MakeNumber(double n) {
     return new Values(n);
 }
 
-Values* Values::MakeString(const std::string& s) {
+Values* Values::MakeString(std::string_view s) {
     return new Values(s);
 }
 
@@ -163,24 +351,32 @@ double Values::AsNumber() const {
     return numberValue_;
 }
 
-const std::string& Values::AsString() const {
+std::string_view Values::AsString() const {
     if (!IsString()) throw ValueError(TypeError, "not a string");
-    return stringValue_;
+    if (inlineSize_ == kHeapString) {
+        return std::string_view(heapString_.data, heapString_.size);
+    }
+    return std::string_view(inlineString_, inlineSize_);
+}
+
+const ValuesList& Values::AsList() const {
+    if (!IsList()) throw ValueError(TypeError, "not a list");
+    return listValue_;
 }
 
-const std::vector<Values*>& Values::AsList() const {
+ValuesList& Values::AsList() {
     if (!IsList()) throw ValueError(TypeError, "not a list");
     return listValue_;
 }
 
 // 常量版本的AsMap()实现
-const std::map<std::string, Values*>& Values::AsMap() const {
+const ValuesMap& Values::AsMap() const {
     if (!IsMap()) throw ValueError(TypeError, "not a map");
     return mapValue_;
 }
 
 // 添加非常量版本的AsMap()实现
-std::map<std::string, Values*>& Values::AsMap() {
+ValuesMap& Values::AsMap() {
     if (!IsMap()) throw ValueError(TypeError, "not a map");
     return mapValue_;
 }
@@ -216,8 +412,8 @@ Values* Values::Table(const std::string& path) const {
             throw ValueError(NoTable, "not a table: " + *it);
         }
         
-        const std::map<std::string, Values*>& map = current->AsMap();
-        std::map<std::string, Values*>::const_iterator mapIt = map.find(*it);
+        const ValuesMap& map = current->AsMap();
+        ValuesMap::const_iterator mapIt = map.find(*it);
         if (mapIt == map.end() || mapIt->second == NULL) {
             throw ValueError(NoValue, "no value for key: " + *it);
         }
@@ -235,8 +431,9 @@ bool Values::Contains(const std::string& key) const {
     if (!IsMap()) {
         return false;
     }
-    const std::map<std::string, Values*>& map = AsMap();
-    return map.find(key) != map.end() && map.find(key)->second != NULL;
+    const ValuesMap& map = AsMap();
+    ValuesMap::const_iterator it = map.find(key);
+    return it != map.end() && it->second != NULL;
 }
 
 // 类似数组访问
@@ -247,7 +444,7 @@ Values*& Values::operator[](const std::string& key) {
     return mapValue_[key];
 }
 
-Values*& Values::operator[](size_t index) {
+Values& Values::operator[](size_t index) {
     if (!IsList()) {
         throw ValueError(TypeError, "not a list");
     }
@@ -257,6 +454,14 @@ Values*& Values::operator[](size_t index) {
     return listValue_[index];
 }
 
+void Values::Append(Values* item) {
+    if (!IsList()) {
+        throw ValueError(TypeError, "not a list");
+    }
+    listValue_.push_back(std::move(*item));
+    delete item;
+}
+
 // 调试输出
 void Values::Print(std::ostream& os, int indent) const {
     std::string spaces(indent, ' ');
@@ -271,19 +476,15 @@ void Values::Print(std::ostream& os, int indent) const {
         os << spaces << "\"" << AsString() << "\"" << std::endl;
     } else if (IsList()) {
         os << spaces << "[" << std::endl;
-        const std::vector<Values*>& list = AsList();
-        for (std::vector<Values*>::const_iterator it = list.begin(); it != list.end(); ++it) {
-            if (*it) {
-                (*it)->Print(os, indent + 2);
-            } else {
-                os << spaces << "  null" << std::endl;
-            }
+        const ValuesList& list = AsList();
+        for (ValuesList::const_iterator it = list.begin(); it != list.end(); ++it) {
+            it->Print(os, indent + 2);
         }
         os << spaces << "]" << std::endl;
     } else if (IsMap()) {
         os << spaces << "{" << std::endl;
-        const std::map<std::string, Values*>& map = AsMap();
-        for (std::map<std::string, Values*>::const_iterator it = map.begin(); it != map.end(); ++it) {
+        const ValuesMap& map = AsMap();
+        for (ValuesMap::const_iterator it = map.begin(); it != map.end(); ++it) {
             os << spaces << "  " << it->first << ": ";
             if (it->second) {
                 it->second->Print(os, indent + 2);
@@ -309,18 +510,14 @@ std::string Values::ToString() const {
         oss << AsString();
     } else if (IsList()) {
         // 列表的简化表示
-        const std::vector<Values*>& list = AsList();
+        const ValuesList& list = AsList();
         if (list.empty()) {
             oss << "[]";
         } else {
             oss << "[";
             for (size_t i = 0; i < list.size() && i < 3; ++i) {
                 if (i > 0) oss << ", ";
-                if (list[i]) {
-                    oss << list[i]->ToString();
-                } else {
-                    oss << "null";
-                }
+                oss << list[i].ToString();
             }
             if (list.size() > 3) {
                 oss << ", ...";
@@ -329,7 +526,7 @@ std::string Values::ToString() const {
         }
     } else if (IsMap()) {
         // Map的简化表示
-        const std::map<std::string, Values*>& map = AsMap();
+        const ValuesMap& map = AsMap();
         if (map.empty()) {
             oss << "{}";
         } else {
@@ -341,7 +538,7 @@ std::string Values::ToString() const {
                 // 输出所有键
                 oss << "{";
                 bool first = true;
-                for (std::map<std::string, Values*>::const_iterator it = map.begin(); it != map.end(); ++it) {
+                for (ValuesMap::const_iterator it = map.begin(); it != map.end(); ++it) {
                     if (!first) oss << " ";
                     first = false;
                     oss << it->first;
@@ -356,45 +553,45 @@ std::string Values::ToString() const {
 
 // values.cpp 中的 PathValue 方法
 Values* Values::PathValue(const std::string& path) const {
+    TE_TRACE(TraceValues, TraceVerbose, "PathValue: 访问路径 " << path);
+    
+    // 创建结果的副本以避免所有权问题
+    const Values* current = PathRef(path);
+    if (current) {
+        return new Values(*current);
+    }
+    
+    return NULL;
+}
+
+const Values* Values::PathRef(const std::string& path) const {
     if (path.empty()) {
         return NULL;
     }
     
-    std::cout << "PathValue: 访问路径 " << path << std::endl;
-    
-    // 分割路径
-    std::vector<std::string> parts = SplitPath(path);
-    std::cout << "  路径分割为 " << parts.size() << " 部分" << std::endl;
-    
-    // 遍历路径
+    // 逐段查找（与SplitPath的分段规则一致），不复制中间结果
     const Values* current = this;
-    
-    for (size_t i = 0; i < parts.size(); ++i) {
-        std::cout << "    查找部分 " << i+1 << ": " << parts[i] << std::endl;
-        
-        if (!current || !current->IsMap()) {
-            std::cout << "    当前节点不是map或为空" << std::endl;
+    std::string::size_type start = 0;
+    for (;;) {
+        std::string::size_type end = path.find('.', start);
+        if (!current->IsMap()) {
             return NULL;
         }
-        
-        const std::map<std::string, Values*>& map = current->AsMap();
-        std::map<std::string, Values*>::const_iterator it = map.find(parts[i]);
-        
-        if (it == map.end() || !it->second) {
-            std::cout << "    未找到键 " << parts[i] << std::endl;
+        ValuesMap::const_iterator it = current->mapValue_.find(
+            std::string_view(path).substr(start, end == std::string::npos ? std::string::npos : end - start));
+        if (it == current->mapValue_.end() || !it->second) {
             return NULL;
         }
-        
         current = it->second;
-        std::cout << "    找到部分 " << parts[i] << ", 类型: " << current->TypeName() << std::endl;
-    }
-    
-    // 创建结果的副本以避免所有权问题
-    if (current) {
-        return new Values(*current);
+        if (end == std::string::npos) {
+            return current;
+        }
+        start = end + 1;
     }
-    
-    return NULL;
+}
+
+Values* Values::PathRef(const std::string& path) {
+    return const_cast<Values*>(static_cast<const Values*>(this)->PathRef(path));
 }
 
 
@@ -473,14 +670,11 @@ Values* Values::FromYAML(const std::string& yamlContent) {
 }
 
 Values* Values::FromYAMLFile(const std::string& filename) {
-    std::ifstream file(filename);
-    if (!file.is_open()) {
+    std::string content;
+    if (!ReadFile(filename, content)) {
         throw ValueError(NoTable, "Could not open file: " + filename);
     }
-    
-    std::stringstream buffer;
-    buffer << file.rdbuf();
-    return FromYAML(buffer.str());
+    return FromYAML(content);
 }
 
 // 合并值
@@ -497,11 +691,11 @@ Values* CoalesceValues(const Values* base, const Values* overlay) {
     }
     
     std::map<std::string, Values*> result;
-    const std::map<std::string, Values*>& baseMap = base->AsMap();
-    const std::map<std::string, Values*>& overlayMap = overlay->AsMap();
+    const ValuesMap& baseMap = base->AsMap();
+    const ValuesMap& overlayMap = overlay->AsMap();
     
     // 复制base中的所有值
-    for (std::map<std::string, Values*>::const_iterator it = baseMap.begin(); it != baseMap.end(); ++it) {
+    for (ValuesMap::const_iterator it = baseMap.begin(); it != baseMap.end(); ++it) {
         if (it->second) {
             result[it->first] = new Values(*(it->second));
         } else {
@@ -510,7 +704,7 @@ Values* CoalesceValues(const Values* base, const Values* overlay) {
     }
     
     // 合并overlay中的值
-    for (std::map<std::string, Values*>::const_iterator it = overlayMap.begin(); it != overlayMap.end(); ++it) {
+    for (ValuesMap::const_iterator it = overlayMap.begin(); it != overlayMap.end(); ++it) {
         std::map<std::string, Values*>::iterator baseIt = result.find(it->first);
         if (baseIt != result.end() && baseIt->second && it->second && 
             baseIt->second->IsMap() && it->second->IsMap()) {
@@ -591,208 +785,8 @@ std::string Values::TypeName() const {
     }
 }
 
-// ================== 简易YAML解析实现（C++98，无第三方库） ==================
-struct SimpleYamlLine {
-    int indent; // 缩进空格数
-    bool isListItem;
-    std::string key;
-    std::string value;
-};
-
-static std::vector<std::string> SplitLines(const std::string& text) {
-    std::vector<std::string> lines;
-    std::string::size_type start = 0, end;
-    while ((end = text.find('\n', start)) != std::string::npos) {
-        lines.push_back(text.substr(start, end - start));
-        start = end + 1;
-    }
-    if (start < text.size()) lines.push_back(text.substr(start));
-    return lines;
-}
-
-static std::vector<SimpleYamlLine> ParseSimpleYamlLines(const std::vector<std::string>& lines) {
-    std::vector<SimpleYamlLine> result;
-    for (size_t i = 0; i < lines.size(); ++i) {
-        const std::string& line = lines[i];
-        if (line.empty()) continue;
-        size_t p = 0;
-        while (p < line.size() && (line[p] == ' ')) ++p;
-        if (p == line.size() || line[p] == '#') continue; // 空行或注释
-        int indent = (int)p;
-        std::string content = line.substr(p);
-        bool isListItem = false;
-        std::string key, value;
-        if (content.size() >= 2 && content[0] == '-' && content[1] == ' ') {
-            isListItem = true;
-            value = content.substr(2);
-        } else {
-            size_t pos = content.find(':');
-            if (pos != std::string::npos) {
-                key = content.substr(0, pos);
-                value = content.substr(pos + 1);
-                if (!value.empty() && value[0] == ' ') value = value.substr(1);
-            }
-        }
-        
-        // --- 新增：去除 value 末尾的注释 --- 
-        size_t commentPos = value.find('#');
-        if (commentPos != std::string::npos) {
-            // 检查 # 是否在引号内（非常简化的检查，仅处理结尾引号）
-            bool inQuotes = (!value.empty() && value[0] == '"' && value[value.size()-1] == '"') ||
-                            (!value.empty() && value[0] == '\'' && value[value.size()-1] == '\'');
-            if (!inQuotes) { // 如果不在引号内（或无法判断引号），则去除注释
-                 value = value.substr(0, commentPos);
-            }
-        }
-        // 去除 value 末尾可能存在的空格
-        size_t endPos = value.find_last_not_of(" \t");
-        if (endPos != std::string::npos) {
-            value = value.substr(0, endPos + 1);
-        } else if (value.find_first_of(" \t") == 0 && value.length() > 0) {
-             // 如果原始值全是空格，则置空
-             value = "";
-        }
-        // --- 结束注释去除 --- 
-        
-        SimpleYamlLine yl;
-        yl.indent = indent;
-        yl.isListItem = isListItem;
-        yl.key = key;
-        yl.value = value;
-        result.push_back(yl);
-    }
-    return result;
-}
-
-static Values* ParseSimpleYamlScalar(const std::string& value) {
-    if (value == "null" || value == "~") return Values::MakeNull();
-    if (value == "true") return Values::MakeBool(true);
-    if (value == "false") return Values::MakeBool(false);
-    if (!value.empty() && value[0] == '"' && value[value.size()-1] == '"')
-        return Values::MakeString(value.substr(1, value.size()-2));
-    if (!value.empty() && value[0] == '\'' && value[value.size()-1] == '\'')
-        return Values::MakeString(value.substr(1, value.size()-2));
-    // 尝试解析为数字
-    char* endptr = 0;
-    double num = strtod(value.c_str(), &endptr);
-    if (endptr != value.c_str() && *endptr == '\0')
-        return Values::MakeNumber(num);
-    // 默认字符串
-    return Values::MakeString(value);
-}
-
-static Values* ParseSimpleYamlBlock(const std::vector<SimpleYamlLine>& lines, int& idx, int parentIndent) {
-    if (idx >= (int)lines.size()) return Values::MakeNull();
-
-    // 判断是列表还是map
-    if (lines[idx].isListItem) {
-        // 列表
-        std::vector<Values*> list;
-        while (idx < (int)lines.size() && lines[idx].isListItem && lines[idx].indent == parentIndent) {
-            // 判断本行是标量还是map
-            if (!lines[idx].value.empty()) {
-                // 进一步判断 value 是否为 key: value 形式（即 - name: ENV）
-                size_t pos = lines[idx].value.find(':');
-                if (pos != std::string::npos && pos != lines[idx].value.length() - 1) {
-                    // 形如 - name: ENV，解析为map
-                    std::string key = lines[idx].value.substr(0, pos);
-                    std::string value = lines[idx].value.substr(pos + 1);
-                    // 去除空白
-                    key.erase(0, key.find_first_not_of(" \t"));
-                    key.erase(key.find_last_not_of(" \t") + 1);
-                    value.erase(0, value.find_first_not_of(" \t"));
-                    value.erase(value.find_last_not_of(" \t") + 1);
-
-                    std::map<std::string, Values*> map;
-                    map[key] = ParseSimpleYamlScalar(value);
-
-                    // 检查下方是否还有同级缩进的字段，属于同一个map
-                    int itemIndent = lines[idx].indent;
-                    int nextIndent = itemIndent + 2;
-                    ++idx;
-                    while (idx < (int)lines.size() && !lines[idx].isListItem && lines[idx].indent == nextIndent) {
-                        std::string subKey = lines[idx].key;
-                        std::string subValue = lines[idx].value;
-                        if (!subKey.empty()) {
-                            if (!subValue.empty()) {
-                                map[subKey] = ParseSimpleYamlScalar(subValue);
-                                ++idx;
-                            } else {
-                                ++idx;
-                                map[subKey] = ParseSimpleYamlBlock(lines, idx, nextIndent + 2);
-                            }
-                        } else {
-                            ++idx;
-                        }
-                    }
-                    list.push_back(Values::MakeMap(map));
-                } else {
-                    // 普通标量
-                list.push_back(ParseSimpleYamlScalar(lines[idx].value));
-                ++idx;
-                }
-            } else {
-                // 该 list item 没有直接 value，递归解析为 map 或 list
-                ++idx;
-                list.push_back(ParseSimpleYamlBlock(lines, idx, parentIndent + 2));
-            }
-        }
-        return Values::MakeList(list);
-    } else {
-        // map
-        std::map<std::string, Values*> map;
-        while (idx < (int)lines.size() && lines[idx].indent == parentIndent && !lines[idx].isListItem) {
-            std::string key = lines[idx].key;
-            std::string value = lines[idx].value;
-            int curIndent = lines[idx].indent;
-            if (!value.empty()) {
-                // 处理空map/空list
-                if (value == "{}") {
-                    map[key] = Values::MakeMap(std::map<std::string, Values*>());
-                } else if (value == "[]") {
-                    map[key] = Values::MakeList(std::vector<Values*>());
-                } else if (value == "|" || value == ">") {
-                    // 多行字符串
-                    std::string multiLine;
-                    ++idx;
-                    while (idx < (int)lines.size() && lines[idx].indent > curIndent) {
-                        multiLine += lines[idx].value;
-                        multiLine += "\n";
-                        ++idx;
-                    }
-                    map[key] = Values::MakeString(multiLine);
-                    continue;
-                } else {
-                    map[key] = ParseSimpleYamlScalar(value);
-                }
-                ++idx;
-            } else {
-                ++idx;
-                map[key] = ParseSimpleYamlBlock(lines, idx, parentIndent + 2);
-            }
-        }
-        return Values::MakeMap(map);
-    }
-}
-
-Values* ParseSimpleYAML(const std::string& yamlText) {
-    std::vector<std::string> lines = SplitLines(yamlText);
-    std::vector<SimpleYamlLine> parsedLines = ParseSimpleYamlLines(lines);
-    int idx = 0;
-    return ParseSimpleYamlBlock(parsedLines, idx, 0);
-}
-
-Values* ParseSimpleYAMLFile(const std::string& filename) {
-    std::ifstream file(filename.c_str());
-    if (!file.is_open()) {
-        throw ValueError(NoTable, "Could not open file: " + filename);
-    }
-    std::stringstream buffer;
-    std::string line;
-    while (std::getline(file, line)) {
-        buffer << line << "\n";
-    }
-    return ParseSimpleYAML(buffer.str());
+ValuesSnapshot MakeValuesSnapshot(Values* value) {
+    return ValuesSnapshot(value);
 }
 
-} // namespace template_engine
\ No newline at end of file
+} // namespace template_engine
@@ -3,13 +3,19 @@
 #define TEMPLATE_VALUES_H
 
 #include <string>
+#include <string_view>
 #include <map>
+#include <cstdint>
+#include <utility>
+#include <memory>
 #include <vector>
 #include <iostream>
 #include <fstream>
 #include <sstream>
 #include <stdexcept>
 
+#include "key_hash.h"
+
 namespace template_engine {
 
 // 前向声明
@@ -19,7 +25,8 @@ class TemplateFn;
 enum ValueErrorType {
     NoTable,     // 表不存在
     NoValue,     // 值不存在
-    TypeError    // 类型错误
+    TypeError,   // 类型错误
+    SyntaxError  // YAML语法错误
 };
 
 // 值错误类
@@ -34,7 +41,74 @@ private:
     ValueErrorType type_;
 };
 
+class Values;
+
+// 映射值的存储：按键排序的连续数组，每项保存键的哈希。
+// 键较少时顺序比较哈希，较多时二分查找；遍历顺序与std::map相同（按键的字典序）。
+// 接口是std::map的子集，元素的first为键、second为值；插入会使迭代器和引用失效
+class ValuesMap {
+public:
+    struct Entry {
+        std::string first;  // 键
+        Values* second;     // 值，由所属的Values释放
+        uint32_t hash;      // first的哈希
+    };
+    typedef std::vector<Entry>::iterator iterator;
+    typedef std::vector<Entry>::const_iterator const_iterator;
+
+    iterator begin() { return entries_.begin(); }
+    iterator end() { return entries_.end(); }
+    const_iterator begin() const { return entries_.begin(); }
+    const_iterator end() const { return entries_.end(); }
+    size_t size() const { return entries_.size(); }
+    bool empty() const { return entries_.empty(); }
+    void clear() { entries_.clear(); }
+    void reserve(size_t n) { entries_.reserve(n); }
+    void swap(ValuesMap& other) { entries_.swap(other.entries_); }
+
+    iterator find(std::string_view key);
+    const_iterator find(std::string_view key) const;
+    // 使用预先算好的哈希查找，hash必须等于Hash(key)
+    iterator find(std::string_view key, uint32_t hash);
+    const_iterator find(std::string_view key, uint32_t hash) const;
+    // 先核对第hint项，命中时不再查找；否则正常查找，找到后把位置写回hint。
+    // 同一个键反复在结构相同的映射中查找时（内联缓存）使用
+    const_iterator find(std::string_view key, uint32_t hash, uint32_t& hint) const;
+    size_t count(std::string_view key) const { return find(key) == end() ? 0 : 1; }
+
+    // 键不存在时插入NULL
+    Values*& operator[](std::string_view key);
+    // 键已存在时不插入，返回已有的项
+    std::pair<iterator, bool> insert(std::string_view key, Values* value);
+    std::pair<iterator, bool> insert(const std::pair<std::string, Values*>& kv) {
+        return insert(kv.first, kv.second);
+    }
+    iterator erase(iterator it) { return entries_.erase(it); }
+
+    // 批量构建：append直接追加，不保持顺序也不检查重复，追加完后必须调用sort()才能查找。
+    // 键无序到达时（如解析YAML）避免insert逐个移动元素，整体只排序一次
+    void append(std::string_view key, Values* value);
+    // 按键排序；重复的键以最后追加的为准，被覆盖的值在这里释放
+    void sort();
+
+    static uint32_t Hash(std::string_view key) { return HashKey(key); }
+
+    // 不超过此数量的映射按哈希顺序比较
+    static const size_t kLinearScanLimit = 16;
+
+private:
+    size_t lookup(std::string_view key, uint32_t hash) const; // 找不到时返回size()
+    size_t lowerBound(std::string_view key) const;
+
+    std::vector<Entry> entries_;
+};
+
+// 列表的存储：元素按值连续存放
+typedef std::vector<Values> ValuesList;
+
 // 值类型定义
+// 各类型的存储共用一块空间，只有当前类型的成员有效；
+// 不超过kInlineStringCapacity字节的字符串直接存放在对象内，更长的字符串单独分配
 class Values {
 public:
     // 值类型枚举
@@ -48,24 +122,14 @@ public:
         Function  // 添加Function类型
     };
 
-
-    //类型判断
-    Type type_;
-
-    // 实际值存储
-    bool boolValue_;
-    double numberValue_;
-    std::string stringValue_;
-    std::vector<Values*> listValue_;
-    std::map<std::string, Values*> mapValue_;
-    TemplateFn* functionValue_;  // 添加函数值
-
+    // 对象内字符串的最大长度
+    static const size_t kInlineStringCapacity = 24;
 
     // 构造函数
     Values();
     explicit Values(bool b);
     explicit Values(double n);
-    explicit Values(const std::string& s);
+    explicit Values(std::string_view s);
     explicit Values(const std::vector<Values*>& l);
     explicit Values(const std::map<std::string, Values*>& m);
     explicit Values(TemplateFn* fn);  // 添加函数构造器
@@ -76,12 +140,15 @@ public:
     // 复制构造函数和赋值运算符（防止重复删除内存）
     Values(const Values& other);
     Values& operator=(const Values& other);
+    // 移动后other为Null
+    Values(Values&& other) noexcept;
+    Values& operator=(Values&& other) noexcept;
 
     // 工厂方法
     static Values* MakeNull();
     static Values* MakeBool(bool b);
     static Values* MakeNumber(double n);
-    static Values* MakeString(const std::string& s);
+    static Values* MakeString(std::string_view s);
     static Values* MakeList(const std::vector<Values*>& l);
     static Values* MakeMap(const std::map<std::string, Values*>& m);
     static Values* MakeFunction(TemplateFn* fn);  // 添加函数工厂方法
@@ -101,15 +168,20 @@ public:
     // 值访问
     bool AsBool() const;
     double AsNumber() const;
-    const std::string& AsString() const;
-    const std::vector<Values*>& AsList() const;
-    const std::map<std::string, Values*>& AsMap() const;
-    std::map<std::string, Values*>& AsMap();
+    // 返回的视图在本对象被修改或释放前有效
+    std::string_view AsString() const;
+    const ValuesList& AsList() const;
+    ValuesList& AsList();
+    const ValuesMap& AsMap() const;
+    ValuesMap& AsMap();
     TemplateFn* AsFunction() const;  // 添加函数访问方法
 
     // 使用路径访问值 (如 foo.bar.baz)
     Values* Table(const std::string& path) const;
     Values* PathValue(const std::string& path) const;
+    // 按路径借用值，不复制；返回的指针指向本对象内部，本对象被修改或释放后失效
+    const Values* PathRef(const std::string& path) const;
+    Values* PathRef(const std::string& path);
 
     
     // 序列化
@@ -128,7 +200,10 @@ public:
     
     // 类似数组访问
     Values*& operator[](const std::string& key);
-    Values*& operator[](size_t index);
+    Values& operator[](size_t index);
+
+    // 把item移到列表末尾并释放item
+    void Append(Values* item);
     
     // 调试输出
     void Print(std::ostream& os = std::cout, int indent = 0) const;
@@ -146,26 +221,62 @@ public:
     static std::vector<std::string> SplitPath(const std::string& path);
     
     // 辅助函数
-    void printMap(const std::map<std::string, Values*>& map, 
+    void printMap(const ValuesMap& map, 
                   std::ostream& os, int indent) const;
-    void printList(const std::vector<Values*>& list, 
+    void printList(const ValuesList& list, 
                    std::ostream& os, int indent) const;
                    
                    
-    // 清理资源
+    // 清理资源，之后为Null
     void clearResources();
 
     // 简易YAML解析接口声明
     Values* ParseSimpleYAML(const std::string& yamlText);
     Values* ParseSimpleYAMLFile(const std::string& filename);
+
+private:
+    // 存放在堆上的长字符串
+    struct HeapString {
+        char* data;
+        size_t size;
+    };
+
+    // inlineSize_取此值时字符串在堆上
+    static const uint8_t kHeapString = 0xFF;
+
+    void assignString(std::string_view s);
+    void moveFrom(Values& other);
+
+    // 实际值存储，由type_决定有效的成员
+    union {
+        bool boolValue_;
+        double numberValue_;
+        TemplateFn* functionValue_;  // 添加函数值
+        HeapString heapString_;
+        char inlineString_[kInlineStringCapacity];
+        ValuesList listValue_;
+        ValuesMap mapValue_;
+    };
+
+    //类型判断
+    Type type_;
+    uint8_t inlineSize_;  // 对象内字符串的长度
 };
 
 // ================== 这里是修正后的声明 ==================
 // 在namespace template_engine内、class Values定义后声明
 Values* ParseSimpleYAML(const std::string& yamlText);
+Values* ParseSimpleYAML(const char* yamlText, size_t size);
 Values* ParseSimpleYAMLFile(const std::string& filename);
 // ================== 声明结束 ==================
 
+// 只读的共享值快照：解析一次后由多个渲染（可以在不同线程上）同时借用，不再复制；
+// 最后一个持有者释放时删除
+typedef std::shared_ptr<const Values> ValuesSnapshot;
+
+// 接管value生成快照，之后不能再通过原指针修改或释放它
+ValuesSnapshot MakeValuesSnapshot(Values* value);
+
 // 用于模板渲染的选项
 struct RenderOptions {
     std::string name;
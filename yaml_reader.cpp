@@ -0,0 +1,689 @@
+// yaml_reader.cpp
+// values文件使用的YAML子集：块映射、块序列、流式 {} / []、块标量 | 和 >、单双引号标量和注释。
+// 读取器在输入缓冲区上单遍扫描，边读边构建Values，不生成中间的行列表
+#include "values.h"
+#include "file_loader.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+
+namespace template_engine {
+
+namespace {
+
+class YamlReader {
+public:
+    YamlReader(const char* data, size_t size)
+        : p_(data), end_(data + size), lineBegin_(data), line_(1) {}
+
+    Values* ReadDocument();
+
+private:
+    // ---------- 位置 ----------
+    int column() const { return static_cast<int>(p_ - lineBegin_); }
+    bool isBlank(char c) const { return c == ' ' || c == '\t'; }
+    bool isBreak(const char* q) const { return q >= end_ || *q == '\n' || *q == '\r'; }
+    // q处是否为分隔符（空白或行尾），用于判断"- "和": "
+    bool isSeparator(const char* q) const { return isBreak(q) || isBlank(*q); }
+    bool atLineEnd() const { return isBreak(p_); }
+    bool atComment() const { return p_ < end_ && *p_ == '#'; }
+
+    void skipBlanks() {
+        while (p_ < end_ && isBlank(*p_)) {
+            ++p_;
+        }
+    }
+    void skipToLineEnd() {
+        while (p_ < end_ && *p_ != '\n') {
+            ++p_;
+        }
+    }
+    void newline() {
+        if (p_ < end_ && *p_ == '\n') {
+            ++p_;
+            lineBegin_ = p_;
+            ++line_;
+        }
+    }
+
+    // 跳过空白、注释和空行，停在下一个内容字符上；没有更多内容时返回false
+    bool nextContent() {
+        for (;;) {
+            skipBlanks();
+            if (p_ >= end_) {
+                return false;
+            }
+            if (*p_ == '#' || *p_ == '\r' || *p_ == '\n') {
+                skipToLineEnd();
+                newline();
+                continue;
+            }
+            return true;
+        }
+    }
+
+    bool isSequenceItem() const { return p_ < end_ && *p_ == '-' && isSeparator(p_ + 1); }
+    // 行首的"---"或"..."
+    bool atDocumentMarker() const {
+        return column() == 0 && end_ - p_ >= 3 &&
+               (memcmp(p_, "---", 3) == 0 || memcmp(p_, "...", 3) == 0) && isSeparator(p_ + 3);
+    }
+    bool looksLikeKey() const;
+
+    void error(const std::string& message) const {
+        std::ostringstream oss;
+        oss << "yaml: line " << line_ << ": " << message;
+        throw ValueError(SyntaxError, oss.str());
+    }
+
+    // ---------- 块结构 ----------
+    Values* parseNode(int parentIndent);
+    Values* parseMapping(int indent);
+    Values* parseSequence(int indent);
+    Values* parseMappingValue(int indent);
+    Values* parseInline(int parentIndent);
+    Values* parseBlockScalar(int parentIndent);
+
+    // ---------- 标量 ----------
+    std::string readKey();
+    std::string readQuoted();
+    std::string readPlain(int parentIndent);
+    static Values* resolvePlain(const std::string& value);
+
+    // ---------- 流式集合 ----------
+    void skipFlowSpace();
+    Values* parseFlowNode();
+    Values* parseFlowMapping();
+    Values* parseFlowSequence();
+    std::string readFlowPlain();
+
+    const char* p_;
+    const char* end_;
+    const char* lineBegin_;
+    int line_;
+};
+
+// 把值追加到正在构建的映射；键按出现顺序追加，映射构建完后由finishMap统一排序
+static void putMapEntry(Values* map, const std::string& key, Values* value) {
+    map->AsMap().append(key, value);
+}
+
+// 映射的所有键都已追加：排序一次，重复的键以后出现的为准
+static void finishMap(Values* map) {
+    map->AsMap().sort();
+}
+
+static void appendUtf8(std::string& out, unsigned long cp) {
+    if (cp < 0x80) {
+        out += static_cast<char>(cp);
+    } else if (cp < 0x800) {
+        out += static_cast<char>(0xC0 | (cp >> 6));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    } else if (cp < 0x10000) {
+        out += static_cast<char>(0xE0 | (cp >> 12));
+        out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    } else {
+        out += static_cast<char>(0xF0 | (cp >> 18));
+        out += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+        out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    }
+}
+
+Values* YamlReader::ReadDocument() {
+    // UTF-8 BOM
+    if (end_ - p_ >= 3 && memcmp(p_, "\xEF\xBB\xBF", 3) == 0) {
+        p_ += 3;
+        lineBegin_ = p_;
+    }
+    if (!nextContent()) {
+        return Values::MakeNull();
+    }
+    // 文档开始标记
+    if (column() == 0 && end_ - p_ >= 3 && memcmp(p_, "---", 3) == 0 && isSeparator(p_ + 3)) {
+        p_ += 3;
+        if (!nextContent()) {
+            return Values::MakeNull();
+        }
+    }
+
+    Values* root = parseNode(-1);
+    if (nextContent()) {
+        // 文档结束标记或下一个文档之后的内容忽略
+        if (!atDocumentMarker()) {
+            delete root;
+            error("unexpected content at column " + std::to_string(column() + 1));
+        }
+    }
+    return root;
+}
+
+// 当前行从p_开始是否为"键:"（冒号后面是空白或行尾）
+bool YamlReader::looksLikeKey() const {
+    const char* q = p_;
+    if (q >= end_) {
+        return false;
+    }
+    if (*q == '"' || *q == '\'') {
+        char quote = *q++;
+        while (q < end_ && *q != '\n') {
+            if (quote == '"' && *q == '\\' && q + 1 < end_) {
+                q += 2;
+                continue;
+            }
+            if (*q == quote) {
+                if (quote == '\'' && q + 1 < end_ && q[1] == '\'') {
+                    q += 2;
+                    continue;
+                }
+                ++q;
+                while (q < end_ && isBlank(*q)) {
+                    ++q;
+                }
+                return q < end_ && *q == ':' && isSeparator(q + 1);
+            }
+            ++q;
+        }
+        return false;
+    }
+    if (*q == '{' || *q == '[' || *q == '|' || *q == '>' || *q == '#') {
+        return false;
+    }
+    for (; q < end_ && *q != '\n'; ++q) {
+        if (*q == ':' && isSeparator(q + 1)) {
+            return true;
+        }
+        if (*q == '#' && q > p_ && isBlank(q[-1])) {
+            return false;
+        }
+    }
+    return false;
+}
+
+// p_在节点的第一个字符上；parentIndent是所属集合的缩进
+Values* YamlReader::parseNode(int parentIndent) {
+    if (isSequenceItem()) {
+        return parseSequence(column());
+    }
+    if (looksLikeKey()) {
+        return parseMapping(column());
+    }
+    return parseInline(parentIndent);
+}
+
+Values* YamlReader::parseMapping(int indent) {
+    Values* map = Values::MakeMap(std::map<std::string, Values*>());
+    try {
+        for (;;) {
+            if (!looksLikeKey()) {
+                error("expected a mapping key");
+            }
+            std::string key = readKey();
+            putMapEntry(map, key, parseMappingValue(indent));
+            if (!nextContent() || column() != indent || isSequenceItem() || atDocumentMarker()) {
+                break;
+            }
+        }
+    } catch (...) {
+        delete map;
+        throw;
+    }
+    finishMap(map);
+    return map;
+}
+
+// "键:"之后的值：同一行的内联值，或下面缩进更深的块（与键同缩进的序列也属于这个键）
+Values* YamlReader::parseMappingValue(int indent) {
+    skipBlanks();
+    if (!atLineEnd() && !atComment()) {
+        return parseInline(indent);
+    }
+    if (!nextContent()) {
+        return Values::MakeNull();
+    }
+    if (column() > indent) {
+        return parseNode(indent);
+    }
+    if (column() == indent && isSequenceItem()) {
+        return parseSequence(indent);
+    }
+    return Values::MakeNull();
+}
+
+Values* YamlReader::parseSequence(int indent) {
+    Values* list = Values::MakeList(std::vector<Values*>());
+    try {
+        for (;;) {
+            ++p_; // '-'
+            skipBlanks();
+            Values* item;
+            if (!atLineEnd() && !atComment()) {
+                item = parseNode(indent);
+            } else if (nextContent() && column() > indent) {
+                item = parseNode(indent);
+            } else {
+                item = Values::MakeNull();
+            }
+            list->Append(item);
+            if (!nextContent() || column() != indent || !isSequenceItem()) {
+                break;
+            }
+        }
+    } catch (...) {
+        delete list;
+        throw;
+    }
+    return list;
+}
+
+// 行内的标量、流式集合或块标量
+Values* YamlReader::parseInline(int parentIndent) {
+    char c = *p_;
+    if (c == '|' || c == '>') {
+        return parseBlockScalar(parentIndent);
+    }
+    if (c == '{' || c == '[') {
+        return parseFlowNode();
+    }
+    if (c == '"' || c == '\'') {
+        return Values::MakeString(readQuoted());
+    }
+    return resolvePlain(readPlain(parentIndent));
+}
+
+// |、|-、|+、>、>-、>+，可带缩进指示数字
+Values* YamlReader::parseBlockScalar(int parentIndent) {
+    bool folded = *p_++ == '>';
+    int chomp = 0; // -1 去掉末尾换行，0 保留一个，1 全部保留
+    int explicitIndent = 0;
+    for (int i = 0; i < 2 && p_ < end_; ++i) {
+        if (*p_ == '-' || *p_ == '+') {
+            chomp = *p_ == '-' ? -1 : 1;
+            ++p_;
+        } else if (*p_ >= '1' && *p_ <= '9') {
+            explicitIndent = *p_ - '0';
+            ++p_;
+        }
+    }
+    skipBlanks();
+    if (!atLineEnd() && !atComment()) {
+        error("unexpected text after block scalar indicator");
+    }
+    skipToLineEnd();
+
+    int blockIndent = explicitIndent ? (parentIndent < 0 ? 0 : parentIndent) + explicitIndent : -1;
+    std::string text;
+    int breaks = 0;               // 上一个内容行之后的换行数
+    bool hasContent = false;
+    bool lastMoreIndented = false;
+    while (p_ < end_) {
+        newline();
+        if (p_ >= end_) {
+            break;
+        }
+        const char* lineStart = p_;
+        skipBlanks();
+        if (atLineEnd()) {
+            // 空行
+            ++breaks;
+            skipToLineEnd();
+            continue;
+        }
+        int indent = static_cast<int>(p_ - lineStart);
+        if (blockIndent < 0) {
+            if (indent <= parentIndent) {
+                p_ = lineStart;
+                break;
+            }
+            blockIndent = indent;
+        }
+        if (indent < blockIndent) {
+            p_ = lineStart;
+            break;
+        }
+
+        p_ = lineStart + blockIndent;
+        const char* contentStart = p_;
+        skipToLineEnd();
+        const char* contentEnd = p_;
+        if (contentEnd > contentStart && contentEnd[-1] == '\r') {
+            --contentEnd;
+        }
+
+        // 折叠：相邻的普通行之间的单个换行变成空格，空行保留为换行；缩进更深的行保持原样
+        bool moreIndented = isBlank(*contentStart);
+        if (!hasContent) {
+            text.append(breaks, '\n');
+        } else if (folded && !moreIndented && !lastMoreIndented) {
+            if (breaks == 1) {
+                text += ' ';
+            } else {
+                text.append(breaks - 1, '\n');
+            }
+        } else {
+            text.append(breaks, '\n');
+        }
+        text.append(contentStart, contentEnd - contentStart);
+        hasContent = true;
+        lastMoreIndented = moreIndented;
+        breaks = 1;
+    }
+
+    if (chomp == 0 && hasContent) {
+        text += '\n';
+    } else if (chomp > 0) {
+        text.append(breaks, '\n');
+    }
+    return Values::MakeString(text);
+}
+
+// 键：引号键或到": "为止的普通键；读完后p_在冒号之后
+std::string YamlReader::readKey() {
+    std::string key;
+    if (*p_ == '"' || *p_ == '\'') {
+        key = readQuoted();
+        skipBlanks();
+    } else {
+        const char* start = p_;
+        while (!(*p_ == ':' && isSeparator(p_ + 1))) {
+            ++p_;
+        }
+        const char* end = p_;
+        while (end > start && isBlank(end[-1])) {
+            --end;
+        }
+        key.assign(start, end - start);
+    }
+    ++p_; // ':'
+    return key;
+}
+
+// 单引号或双引号标量，可以跨行（换行折叠为空格）
+std::string YamlReader::readQuoted() {
+    char quote = *p_++;
+    std::string out;
+    for (;;) {
+        if (p_ >= end_) {
+            error("unterminated quoted string");
+        }
+        char c = *p_;
+        if (c == quote) {
+            if (quote == '\'' && p_ + 1 < end_ && p_[1] == '\'') {
+                out += '\'';
+                p_ += 2;
+                continue;
+            }
+            ++p_;
+            return out;
+        }
+        if (c == '\n' || c == '\r') {
+            // 去掉行尾空白，换行折叠：一个换行变为空格，之后的每个空行变为"\n"
+            while (!out.empty() && isBlank(out[out.size() - 1])) {
+                out.erase(out.size() - 1);
+            }
+            int lines = 0;
+            while (p_ < end_ && (*p_ == '\n' || *p_ == '\r' || isBlank(*p_))) {
+                if (*p_ == '\n') {
+                    newline();
+                    ++lines;
+                } else {
+                    ++p_;
+                }
+            }
+            if (lines <= 1) {
+                out += ' ';
+            } else {
+                out.append(lines - 1, '\n');
+            }
+            continue;
+        }
+        if (quote == '"' && c == '\\') {
+            if (p_ + 1 >= end_) {
+                error("unterminated quoted string");
+            }
+            char e = p_[1];
+            p_ += 2;
+            switch (e) {
+                case 'n': out += '\n'; break;
+                case 't': case '\t': out += '\t'; break;
+                case 'r': out += '\r'; break;
+                case '0': out += '\0'; break;
+                case 'a': out += '\a'; break;
+                case 'b': out += '\b'; break;
+                case 'e': out += '\x1B'; break;
+                case 'f': out += '\f'; break;
+                case 'v': out += '\v'; break;
+                case ' ': out += ' '; break;
+                case '"': out += '"'; break;
+                case '/': out += '/'; break;
+                case '\\': out += '\\'; break;
+                case 'x': case 'u': case 'U': {
+                    int digits = e == 'x' ? 2 : (e == 'u' ? 4 : 8);
+                    if (end_ - p_ < digits) {
+                        error("invalid escape sequence");
+                    }
+                    std::string hex(p_, digits);
+                    char* hexEnd = NULL;
+                    unsigned long cp = strtoul(hex.c_str(), &hexEnd, 16);
+                    if (*hexEnd != '\0') {
+                        error("invalid escape sequence");
+                    }
+                    appendUtf8(out, cp);
+                    p_ += digits;
+                    break;
+                }
+                case '\n':
+                    // 转义的换行：连接下一行，去掉其前导空白
+                    --p_;
+                    newline();
+                    skipBlanks();
+                    break;
+                default:
+                    error(std::string("invalid escape sequence \\") + e);
+            }
+            continue;
+        }
+        out += c;
+        ++p_;
+    }
+}
+
+// 普通标量：到行尾或" #"为止；后面缩进更深的非键行是续行，以空格连接
+std::string YamlReader::readPlain(int parentIndent) {
+    std::string out;
+    for (;;) {
+        const char* start = p_;
+        while (p_ < end_ && *p_ != '\n' && !(*p_ == '#' && p_ > start && isBlank(p_[-1]))) {
+            ++p_;
+        }
+        const char* end = p_;
+        while (end > start && (isBlank(end[-1]) || end[-1] == '\r')) {
+            --end;
+        }
+        out.append(start, end - start);
+        if (atComment()) {
+            return out; // 注释之后不再有续行
+        }
+
+        // 查看下一行是否为续行
+        const char* savedP = p_;
+        const char* savedLine = lineBegin_;
+        int savedLineNo = line_;
+        if (!nextContent() || column() <= parentIndent || isSequenceItem() || looksLikeKey()) {
+            p_ = savedP;
+            lineBegin_ = savedLine;
+            line_ = savedLineNo;
+            return out;
+        }
+        int lines = line_ - savedLineNo;
+        if (lines <= 1) {
+            out += ' ';
+        } else {
+            out.append(lines - 1, '\n');
+        }
+    }
+}
+
+// 普通标量的类型：null / ~、true / false、数字，其余为字符串
+Values* YamlReader::resolvePlain(const std::string& value) {
+    if (value == "null" || value == "~") return Values::MakeNull();
+    if (value == "true") return Values::MakeBool(true);
+    if (value == "false") return Values::MakeBool(false);
+    char* endptr = 0;
+    double num = strtod(value.c_str(), &endptr);
+    if (endptr != value.c_str() && *endptr == '\0')
+        return Values::MakeNumber(num);
+    return Values::MakeString(value);
+}
+
+// 流式集合中的空白可以包括换行和注释
+void YamlReader::skipFlowSpace() {
+    for (;;) {
+        while (p_ < end_ && (isBlank(*p_) || *p_ == '\r')) {
+            ++p_;
+        }
+        if (p_ < end_ && *p_ == '#') {
+            skipToLineEnd();
+        }
+        if (p_ < end_ && *p_ == '\n') {
+            newline();
+            continue;
+        }
+        return;
+    }
+}
+
+Values* YamlReader::parseFlowNode() {
+    skipFlowSpace();
+    if (p_ >= end_) {
+        error("unexpected end of flow collection");
+    }
+    if (*p_ == '{') {
+        return parseFlowMapping();
+    }
+    if (*p_ == '[') {
+        return parseFlowSequence();
+    }
+    if (*p_ == '"' || *p_ == '\'') {
+        return Values::MakeString(readQuoted());
+    }
+    std::string value = readFlowPlain();
+    if (value.empty()) {
+        return Values::MakeNull();
+    }
+    return resolvePlain(value);
+}
+
+// 流式普通标量：到 , [ ] { } 或": "为止
+std::string YamlReader::readFlowPlain() {
+    const char* start = p_;
+    while (p_ < end_ && *p_ != '\n' && *p_ != ',' && *p_ != '[' && *p_ != ']' &&
+           *p_ != '{' && *p_ != '}' &&
+           !(*p_ == ':' && (isSeparator(p_ + 1) || p_[1] == ',' || p_[1] == ']' || p_[1] == '}')) &&
+           !(*p_ == '#' && p_ > start && isBlank(p_[-1]))) {
+        ++p_;
+    }
+    const char* end = p_;
+    while (end > start && (isBlank(end[-1]) || end[-1] == '\r')) {
+        --end;
+    }
+    return std::string(start, end - start);
+}
+
+Values* YamlReader::parseFlowMapping() {
+    ++p_; // '{'
+    Values* map = Values::MakeMap(std::map<std::string, Values*>());
+    try {
+        for (;;) {
+            skipFlowSpace();
+            if (p_ < end_ && *p_ == '}') {
+                ++p_;
+                break;
+            }
+            if (p_ >= end_) {
+                error("unterminated flow mapping");
+            }
+            std::string key = (*p_ == '"' || *p_ == '\'') ? readQuoted() : readFlowPlain();
+            skipFlowSpace();
+            Values* value;
+            if (p_ < end_ && *p_ == ':') {
+                ++p_;
+                skipFlowSpace();
+                if (p_ < end_ && (*p_ == ',' || *p_ == '}')) {
+                    value = Values::MakeNull();
+                } else {
+                    value = parseFlowNode();
+                }
+            } else {
+                value = Values::MakeNull();
+            }
+            putMapEntry(map, key, value);
+            skipFlowSpace();
+            if (p_ < end_ && *p_ == ',') {
+                ++p_;
+            } else if (p_ < end_ && *p_ == '}') {
+                ++p_;
+                break;
+            } else {
+                error("expected ',' or '}' in flow mapping");
+            }
+        }
+    } catch (...) {
+        delete map;
+        throw;
+    }
+    finishMap(map);
+    return map;
+}
+
+Values* YamlReader::parseFlowSequence() {
+    ++p_; // '['
+    Values* list = Values::MakeList(std::vector<Values*>());
+    try {
+        for (;;) {
+            skipFlowSpace();
+            if (p_ < end_ && *p_ == ']') {
+                ++p_;
+                break;
+            }
+            list->Append(parseFlowNode());
+            skipFlowSpace();
+            if (p_ < end_ && *p_ == ',') {
+                ++p_;
+            } else if (p_ < end_ && *p_ == ']') {
+                ++p_;
+                break;
+            } else {
+                error("expected ',' or ']' in flow sequence");
+            }
+        }
+    } catch (...) {
+        delete list;
+        throw;
+    }
+    return list;
+}
+
+} // namespace
+
+Values* ParseSimpleYAML(const std::string& yamlText) {
+    return ParseSimpleYAML(yamlText.data(), yamlText.size());
+}
+
+Values* ParseSimpleYAML(const char* yamlText, size_t size) {
+    YamlReader reader(yamlText, size);
+    return reader.ReadDocument();
+}
+
+Values* ParseSimpleYAMLFile(const std::string& filename) {
+    // 直接解析映射（或读入）的文件内容
+    FileBuffer file;
+    if (!file.Load(filename)) {
+        throw ValueError(NoTable, "Could not open file: " + filename);
+    }
+    return ParseSimpleYAML(file.Data(), file.Size());
+}
+
+} // namespace template_engine